@@ -0,0 +1,104 @@
+#include "Corpus.h"
+
+#include "src/mml/MathMLGenerator.h"
+#include "src/mml/OutputSink.h"
+
+#include <benchmark/benchmark.h>
+
+#include <atomic>
+#include <cstdlib>
+#include <new>
+#include <string>
+
+namespace
+{
+// Heap allocations are only counted while a benchmark asks for it, so
+// nothing google benchmark does in between shows up
+std::atomic<bool> counting{false};
+std::atomic<std::uint64_t> allocations{0};
+} // namespace
+
+void* operator new(std::size_t size)
+{
+    if (counting.load(std::memory_order_relaxed))
+    {
+        allocations.fetch_add(1, std::memory_order_relaxed);
+    }
+    if (void* p = std::malloc(size ? size : 1))
+    {
+        return p;
+    }
+    throw std::bad_alloc();
+}
+
+void operator delete(void* p) noexcept
+{
+    std::free(p);
+}
+
+void operator delete(void* p, std::size_t) noexcept
+{
+    std::free(p);
+}
+
+namespace TXL
+{
+namespace
+{
+// Appends to a string like StringSink but ignores size hints, which is how
+// the output grew before the generator estimated it
+class AppendSink final : public OutputSink
+{
+public:
+    explicit AppendSink(std::string& out)
+        : _out(out)
+    {
+    }
+
+    void write(std::string_view text) override
+    {
+        _out.append(text.data(), text.size());
+    }
+
+private:
+    std::string& _out;
+};
+
+// Every test formula converted into a new string by a generator that has
+// already seen them all, so the counter shows what growing the output costs.
+// 0 ignores the estimate, 1 reserves it.
+void BM_OutputReallocations(benchmark::State& state)
+{
+    const auto& formulas = Bench::getTestFormulas();
+    const bool reserve = state.range(0) != 0;
+
+    std::string output;
+    AppendSink append(output);
+    StringSink hinted(output);
+    OutputSink& sink = reserve ? static_cast<OutputSink&>(hinted) : append;
+    MathMLGenerator generator(sink);
+    for (const auto& tex : formulas)
+    {
+        generator.generate(tex);
+    }
+
+    std::uint64_t counted = 0;
+    for (auto _ : state)
+    {
+        for (const auto& tex : formulas)
+        {
+            std::string().swap(output);
+            allocations = 0;
+            counting = true;
+            generator.generate(tex);
+            counting = false;
+            counted += allocations;
+            benchmark::DoNotOptimize(output);
+        }
+    }
+    state.counters["allocations/formula"] =
+        static_cast<double>(counted) / static_cast<double>(state.iterations() * formulas.size());
+}
+BENCHMARK(BM_OutputReallocations)->Arg(0)->Arg(1);
+} // namespace
+} // namespace TXL
@@ -0,0 +1,236 @@
+#include "Corpus.h"
+
+#include <algorithm>
+#include <filesystem>
+#include <fstream>
+#include <iterator>
+#include <random>
+
+namespace TXL
+{
+namespace Bench
+{
+namespace
+{
+const char* const SYMBOLS[] = {
+    "\\alpha", "\\beta", "\\pi", "\\infty", "\\cdot", "\\leq", "\\to", "\\partial", "+", "-", "=", "<", ",",
+};
+
+const char* const ENVIRONMENTS[] = {"matrix", "pmatrix", "bmatrix", "vmatrix"};
+
+class SyntheticFormula final
+{
+public:
+    explicit SyntheticFormula(std::mt19937& random)
+        : _random(random)
+    {}
+
+    std::string make()
+    {
+        addRow(3);
+        return std::move(_tex);
+    }
+
+private:
+    // std::uniform_int_distribution differs between standard libraries
+    std::size_t pick(std::size_t count)
+    {
+        return _random() % count;
+    }
+
+    void addRow(int depth)
+    {
+        const auto length = 1 + pick(depth > 0 ? 6 : 3);
+        for (std::size_t i = 0; i < length; ++i)
+        {
+            addTerm(depth);
+        }
+    }
+
+    void addGroup(int depth)
+    {
+        _tex.append("{");
+        addRow(depth - 1);
+        _tex.append("}");
+    }
+
+    void addTerm(int depth)
+    {
+        switch (depth > 0 ? pick(10) : pick(3))
+        {
+            case 0:
+                _tex.append(1, static_cast<char>('a' + pick(26)));
+                break;
+
+            case 1:
+                _tex.append(std::to_string(pick(1000)));
+                break;
+
+            case 2:
+                _tex.append(" ").append(SYMBOLS[pick(std::size(SYMBOLS))]).append(" ");
+                break;
+
+            case 3:
+                _tex.append(1, static_cast<char>('x' + pick(3))).append(pick(2) ? "^" : "_");
+                addGroup(depth);
+                break;
+
+            case 4:
+                _tex.append("\\frac");
+                addGroup(depth);
+                addGroup(depth);
+                break;
+
+            case 5:
+                _tex.append("\\sqrt");
+                if (pick(3) == 0)
+                {
+                    _tex.append("[").append(std::to_string(2 + pick(3))).append("]");
+                }
+                addGroup(depth);
+                break;
+
+            case 6:
+                _tex.append("\\left( ");
+                addRow(depth - 1);
+                _tex.append(" \\right)");
+                break;
+
+            case 7:
+            {
+                const auto* env = ENVIRONMENTS[pick(std::size(ENVIRONMENTS))];
+                const auto size = 1 + pick(3);
+                _tex.append("\\begin{").append(env).append("}");
+                for (std::size_t row = 0; row < size; ++row)
+                {
+                    for (std::size_t col = 0; col < size; ++col)
+                    {
+                        _tex.append(col ? " & " : " ");
+                        addRow(depth - 2);
+                    }
+                    _tex.append(" \\\\");
+                }
+                _tex.append(" \\end{").append(env).append("}");
+                break;
+            }
+
+            case 8:
+                _tex.append("\\sum_{i=").append(std::to_string(pick(2))).append("}^{n} ");
+                break;
+
+            case 9:
+                _tex.append("\\mbox{for all } ");
+                break;
+        }
+    }
+
+private:
+    std::mt19937& _random;
+    std::string _tex;
+};
+} // namespace
+
+const std::vector<std::string>& getTestFormulas()
+{
+    static const std::vector<std::string> formulas = []
+    {
+        std::vector<std::filesystem::path> paths;
+        for (const auto& entry : std::filesystem::directory_iterator(TXL_TEST_FILES_DIR))
+        {
+            if (entry.path().extension() == ".tex")
+            {
+                paths.push_back(entry.path());
+            }
+        }
+        std::sort(paths.begin(), paths.end());
+
+        std::vector<std::string> result;
+        for (const auto& path : paths)
+        {
+            std::ifstream file(path);
+            result.emplace_back((std::istreambuf_iterator<char>(file)),
+                                 std::istreambuf_iterator<char>());
+        }
+        return result;
+    }();
+    return formulas;
+}
+
+std::string makeCorpusText(std::size_t minSize)
+{
+    std::string text;
+    while (text.size() < minSize)
+    {
+        for (const auto& formula : getTestFormulas())
+        {
+            text.append(formula).append("\n");
+        }
+    }
+    return text;
+}
+
+std::vector<std::string> makeSyntheticCorpus(std::size_t count, std::uint32_t seed)
+{
+    std::mt19937 random(seed);
+    std::vector<std::string> corpus;
+    corpus.reserve(count);
+    for (std::size_t i = 0; i < count; ++i)
+    {
+        corpus.push_back(SyntheticFormula(random).make());
+    }
+    return corpus;
+}
+
+std::string makeNestedFrac(std::size_t depth)
+{
+    std::string tex;
+    for (std::size_t i = 0; i < depth; ++i)
+    {
+        tex.append("\\frac{1}{1 + ");
+    }
+    tex.append("x");
+    tex.append(depth, '}');
+    return tex;
+}
+
+std::string makePmatrix(std::size_t size)
+{
+    std::string tex = "\\begin{pmatrix}";
+    for (std::size_t row = 0; row < size; ++row)
+    {
+        for (std::size_t col = 0; col < size; ++col)
+        {
+            tex.append(col ? " & " : "").append("a_{").append(std::to_string(row * size + col)).append("}");
+        }
+        tex.append(" \\\\ ");
+    }
+    return tex.append("\\end{pmatrix}");
+}
+
+std::string makeNestedLeftRight(std::size_t depth)
+{
+    std::string tex;
+    for (std::size_t i = 0; i < depth; ++i)
+    {
+        tex.append("\\left( x + ");
+    }
+    tex.append("y");
+    for (std::size_t i = 0; i < depth; ++i)
+    {
+        tex.append(" \\right)");
+    }
+    return tex;
+}
+
+std::string makeTextRun(std::size_t length)
+{
+    std::string tex;
+    tex.reserve(length);
+    for (std::size_t i = 0; i < length; ++i)
+    {
+        tex.push_back(static_cast<char>('a' + i % 26));
+    }
+    return tex;
+}
+} // namespace Bench
+} // namespace TXL
@@ -0,0 +1,29 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace TXL
+{
+namespace Bench
+{
+// Formulas of test/files/*.tex, sorted by file name.
+const std::vector<std::string>& getTestFormulas();
+
+// The test formulas joined by newlines and repeated until the text is at
+// least `minSize` bytes long.
+std::string makeCorpusText(std::size_t minSize);
+
+// Random formulas built from the constructs the generator knows: scripts,
+// fractions, roots, \left...\right, matrices, text, symbols and numbers.
+// The same seed always gives the same corpus, on every platform.
+std::vector<std::string> makeSyntheticCorpus(std::size_t count, std::uint32_t seed = 1);
+
+// Inputs that stress one feature, growing with the argument
+std::string makeNestedFrac(std::size_t depth);
+std::string makePmatrix(std::size_t size);
+std::string makeNestedLeftRight(std::size_t depth);
+std::string makeTextRun(std::size_t length);
+} // namespace Bench
+} // namespace TXL
@@ -0,0 +1,119 @@
+#include "Corpus.h"
+
+#include "src/Lexer.h"
+#include "src/SimdScanner.h"
+
+#include <benchmark/benchmark.h>
+
+#include <string_view>
+
+namespace TXL
+{
+namespace
+{
+const std::size_t CORPUS_SIZE = 1 << 20;
+
+void setCounters(benchmark::State& state, std::size_t bytes, std::size_t tokens)
+{
+    state.SetBytesProcessed(static_cast<int64_t>(state.iterations() * bytes));
+    state.counters["tokens/s"] = benchmark::Counter(static_cast<double>(state.iterations() * tokens),
+                                                    benchmark::Counter::kIsRate);
+}
+
+// Whichever backend Lexer was built with, flex by default
+void BM_LexerTokenize(benchmark::State& state)
+{
+    const auto text = Bench::makeCorpusText(CORPUS_SIZE);
+    Lexer lexer;
+    TokenArray tokens;
+    for (auto _ : state)
+    {
+        lexer.tokenize(text, tokens);
+        benchmark::DoNotOptimize(tokens.types.data());
+    }
+    setCounters(state, text.size(), tokens.size());
+}
+BENCHMARK(BM_LexerTokenize);
+
+void BM_LexerNext(benchmark::State& state)
+{
+    const auto text = Bench::makeCorpusText(CORPUS_SIZE);
+    Lexer lexer;
+    std::size_t count = 0;
+    for (auto _ : state)
+    {
+        count = 1;
+        lexer.reset(text);
+        for (auto token = lexer.next(); token.type != END; token = lexer.next())
+        {
+            benchmark::DoNotOptimize(token.content.data());
+            ++count;
+        }
+    }
+    setCounters(state, text.size(), count);
+}
+BENCHMARK(BM_LexerNext);
+
+void BM_LexerNextView(benchmark::State& state)
+{
+    const auto text = Bench::makeCorpusText(CORPUS_SIZE);
+    Lexer lexer;
+    std::size_t count = 0;
+    for (auto _ : state)
+    {
+        count = 1;
+        lexer.reset(text);
+        for (auto token = lexer.nextView(); token.type != END; token = lexer.nextView())
+        {
+            benchmark::DoNotOptimize(token.content.data());
+            ++count;
+        }
+    }
+    setCounters(state, text.size(), count);
+}
+BENCHMARK(BM_LexerNextView);
+
+// One TEXT token as long as the argument
+void BM_LexerTextRun(benchmark::State& state)
+{
+    const auto text = Bench::makeTextRun(static_cast<std::size_t>(state.range(0)));
+    Lexer lexer;
+    TokenArray tokens;
+    for (auto _ : state)
+    {
+        lexer.tokenize(text, tokens);
+        benchmark::DoNotOptimize(tokens.types.data());
+    }
+    setCounters(state, text.size(), tokens.size());
+    state.SetComplexityN(state.range(0));
+}
+BENCHMARK(BM_LexerTextRun)->RangeMultiplier(8)->Range(64, 1 << 18)->Complexity(benchmark::oN);
+
+// Compares with BM_LexerTokenize, which only makes sense when Lexer is not
+// SimdScanner already
+void BM_SimdScanner(benchmark::State& state)
+{
+    if (std::string_view(TXL_LEXER_BACKEND) == "simd")
+    {
+        state.SkipWithError("Lexer is built with the simd backend, use flex to compare the two");
+        return;
+    }
+
+    const auto text = Bench::makeCorpusText(CORPUS_SIZE);
+    SimdScanner scanner;
+    std::size_t count = 0;
+    for (auto _ : state)
+    {
+        count = 0;
+        scanner.reset(text.data(), text.size());
+        while (scanner.next() != END)
+        {
+            benchmark::DoNotOptimize(scanner.text());
+            ++count;
+        }
+    }
+    setCounters(state, text.size(), count + 1);
+}
+BENCHMARK(BM_SimdScanner);
+} // namespace
+} // namespace TXL
@@ -0,0 +1,116 @@
+#include "Corpus.h"
+
+#include "src/mml/MathMLGenerator.h"
+
+#include <benchmark/benchmark.h>
+
+#include <sstream>
+#include <string>
+#include <vector>
+
+namespace TXL
+{
+namespace
+{
+void run(benchmark::State& state, const std::string& tex)
+{
+    std::stringstream out;
+    MathMLGenerator generator(out);
+    for (auto _ : state)
+    {
+        out.str(std::string());
+        generator.generate(tex);
+        benchmark::DoNotOptimize(out);
+    }
+    state.SetBytesProcessed(static_cast<int64_t>(state.iterations() * tex.size()));
+}
+
+void runAll(benchmark::State& state, const std::vector<std::string>& formulas)
+{
+    std::size_t bytes = 0;
+    for (const auto& tex : formulas)
+    {
+        bytes += tex.size();
+    }
+
+    std::stringstream out;
+    MathMLGenerator generator(out);
+    for (auto _ : state)
+    {
+        for (const auto& tex : formulas)
+        {
+            out.str(std::string());
+            generator.generate(tex);
+        }
+        benchmark::DoNotOptimize(out);
+    }
+    state.SetBytesProcessed(static_cast<int64_t>(state.iterations() * bytes));
+    state.counters["formulas/s"] = benchmark::Counter(static_cast<double>(state.iterations() * formulas.size()),
+                                                      benchmark::Counter::kIsRate);
+}
+
+void BM_GenerateTestFormulas(benchmark::State& state)
+{
+    runAll(state, Bench::getTestFormulas());
+}
+BENCHMARK(BM_GenerateTestFormulas);
+
+void BM_GenerateSynthetic(benchmark::State& state)
+{
+    runAll(state, Bench::makeSyntheticCorpus(1000));
+}
+BENCHMARK(BM_GenerateSynthetic);
+
+void BM_NestedFrac(benchmark::State& state)
+{
+    run(state, Bench::makeNestedFrac(static_cast<std::size_t>(state.range(0))));
+    state.SetComplexityN(state.range(0));
+}
+BENCHMARK(BM_NestedFrac)->RangeMultiplier(2)->Range(8, 256)->Complexity(benchmark::oN);
+
+// Time per cell should stay flat as the matrix grows
+void BM_Pmatrix(benchmark::State& state)
+{
+    const auto size = static_cast<std::size_t>(state.range(0));
+    run(state, Bench::makePmatrix(size));
+    state.SetComplexityN(static_cast<int64_t>(size * size));
+}
+BENCHMARK(BM_Pmatrix)->RangeMultiplier(2)->Range(25, 200)->Complexity(benchmark::oN);
+
+void BM_SequentialLeftRight(benchmark::State& state)
+{
+    std::string tex;
+    for (int64_t i = 0; i < state.range(0); ++i)
+    {
+        tex.append("\\left( x_{").append(std::to_string(i)).append("} \\right) + ");
+    }
+    run(state, tex);
+    state.SetComplexityN(state.range(0));
+}
+BENCHMARK(BM_SequentialLeftRight)->RangeMultiplier(4)->Range(64, 4096)->Complexity(benchmark::oN);
+
+void BM_NestedLeftRight(benchmark::State& state)
+{
+    run(state, Bench::makeNestedLeftRight(static_cast<std::size_t>(state.range(0))));
+    state.SetComplexityN(state.range(0));
+}
+BENCHMARK(BM_NestedLeftRight)->RangeMultiplier(2)->Range(8, 256)->Complexity();
+
+void BM_TextRun(benchmark::State& state)
+{
+    run(state, Bench::makeTextRun(static_cast<std::size_t>(state.range(0))));
+    state.SetComplexityN(state.range(0));
+}
+BENCHMARK(BM_TextRun)->RangeMultiplier(8)->Range(64, 1 << 18)->Complexity(benchmark::oN);
+
+// Formulas of one identifier, number or symbol. /1 takes the fast path,
+// /0 the general one: the lexer skips the leading space, but the fast path
+// does not accept it, so the output is the same.
+void BM_SingleToken(benchmark::State& state)
+{
+    const std::string prefix = state.range(0) ? "" : " ";
+    runAll(state, {prefix + "x", prefix + "42", prefix + "\\alpha", prefix + "\\le"});
+}
+BENCHMARK(BM_SingleToken)->Arg(0)->Arg(1);
+} // namespace
+} // namespace TXL
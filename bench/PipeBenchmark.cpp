@@ -0,0 +1,103 @@
+#include "Corpus.h"
+
+#include "src/mml/MathMLGenerator.h"
+#include "src/mml/OutputSink.h"
+
+#include <benchmark/benchmark.h>
+
+#ifdef TXL_HAS_WRITEV
+#include <fstream>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <unistd.h>
+
+namespace TXL
+{
+namespace
+{
+// A pipe with a thread reading and dropping everything written to it
+class Pipe final
+{
+public:
+    Pipe()
+    {
+        if (::pipe(_fds) != 0)
+        {
+            throw std::runtime_error("pipe");
+        }
+        _reader = std::thread([fd = _fds[0]]
+        {
+            char buffer[65536];
+            while (::read(fd, buffer, sizeof(buffer)) > 0)
+            {
+            }
+        });
+    }
+
+    ~Pipe()
+    {
+        ::close(_fds[1]);
+        _reader.join();
+        ::close(_fds[0]);
+    }
+
+    int fd() const
+    {
+        return _fds[1];
+    }
+
+private:
+    int _fds[2];
+    std::thread _reader;
+};
+
+// The test formulas written to a pipe, as texToMML does with its stdout.
+// fd:0 goes through an std::ofstream, fd:1 through FdSink. batch:0 flushes
+// after every document, batch:1 once per pass over the formulas.
+void BM_PipeThroughput(benchmark::State& state)
+{
+    const auto& formulas = Bench::getTestFormulas();
+    const bool fd = state.range(0) != 0;
+    const bool batch = state.range(1) != 0;
+
+    Pipe pipe;
+    std::ofstream stream;
+    std::unique_ptr<OutputSink> sink;
+    if (fd)
+    {
+        sink = std::make_unique<FdSink>(pipe.fd());
+    }
+    else
+    {
+        stream.open("/dev/fd/" + std::to_string(pipe.fd()), std::ios::binary);
+        sink = std::make_unique<StreamSink>(stream);
+    }
+
+    MathMLGenerator generator(*sink);
+    generator.setFlushMode(batch ? MathMLGenerator::FlushMode::OnDemand : MathMLGenerator::FlushMode::EachDocument);
+
+    std::size_t bytes = 0;
+    for (const auto& tex : formulas)
+    {
+        bytes += tex.size();
+    }
+    for (auto _ : state)
+    {
+        for (const auto& tex : formulas)
+        {
+            generator.generate(tex);
+        }
+        generator.flush();
+    }
+    state.SetBytesProcessed(static_cast<int64_t>(state.iterations() * bytes));
+    state.counters["formulas/s"] = benchmark::Counter(static_cast<double>(state.iterations() * formulas.size()),
+                                                      benchmark::Counter::kIsRate);
+}
+BENCHMARK(BM_PipeThroughput)->ArgNames({"fd", "batch"})->ArgsProduct({{0, 1}, {0, 1}})->UseRealTime();
+} // namespace
+} // namespace TXL
+#endif
@@ -0,0 +1,340 @@
+#include "FormulaReader.h"
+
+#include <stdexcept>
+#include <string_view>
+
+namespace TXL
+{
+namespace
+{
+class JsonParser final
+{
+public:
+    JsonParser(const std::string& text, std::size_t lineNumber)
+        : _text(text)
+        , _lineNumber(lineNumber)
+    {
+    }
+
+    // Accepts {"tex": "..."} with any other members, or a bare "..."
+    void parseFormula(std::string& tex)
+    {
+        skipWhitespace();
+        if (peek() == '"')
+        {
+            parseString(tex);
+        }
+        else
+        {
+            bool found = false;
+            expect('{');
+            skipWhitespace();
+            if (peek() == '}')
+            {
+                ++_pos;
+            }
+            else
+            {
+                std::string key;
+                for (;;)
+                {
+                    skipWhitespace();
+                    parseString(key);
+                    skipWhitespace();
+                    expect(':');
+                    skipWhitespace();
+                    if (key == "tex" && peek() == '"')
+                    {
+                        parseString(tex);
+                        found = true;
+                    }
+                    else
+                    {
+                        skipValue();
+                    }
+                    skipWhitespace();
+                    if (peek() == ',')
+                    {
+                        ++_pos;
+                        continue;
+                    }
+                    expect('}');
+                    break;
+                }
+            }
+            if (!found)
+            {
+                fail("no \"tex\" string member");
+            }
+        }
+
+        skipWhitespace();
+        if (_pos != _text.size())
+        {
+            fail("unexpected trailing characters");
+        }
+    }
+
+private:
+    char peek() const
+    {
+        return _pos < _text.size() ? _text[_pos] : '\0';
+    }
+
+    void expect(const char c)
+    {
+        if (peek() != c)
+        {
+            fail(std::string("expected '") + c + "'");
+        }
+        ++_pos;
+    }
+
+    void skipWhitespace()
+    {
+        while (_pos < _text.size() && (_text[_pos] == ' ' || _text[_pos] == '\t' || _text[_pos] == '\r'))
+        {
+            ++_pos;
+        }
+    }
+
+    void parseString(std::string& out)
+    {
+        out.clear();
+        expect('"');
+        for (;;)
+        {
+            if (_pos >= _text.size())
+            {
+                fail("unterminated string");
+            }
+
+            const char c = _text[_pos++];
+            if (c == '"')
+            {
+                return;
+            }
+            if (c != '\\')
+            {
+                out.push_back(c);
+                continue;
+            }
+
+            switch (peek())
+            {
+                case '"': out.push_back('"'); break;
+                case '\\': out.push_back('\\'); break;
+                case '/': out.push_back('/'); break;
+                case 'b': out.push_back('\b'); break;
+                case 'f': out.push_back('\f'); break;
+                case 'n': out.push_back('\n'); break;
+                case 'r': out.push_back('\r'); break;
+                case 't': out.push_back('\t'); break;
+                case 'u':
+                {
+                    ++_pos;
+                    auto codePoint = parseHex4();
+                    // Surrogates only come in pairs, a lone one is no character
+                    if (codePoint >= 0xDC00 && codePoint < 0xE000)
+                    {
+                        fail("unpaired surrogate in \\u escape");
+                    }
+                    if (codePoint >= 0xD800 && codePoint < 0xDC00)
+                    {
+                        if (_text.compare(_pos, 2, "\\u") != 0)
+                        {
+                            fail("unpaired surrogate in \\u escape");
+                        }
+                        _pos += 2;
+                        const auto low = parseHex4();
+                        if (low < 0xDC00 || low >= 0xE000)
+                        {
+                            fail("unpaired surrogate in \\u escape");
+                        }
+                        codePoint = 0x10000 + ((codePoint - 0xD800) << 10) + (low - 0xDC00);
+                    }
+                    appendUtf8(out, codePoint);
+                    continue;
+                }
+                default:
+                    fail("invalid escape sequence");
+            }
+            ++_pos;
+        }
+    }
+
+    unsigned parseHex4()
+    {
+        unsigned value = 0;
+        for (int i = 0; i < 4; ++i, ++_pos)
+        {
+            const char c = peek();
+            value <<= 4;
+            if (c >= '0' && c <= '9') value |= c - '0';
+            else if (c >= 'a' && c <= 'f') value |= c - 'a' + 10;
+            else if (c >= 'A' && c <= 'F') value |= c - 'A' + 10;
+            else fail("invalid \\u escape");
+        }
+        return value;
+    }
+
+    static void appendUtf8(std::string& out, const unsigned codePoint)
+    {
+        if (codePoint < 0x80)
+        {
+            out.push_back(static_cast<char>(codePoint));
+        }
+        else if (codePoint < 0x800)
+        {
+            out.push_back(static_cast<char>(0xC0 | (codePoint >> 6)));
+            out.push_back(static_cast<char>(0x80 | (codePoint & 0x3F)));
+        }
+        else if (codePoint < 0x10000)
+        {
+            out.push_back(static_cast<char>(0xE0 | (codePoint >> 12)));
+            out.push_back(static_cast<char>(0x80 | ((codePoint >> 6) & 0x3F)));
+            out.push_back(static_cast<char>(0x80 | (codePoint & 0x3F)));
+        }
+        else
+        {
+            out.push_back(static_cast<char>(0xF0 | (codePoint >> 18)));
+            out.push_back(static_cast<char>(0x80 | ((codePoint >> 12) & 0x3F)));
+            out.push_back(static_cast<char>(0x80 | ((codePoint >> 6) & 0x3F)));
+            out.push_back(static_cast<char>(0x80 | (codePoint & 0x3F)));
+        }
+    }
+
+    // Skips a value that is not the formula, without interpreting it
+    void skipValue()
+    {
+        std::size_t depth = 0;
+        std::string ignored;
+        do
+        {
+            skipWhitespace();
+            switch (peek())
+            {
+                case '"':
+                    parseString(ignored);
+                    break;
+
+                case '{':
+                case '[':
+                    ++depth;
+                    ++_pos;
+                    break;
+
+                case '}':
+                case ']':
+                    if (depth == 0)
+                    {
+                        fail("unexpected end of value");
+                    }
+                    --depth;
+                    ++_pos;
+                    break;
+
+                case '\0':
+                    fail("unexpected end of line");
+
+                default:
+                    // numbers, literals, ',' and ':' inside containers
+                    while (_pos < _text.size() && std::string_view(",]}\" \t").find(_text[_pos]) == std::string_view::npos)
+                    {
+                        ++_pos;
+                    }
+                    if (depth != 0 && (peek() == ',' || peek() == ':'))
+                    {
+                        ++_pos;
+                    }
+                    break;
+            }
+        } while (depth != 0);
+    }
+
+    [[noreturn]] void fail(const std::string& what) const
+    {
+        throw std::runtime_error("line " + std::to_string(_lineNumber) + ": " + what);
+    }
+
+private:
+    const std::string& _text;
+    std::size_t _pos = 0;
+    std::size_t _lineNumber;
+};
+} // namespace
+
+FormulaReader::FormulaReader(std::istream& in, Format format, std::string delimiter)
+    : _in(in)
+    , _format(format)
+    , _delimiter(std::move(delimiter))
+{
+}
+
+bool FormulaReader::readLine()
+{
+    if (!std::getline(_in, _line))
+    {
+        return false;
+    }
+    ++_lineNumber;
+    if (!_line.empty() && _line.back() == '\r')
+    {
+        _line.pop_back();
+    }
+    return true;
+}
+
+bool FormulaReader::next(std::string& tex)
+{
+    switch (_format)
+    {
+        case Format::Lines:
+            if (!readLine())
+            {
+                return false;
+            }
+            tex.swap(_line);
+            return true;
+
+        case Format::Delimited:
+        {
+            tex.clear();
+            bool hasContent = false;
+            while (readLine())
+            {
+                if (_line == _delimiter)
+                {
+                    return true;
+                }
+                if (hasContent)
+                {
+                    tex.push_back('\n');
+                }
+                tex.append(_line);
+                hasContent = true;
+            }
+            // The last formula does not need a delimiter after it
+            return hasContent;
+        }
+
+        case Format::JsonLines:
+            while (readLine())
+            {
+                if (_line.find_first_not_of(" \t") == std::string::npos)
+                {
+                    continue;
+                }
+                parseJsonLine(tex);
+                return true;
+            }
+            return false;
+    }
+    return false;
+}
+
+void FormulaReader::parseJsonLine(std::string& tex) const
+{
+    JsonParser(_line, _lineNumber).parseFormula(tex);
+}
+} // namespace TXL
@@ -0,0 +1,49 @@
+#pragma once
+
+#include <cstddef>
+#include <istream>
+#include <string>
+
+namespace TXL
+{
+// Splits a stream holding many formulas into single formulas.
+// Input is read line by line, so a formula is available as soon as its
+// last line arrives, and only the current formula is kept in memory.
+class FormulaReader final
+{
+public:
+    enum class Format
+    {
+        // Every line is a formula
+        Lines,
+        // Formulas are separated by lines equal to the delimiter
+        Delimited,
+        // Every line is a JSON object with a "tex" string member, or a JSON string
+        JsonLines,
+    };
+
+public:
+    FormulaReader(std::istream& in, Format format, std::string delimiter = std::string());
+
+    // Reads the next formula into tex. Returns false at the end of input.
+    // Throws std::runtime_error on a malformed JSON line.
+    bool next(std::string& tex);
+
+    // Line number of the last line read, starting at 1
+    std::size_t lineNumber() const
+    {
+        return _lineNumber;
+    }
+
+private:
+    bool readLine();
+    void parseJsonLine(std::string& tex) const;
+
+private:
+    std::istream& _in;
+    Format _format;
+    std::string _delimiter;
+    std::string _line;
+    std::size_t _lineNumber = 0;
+};
+} // namespace TXL
@@ -1,6 +1,10 @@
 #include "Lexer.h"
 #include "Token.h"
 
+#include <cstdint>
+#include <limits>
+#include <stdexcept>
+
 extern "C"
 {
 int txllex_init(void* scanCtx) ;
@@ -10,12 +14,27 @@ int txllex(void* scanCtx);
 std::size_t txlget_leng(void* scanCtx);
 char* txlget_text(void* scanCtx);
 
-void* initBuffer(const char* text, std::size_t size, void* const scanCtx);
+void* scanBuffer(void* buffer, char* text, std::size_t size, void* const scanCtx);
 void freeBuffer(void* buffer, void* const scanCtx);
+const char* bufferBase(void* buffer);
 }
 
 namespace TXL
 {
+namespace
+{
+// Offsets and lengths of tokens are 32 bit, the two NUL bytes included
+constexpr std::size_t MAX_TEXT_SIZE = std::numeric_limits<std::uint32_t>::max() - 2;
+
+void checkSize(std::size_t size)
+{
+    if (size > MAX_TEXT_SIZE)
+    {
+        throw std::length_error("Lexer::reset: text too large");
+    }
+}
+} // namespace
+
 Lexer::Lexer()
 {
     txllex_init(&_scanCtx);
@@ -24,7 +43,7 @@ Lexer::Lexer()
 Lexer::Lexer(const std::string& text)
 {
     txllex_init(&_scanCtx);
-    _buffer = initBuffer(text.data(), text.size(), _scanCtx);
+    reset(text);
 }
 
 Lexer::~Lexer()
@@ -40,9 +59,80 @@ Lexer::~Lexer()
     }
 }
 
+void Lexer::reset(std::string_view text)
+{
+    checkSize(text.size());
+    _storage.assign(text.data(), text.size());
+    _storage.append(2, '\0');
+    reset(&_storage[0], _storage.size());
+}
+
+void Lexer::reset(char* buffer, std::size_t size)
+{
+    if (size >= 2)
+    {
+        checkSize(size - 2);
+    }
+    if (size < 2 || buffer[size - 2] != '\0' || buffer[size - 1] != '\0')
+    {
+        throw std::invalid_argument("Lexer::reset: the buffer must end with two NUL bytes");
+    }
+    _buffer = scanBuffer(_buffer, buffer, size, _scanCtx);
+}
+
 Token Lexer::next()
 {
-    auto result = txllex(_scanCtx);
-    return {TokenType(result), std::string(txlget_text(_scanCtx), txlget_leng(_scanCtx))};
+    const auto token = nextView();
+    return {token.type, std::string(token.content)};
+}
+
+TokenView Lexer::nextView()
+{
+    const auto type = TokenType(txllex(_scanCtx));
+    const std::string_view content(txlget_text(_scanCtx), txlget_leng(_scanCtx));
+    return {type, content, nameId(type, content)};
+}
+
+void Lexer::tokenize(std::string_view text, TokenArray& tokens)
+{
+    reset(text);
+    // The scanner works on its own copy of the text, offsets are the same.
+    scan(text, tokens);
+}
+
+void Lexer::tokenize(char* buffer, std::size_t size, TokenArray& tokens)
+{
+    reset(buffer, size);
+    scan(std::string_view(buffer, size - 2), tokens);
+}
+
+TokenArray Lexer::tokenize(std::string_view text)
+{
+    TokenArray tokens;
+    tokenize(text, tokens);
+    return tokens;
+}
+
+void Lexer::scan(std::string_view source, TokenArray& tokens)
+{
+    const auto base = bufferBase(_buffer);
+
+    tokens.clear();
+    tokens.source = source;
+    for (;;)
+    {
+        const auto type = TokenType(txllex(_scanCtx));
+        const auto tokenText = txlget_text(_scanCtx);
+        // yyleng is not updated when the scanner hits the end of input
+        const auto length = type == END ? 0 : txlget_leng(_scanCtx);
+        tokens.types.push_back(static_cast<std::uint8_t>(type));
+        tokens.offsets.push_back(static_cast<std::uint32_t>(tokenText - base));
+        tokens.lengths.push_back(static_cast<std::uint32_t>(length));
+        tokens.ids.push_back(nameId(type, std::string_view(tokenText, length)));
+        if (type == END)
+        {
+            break;
+        }
+    }
 }
 } // namespace TXL
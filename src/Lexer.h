@@ -1,6 +1,7 @@
 #pragma once
 
 #include "Token.h"
+#include "TokenArray.h"
 
 namespace TXL
 {
@@ -11,10 +12,47 @@ public:
     Lexer(const std::string& text);
     ~Lexer();
 
+    Lexer(const Lexer&) = delete;
+    Lexer& operator=(const Lexer&) = delete;
+
+    // Starts scanning text from the beginning, reusing the scanner.
+    // The text is copied into a buffer kept by the lexer, which only
+    // reallocates when a longer text comes in. Throws std::length_error
+    // for 4 GiB and more, token offsets are 32 bit.
+    void reset(std::string_view text);
+
+    // Scans the buffer in place, without copying it. The last two bytes
+    // must be NUL and are not part of the text. The scanner temporarily
+    // writes into the buffer while it works, so it has to stay writable
+    // and alive until the next reset() or the lexer is destroyed.
+    void reset(char* buffer, std::size_t size);
+
     Token next();
 
+    // Returns the next token without copying its content.
+    // After reset() the view stays valid until the next reset() or until the
+    // lexer is destroyed. When it reads from stdin the view is only valid
+    // until the next call to next() or nextView().
+    TokenView nextView();
+
+    // Lexes the whole text at once, like reset() followed by nextView()
+    // until END. A literal "EOF" in the text is an END as well and ends the
+    // array, whatever follows it is not lexed.
+    // The array is cleared first, so it can be reused between calls
+    // without reallocating.
+    void tokenize(std::string_view text, TokenArray& tokens);
+    TokenArray tokenize(std::string_view text);
+
+    // Same on a buffer scanned in place, see reset(char*, std::size_t).
+    // The tokens point into the buffer.
+    void tokenize(char* buffer, std::size_t size, TokenArray& tokens);
+
+private:
+    void scan(std::string_view source, TokenArray& tokens);
+
 private:
     void* _scanCtx = nullptr;
     void* _buffer = nullptr;
+    std::string _storage;
 };
 } // namespace TXL
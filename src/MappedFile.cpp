@@ -0,0 +1,107 @@
+#include "MappedFile.h"
+
+#include <cerrno>
+#include <cstdint>
+#include <limits>
+#include <stdexcept>
+#include <system_error>
+
+#if defined(__unix__) || defined(__APPLE__)
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#define TXL_HAS_MMAP 1
+#else
+#include <fstream>
+#endif
+
+namespace TXL
+{
+namespace
+{
+// Token offsets are 32 bit
+constexpr std::size_t MAX_SIZE = std::numeric_limits<std::uint32_t>::max() - 2;
+
+[[noreturn]] void fail(const std::string& path)
+{
+    throw std::system_error(errno, std::generic_category(), path);
+}
+} // namespace
+
+#ifdef TXL_HAS_MMAP
+MappedFile::MappedFile(const std::string& path, Access access)
+{
+    const int fd = ::open(path.c_str(), O_RDONLY);
+    if (fd < 0)
+    {
+        fail(path);
+    }
+
+    struct stat info;
+    if (::fstat(fd, &info) != 0)
+    {
+        const auto error = errno;
+        ::close(fd);
+        errno = error;
+        fail(path);
+    }
+    if (static_cast<std::size_t>(info.st_size) > MAX_SIZE)
+    {
+        ::close(fd);
+        throw std::length_error(path + ": file too large");
+    }
+    _size = static_cast<std::size_t>(info.st_size);
+    _mappedSize = _size + 2;
+
+    // Anonymous zero pages with the file mapped over their start, so the
+    // NUL bytes are there even when the file ends on a page boundary
+    const int protection = access == Access::ReadOnly ? PROT_READ : PROT_READ | PROT_WRITE;
+    void* region = ::mmap(nullptr, _mappedSize, protection, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (region == MAP_FAILED)
+    {
+        const auto error = errno;
+        ::close(fd);
+        errno = error;
+        fail(path);
+    }
+    if (_size && ::mmap(region, _size, protection, MAP_PRIVATE | MAP_FIXED, fd, 0) == MAP_FAILED)
+    {
+        const auto error = errno;
+        ::munmap(region, _mappedSize);
+        ::close(fd);
+        errno = error;
+        fail(path);
+    }
+    ::close(fd);
+
+    ::madvise(region, _mappedSize, MADV_SEQUENTIAL);
+    _data = static_cast<char*>(region);
+}
+
+MappedFile::~MappedFile()
+{
+    ::munmap(_data, _mappedSize);
+}
+#else
+MappedFile::MappedFile(const std::string& path, Access)
+{
+    std::ifstream in(path, std::ios::binary | std::ios::ate);
+    if (!in)
+    {
+        fail(path);
+    }
+    _size = static_cast<std::size_t>(in.tellg());
+    if (_size > MAX_SIZE)
+    {
+        throw std::length_error(path + ": file too large");
+    }
+    _fallback.resize(_size + 2);
+    in.seekg(0);
+    in.read(_fallback.data(), static_cast<std::streamsize>(_size));
+    _data = _fallback.data();
+}
+
+MappedFile::~MappedFile() = default;
+#endif
+} // namespace TXL
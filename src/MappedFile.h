@@ -0,0 +1,57 @@
+#pragma once
+
+#include <cstddef>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace TXL
+{
+// A file mapped into memory and followed by two NUL bytes, the way
+// Lexer::reset(char*, size) wants it. The file itself never changes. Where
+// mmap() is not available the file is read into memory instead.
+class MappedFile final
+{
+public:
+    enum class Access
+    {
+        // Private, writable pages, for Lexer::reset(char*, size). A page is
+        // copied once it is written to, and the flex scanner puts a NUL
+        // after every token, so with flex the whole file ends up copied.
+        CopyOnWrite,
+        // The pages of the page cache, never copied. For scanners that do
+        // not write, like SimdScanner::tokenize().
+        ReadOnly,
+    };
+
+public:
+    // Throws std::system_error when the file cannot be opened or mapped
+    explicit MappedFile(const std::string& path, Access access = Access::CopyOnWrite);
+    ~MappedFile();
+
+    MappedFile(const MappedFile&) = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+
+    // The contents followed by the two NUL bytes, only writable with CopyOnWrite
+    char* buffer()
+    {
+        return _data;
+    }
+
+    std::size_t bufferSize() const
+    {
+        return _size + 2;
+    }
+
+    std::string_view text() const
+    {
+        return std::string_view(_data, _size);
+    }
+
+private:
+    char* _data = nullptr;
+    std::size_t _size = 0;
+    std::size_t _mappedSize = 0;
+    std::vector<char> _fallback;
+};
+} // namespace TXL
@@ -0,0 +1,36 @@
+#pragma once
+
+#include "TokenType.h"
+
+#include <cstdint>
+#include <string_view>
+
+namespace TXL
+{
+// Commands and environments the MathML generator knows get a small id while
+// lexing, so it dispatches on a number instead of comparing names. Other
+// tokens and unknown names get NO_NAME and keep only their text.
+using NameId = std::uint16_t;
+
+constexpr NameId NO_NAME = 0xFFFF;
+
+// Perfect hashes over the lists in Names.h
+NameId commandId(std::string_view name);
+NameId environmentId(std::string_view name);
+
+inline NameId nameId(TokenType type, std::string_view name)
+{
+    switch (type)
+    {
+        case COMMAND:
+            return commandId(name);
+
+        case BEGIN_ENV:
+        case END_ENV:
+            return environmentId(name);
+
+        default:
+            return NO_NAME;
+    }
+}
+} // namespace TXL
@@ -0,0 +1,162 @@
+#include "Names.h"
+
+#include <cstddef>
+#include <stdexcept>
+
+namespace TXL
+{
+namespace
+{
+// Perfect hash over a list of names, built by the compiler (hash and
+// displace). The hash of a name picks a bucket, the seed of that bucket moves
+// it to a slot no other name uses, so a lookup is one probe and one compare.
+template <std::size_t N>
+struct NameTable final
+{
+    static constexpr std::size_t BUCKETS = N / 2 + 1;
+    static constexpr std::size_t SLOTS = [](){
+        std::size_t size = 1;
+        while (size < 2 * N) size <<= 1;
+        return size;
+    }();
+
+    static constexpr std::size_t bucket(std::uint64_t hash)
+    {
+        return hash % BUCKETS;
+    }
+
+    static constexpr std::size_t slot(std::uint64_t hash, std::uint32_t seed)
+    {
+        const auto h1 = static_cast<std::uint32_t>(hash);
+        const auto h2 = static_cast<std::uint32_t>(hash >> 32) | 1;
+        return (h1 + seed * h2) & (SLOTS - 1);
+    }
+
+    constexpr NameId find(const std::string_view (&names)[N], std::string_view name) const
+    {
+        const auto hash = hashText(name);
+        const auto index = slots[slot(hash, seeds[bucket(hash)])];
+        if (index == 0 || names[index - 1] != name)
+        {
+            return NO_NAME;
+        }
+        return static_cast<NameId>(index - 1);
+    }
+
+    std::uint16_t seeds[BUCKETS] = {};
+    // Index in the list plus one, 0 marks an empty slot
+    std::uint16_t slots[SLOTS] = {};
+};
+
+template <std::size_t N>
+constexpr NameTable<N> makeNameTable(const std::string_view (&names)[N])
+{
+    using Table = NameTable<N>;
+    Table table;
+
+    std::uint64_t hashes[N] = {};
+    std::size_t sizes[Table::BUCKETS] = {};
+    for (std::size_t i = 0; i < N; ++i)
+    {
+        hashes[i] = hashText(names[i]);
+        ++sizes[Table::bucket(hashes[i])];
+    }
+
+    // Names grouped by bucket
+    std::size_t begins[Table::BUCKETS + 1] = {};
+    for (std::size_t b = 0; b < Table::BUCKETS; ++b)
+    {
+        begins[b + 1] = begins[b] + sizes[b];
+    }
+    std::size_t members[N] = {};
+    std::size_t filled[Table::BUCKETS] = {};
+    for (std::size_t i = 0; i < N; ++i)
+    {
+        const auto b = Table::bucket(hashes[i]);
+        members[begins[b] + filled[b]++] = i;
+    }
+
+    // The fullest buckets are placed first, while most slots are free
+    std::size_t order[Table::BUCKETS] = {};
+    for (std::size_t b = 0; b < Table::BUCKETS; ++b)
+    {
+        order[b] = b;
+    }
+    for (std::size_t i = 0; i < Table::BUCKETS; ++i)
+    {
+        for (std::size_t j = i + 1; j < Table::BUCKETS; ++j)
+        {
+            if (sizes[order[j]] > sizes[order[i]])
+            {
+                const auto tmp = order[i];
+                order[i] = order[j];
+                order[j] = tmp;
+            }
+        }
+    }
+
+    for (const auto b : order)
+    {
+        for (std::uint32_t seed = 0;; ++seed)
+        {
+            if (seed > 0xFFFF)
+            {
+                throw std::logic_error("no perfect hash for the name table");
+            }
+
+            auto placed = begins[b];
+            for (; placed < begins[b + 1]; ++placed)
+            {
+                auto& slot = table.slots[Table::slot(hashes[members[placed]], seed)];
+                if (slot != 0)
+                {
+                    break;
+                }
+                slot = static_cast<std::uint16_t>(members[placed] + 1);
+            }
+
+            if (placed == begins[b + 1])
+            {
+                table.seeds[b] = static_cast<std::uint16_t>(seed);
+                break;
+            }
+
+            while (placed-- > begins[b])
+            {
+                table.slots[Table::slot(hashes[members[placed]], seed)] = 0;
+            }
+        }
+    }
+    return table;
+}
+
+template <std::size_t N>
+constexpr bool findsAll(const NameTable<N>& table, const std::string_view (&names)[N])
+{
+    for (std::size_t i = 0; i < N; ++i)
+    {
+        if (table.find(names, names[i]) != i)
+        {
+            return false;
+        }
+    }
+    return true;
+}
+
+constexpr auto COMMAND_TABLE = makeNameTable(COMMAND_NAMES);
+constexpr auto ENVIRONMENT_TABLE = makeNameTable(ENVIRONMENT_NAMES);
+
+static_assert(findsAll(COMMAND_TABLE, COMMAND_NAMES), "every command name must be unique");
+static_assert(findsAll(ENVIRONMENT_TABLE, ENVIRONMENT_NAMES), "every environment name must be unique");
+} // namespace
+
+NameId commandId(std::string_view name)
+{
+    return COMMAND_TABLE.find(COMMAND_NAMES, name);
+}
+
+NameId environmentId(std::string_view name)
+{
+    return ENVIRONMENT_TABLE.find(ENVIRONMENT_NAMES, name);
+}
+} // namespace TXL
@@ -0,0 +1,278 @@
+#pragma once
+
+#include "NameId.h"
+
+#include <cstdint>
+#include <iterator>
+#include <string_view>
+
+namespace TXL
+{
+// Names that get an id while lexing, see NameId.h. The id is the index in
+// these lists. The MathML generator keeps a table in the same order with
+// what each of them makes, which is checked when it is compiled.
+constexpr std::string_view COMMAND_NAMES[] =
+{
+    // Written as <mi>
+    // Greek letters
+    "alpha",
+    "beta",
+    "Gamma",
+    "gamma",
+    "Delta",
+    "delta",
+    "epsilon",
+    "zeta",
+    "eta",
+    "Theta",
+    "theta",
+    "iota",
+    "kappa",
+    "Lambda",
+    "lambda",
+    "mu",
+    "nu",
+    "Xi",
+    "xi",
+    "Pi",
+    "pi",
+    "rho",
+    "Sigma",
+    "sigma",
+    "tau",
+    "Upsilon",
+    "upsilon",
+    "Phi",
+    "phi",
+    "chi",
+    "Psi",
+    "psi",
+    "Omega",
+    "omega",
+    "varsigma",
+    "vartheta",
+    "varphi",
+    "varpi",
+    "varkappa",
+    "varrho",
+    "varepsilon",
+
+    "dots",
+    "ldots",
+    "dotso",
+    "dotsc",
+    "vdots",
+    "cdots",
+    "dotsb",
+    "ddots",
+    "udots",
+    "hbar",
+
+    // Written as <mo>
+    "Del",
+    "Im",
+    "Leftarrow",
+    "Re",
+    "Rightarrow",
+    "aleph",
+    "amalg",
+    "angle",
+    "approx",
+    "ast",
+    "bigcap",
+    "bigcup",
+    "bigvee",
+    "bigwedge",
+    "bullet",
+    "cap",
+    "cdot",
+    "circ",
+    "complement",
+    "cong",
+    "conint",
+    "contourintegral",
+    "coprod",
+    "coproduct",
+    "cup",
+    "div",
+    "doubleintegral",
+    "downarrow",
+    "equiv",
+    "exists",
+    "forall",
+    "ge",
+    "geq",
+    "geqslant",
+    "gg",
+    "gt",
+    "hslash",
+    "iff",
+    "in",
+    "infinity",
+    "infty",
+    "le",
+    "leftarrow",
+    "leq",
+    "leqslant",
+    "ll",
+    "longleftarrow",
+    "lt",
+    "measuredangle",
+    "mid",
+    "mp",
+    "nabla",
+    "ne",
+    "neg",
+    "neq",
+    "nexists",
+    "ngeq",
+    "ngtr",
+    "ni",
+    "nleq",
+    "nless",
+    "nmid",
+    "not",
+    "notin",
+    "nparallel",
+    "nprec",
+    "nsubseteq",
+    "nsucc",
+    "nsupseteq",
+    "odot",
+    "ominus",
+    "oplus",
+    "oslash",
+    "otimes",
+    "parallel",
+    "partial",
+    "perp",
+    "pm",
+    "prec",
+    "preccurlyeq",
+    "precsim",
+    "prime",
+    "propto",
+    "quadrupleintegral",
+    "rightarrow",
+    "setminus",
+    "sim",
+    "simeq",
+    "subset",
+    "subseteq",
+    "succ",
+    "succcurlyeq",
+    "succsim",
+    "supset",
+    "supseteq",
+    "times",
+    "to",
+    "triangle",
+    "triangledown",
+    "tripleintegral",
+    "uparrow",
+    "varnothing",
+    "vee",
+    "wedge",
+    "wp",
+
+    // Made by a builder
+    " ",
+    "!",
+    ",",
+    ":",
+    ";",
+    ">",
+    "bar",
+    "binom",
+    "cfrac",
+    "closure",
+    "ddot",
+    "dfrac",
+    "displaystyle",
+    "dot",
+    "frac",
+    "genfrac",
+    "hat",
+    "hspace",
+    "iiiint",
+    "iiint",
+    "iint",
+    "int",
+    "integral",
+    "lim",
+    "mathbb",
+    "mathrm",
+    "mbox",
+    "medspace",
+    "negmedspace",
+    "negspace",
+    "negthickspace",
+    "negthinspace",
+    "oiiint",
+    "oiint",
+    "oint",
+    "overline",
+    "overrightarrow",
+    "overset",
+    "phantom",
+    "prod",
+    "product",
+    "qquad",
+    "quad",
+    "rm",
+    "smallint",
+    "sqrt",
+    "stackrel",
+    "substack",
+    "sum",
+    "tbinom",
+    "textcolor",
+    "textstyle",
+    "tfrac",
+    "thickspace",
+    "thinspace",
+    "tilde",
+    "underline",
+    "underset",
+    "vec",
+    "widebar",
+    "widehat",
+    "widetilde",
+    "widevec",
+    "~",
+
+    // Read by the row or the scripts they are in
+    "left",
+    "right",
+    "limits",
+    "nolimits",
+};
+
+constexpr std::string_view ENVIRONMENT_NAMES[] =
+{
+    "matrix",
+    "array",
+    "pmatrix",
+    "bmatrix",
+    "Bmatrix",
+    "vmatrix",
+    "Vmatrix",
+};
+
+static_assert(std::size(COMMAND_NAMES) < NO_NAME && std::size(ENVIRONMENT_NAMES) < NO_NAME, "ids must fit NameId");
+
+// FNV-1a with a final mix, so that the low bits are usable as well
+constexpr std::uint64_t hashText(std::string_view text)
+{
+    std::uint64_t hash = 14695981039346656037ull;
+    for (const char c : text)
+    {
+        hash ^= static_cast<std::uint8_t>(c);
+        hash *= 1099511628211ull;
+    }
+    hash ^= hash >> 31;
+    hash *= 0x7fb5d329728ea185ull;
+    hash ^= hash >> 27;
+    return hash;
+}
+} // namespace TXL
@@ -0,0 +1,466 @@
+#include "SimdScanner.h"
+#include "TokenArray.h"
+
+#include <array>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <string>
+
+#if defined(__AVX2__)
+#include <immintrin.h>
+#define TXL_SIMD_AVX2
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+#define TXL_SIMD_SSE2
+#endif
+
+namespace TXL
+{
+namespace
+{
+enum class Run
+{
+    Text,
+    Digits,
+    Letters,
+};
+
+constexpr std::uint8_t TEXT_CHAR = 1;
+constexpr std::uint8_t DIGIT_CHAR = 2;
+constexpr std::uint8_t LETTER_CHAR = 4;
+
+// Mirrors the character classes of LexerImpl.l
+constexpr std::array<std::uint8_t, 256> makeCharTable()
+{
+    std::array<std::uint8_t, 256> table{};
+    for (int c = 0; c < 256; ++c)
+    {
+        table[c] = TEXT_CHAR;
+    }
+    for (const char c : "'<>&$\\{}()[]^_+-= \t\n,")
+    {
+        table[static_cast<unsigned char>(c)] = 0;
+    }
+    for (int c = '0'; c <= '9'; ++c)
+    {
+        table[c] = DIGIT_CHAR;
+    }
+    for (int c = 'a'; c <= 'z'; ++c)
+    {
+        table[c] |= LETTER_CHAR;
+        table[c - 'a' + 'A'] |= LETTER_CHAR;
+    }
+    // The string literal loop above also visits the terminating NUL,
+    // restore it the way flex treats it inside a negated class.
+    table[0] = TEXT_CHAR;
+    return table;
+}
+
+constexpr auto CHAR_TABLE = makeCharTable();
+
+template <Run run>
+bool inRun(const char c)
+{
+    const auto flags = CHAR_TABLE[static_cast<unsigned char>(c)];
+    switch (run)
+    {
+        case Run::Text:
+            return flags & TEXT_CHAR;
+
+        case Run::Digits:
+            return flags & DIGIT_CHAR;
+
+        case Run::Letters:
+            return flags & LETTER_CHAR;
+    }
+    return false;
+}
+
+#if defined(TXL_SIMD_AVX2)
+struct Simd
+{
+    using Vector = __m256i;
+    static constexpr std::size_t WIDTH = 32;
+
+    static Vector load(const char* p) { return _mm256_loadu_si256(reinterpret_cast<const __m256i*>(p)); }
+    static Vector set(const char c) { return _mm256_set1_epi8(c); }
+    static Vector eq(Vector x, const char c) { return _mm256_cmpeq_epi8(x, set(c)); }
+    static Vector lt(Vector a, Vector b) { return _mm256_cmpgt_epi8(b, a); }
+    static Vector add(Vector a, Vector b) { return _mm256_add_epi8(a, b); }
+    static Vector bitOr(Vector a, Vector b) { return _mm256_or_si256(a, b); }
+    static std::uint32_t mask(Vector x) { return static_cast<std::uint32_t>(_mm256_movemask_epi8(x)); }
+    static constexpr std::uint32_t FULL_MASK = 0xFFFFFFFFu;
+};
+#elif defined(TXL_SIMD_SSE2)
+struct Simd
+{
+    using Vector = __m128i;
+    static constexpr std::size_t WIDTH = 16;
+
+    static Vector load(const char* p) { return _mm_loadu_si128(reinterpret_cast<const __m128i*>(p)); }
+    static Vector set(const char c) { return _mm_set1_epi8(c); }
+    static Vector eq(Vector x, const char c) { return _mm_cmpeq_epi8(x, set(c)); }
+    static Vector lt(Vector a, Vector b) { return _mm_cmplt_epi8(a, b); }
+    static Vector add(Vector a, Vector b) { return _mm_add_epi8(a, b); }
+    static Vector bitOr(Vector a, Vector b) { return _mm_or_si128(a, b); }
+    static std::uint32_t mask(Vector x) { return static_cast<std::uint32_t>(_mm_movemask_epi8(x)); }
+    static constexpr std::uint32_t FULL_MASK = 0xFFFFu;
+};
+#endif
+
+#if defined(TXL_SIMD_AVX2) || defined(TXL_SIMD_SSE2)
+// Byte-wise lo <= x <= hi, done as one signed compare on the biased difference.
+Simd::Vector inRange(Simd::Vector x, const unsigned char lo, const unsigned char hi)
+{
+    const auto biased = Simd::add(x, Simd::set(static_cast<char>(0x80 - lo)));
+    return Simd::lt(biased, Simd::set(static_cast<char>(0x80 + (hi - lo + 1))));
+}
+
+// Bit i is set when byte i ends the run.
+template <Run run>
+std::uint32_t stopMask(Simd::Vector x)
+{
+    switch (run)
+    {
+        case Run::Text:
+        {
+            auto special = Simd::bitOr(Simd::eq(x, '\t'), Simd::eq(x, '\n'));
+            special = Simd::bitOr(special, Simd::eq(x, ' '));
+            special = Simd::bitOr(special, Simd::eq(x, '$'));
+            special = Simd::bitOr(special, inRange(x, '&', ')'));
+            special = Simd::bitOr(special, inRange(x, '+', '-'));
+            special = Simd::bitOr(special, inRange(x, '0', '9'));
+            special = Simd::bitOr(special, inRange(x, '<', '>'));
+            special = Simd::bitOr(special, inRange(x, '[', '_'));
+            special = Simd::bitOr(special, Simd::eq(x, '{'));
+            special = Simd::bitOr(special, Simd::eq(x, '}'));
+            return Simd::mask(special);
+        }
+
+        case Run::Digits:
+            return ~Simd::mask(inRange(x, '0', '9')) & Simd::FULL_MASK;
+
+        case Run::Letters:
+            return ~Simd::mask(inRange(Simd::bitOr(x, Simd::set(0x20)), 'a', 'z')) & Simd::FULL_MASK;
+    }
+    return Simd::FULL_MASK;
+}
+#endif
+
+// Returns the first position in [p, end) that does not belong to the run.
+template <Run run>
+const char* skipRun(const char* p, const char* const end)
+{
+#if defined(TXL_SIMD_AVX2) || defined(TXL_SIMD_SSE2)
+    while (static_cast<std::size_t>(end - p) >= Simd::WIDTH)
+    {
+        const auto mask = stopMask<run>(Simd::load(p));
+        if (mask)
+        {
+            return p + __builtin_ctz(mask);
+        }
+        p += Simd::WIDTH;
+    }
+#endif
+    while (p != end && inRun<run>(*p))
+    {
+        ++p;
+    }
+    return p;
+}
+
+bool isSign(const char c)
+{
+    switch (c)
+    {
+        case '&':
+        case '\'':
+        case '(':
+        case ')':
+        case '|':
+        case '^':
+        case ',':
+        case '<':
+        case '>':
+        case '_':
+        case '+':
+        case '-':
+        case '=':
+            return true;
+
+        default:
+            return false;
+    }
+}
+} // namespace
+
+void SimdScanner::reset(const char* text, std::size_t size)
+{
+    _pos = text;
+    _end = text + size;
+    _text = text;
+    _length = 0;
+    _state = State::Initial;
+}
+
+TokenType SimdScanner::emit(const char* end, TokenType type)
+{
+    _text = _pos;
+    _length = static_cast<std::size_t>(end - _pos);
+    _pos = end;
+    return type;
+}
+
+TokenType SimdScanner::next()
+{
+    while (_pos != _end)
+    {
+        const char c = *_pos;
+        switch (_state)
+        {
+            case State::Initial:
+                switch (c)
+                {
+                    case '$':
+                        _pos += (_end - _pos > 1 && _pos[1] == '$') ? 2 : 1;
+                        continue;
+
+                    case '\\':
+                        if (_end - _pos > 1 && (_pos[1] == '[' || _pos[1] == ']'))
+                        {
+                            _pos += 2;
+                            continue;
+                        }
+                        _state = State::Command;
+                        ++_pos;
+                        continue;
+
+                    case ' ':
+                    case '\t':
+                    case '\n':
+                        ++_pos;
+                        continue;
+
+                    case '{':
+                    case '[':
+                        return emit(_pos + 1, START_GROUP);
+
+                    case '}':
+                    case ']':
+                        return emit(_pos + 1, END_GROUP);
+
+                    case 'E':
+                        if (_end - _pos > 2 && _pos[1] == 'O' && _pos[2] == 'F')
+                        {
+                            return emit(_pos + 3, END);
+                        }
+                        break;
+
+                    default:
+                        if (isSign(c))
+                        {
+                            return emit(_pos + 1, SIGN);
+                        }
+                        break;
+                }
+                _state = State::Text;
+                continue;
+
+            case State::Command:
+                switch (c)
+                {
+                    case '{':
+                    case '}':
+                    case '_':
+                    case '^':
+                        _state = State::Initial;
+                        return emit(_pos + 1, TEXT);
+
+                    case '\\':
+                        _state = State::Initial;
+                        return emit(_pos + 1, SIGN);
+
+                    case ' ':
+                    case ',':
+                    case ':':
+                    case '>':
+                    case ';':
+                    case '!':
+                    case '~':
+                        _state = State::Initial;
+                        return emit(_pos + 1, COMMAND);
+
+                    case '\n':
+                        // flex echoes it and stays in the command state
+                        ++_pos;
+                        continue;
+
+                    default:
+                        break;
+                }
+
+                if (inRun<Run::Letters>(c))
+                {
+                    const auto end = skipRun<Run::Letters>(_pos, _end);
+                    const auto length = end - _pos;
+                    if (length == 5 && std::memcmp(_pos, "begin", 5) == 0)
+                    {
+                        _state = State::BeginEnv;
+                        _pos = end;
+                        continue;
+                    }
+                    if (length == 3 && std::memcmp(_pos, "end", 3) == 0)
+                    {
+                        _state = State::EndEnv;
+                        _pos = end;
+                        continue;
+                    }
+                    _state = State::Initial;
+                    return emit(end, COMMAND);
+                }
+                _state = State::Text;
+                continue;
+
+            case State::BeginEnv:
+            case State::EndEnv:
+                if (inRun<Run::Letters>(c))
+                {
+                    return emit(skipRun<Run::Letters>(_pos, _end), _state == State::BeginEnv ? BEGIN_ENV : END_ENV);
+                }
+                if (c == '}')
+                {
+                    _state = State::Initial;
+                }
+                // '{' is skipped, anything else is echoed by flex
+                ++_pos;
+                continue;
+
+            case State::Text:
+                if (inRun<Run::Digits>(c))
+                {
+                    _state = State::Initial;
+                    return emit(skipRun<Run::Digits>(_pos, _end), DIGIT);
+                }
+                if (inRun<Run::Text>(c))
+                {
+                    _state = State::Initial;
+                    return emit(skipRun<Run::Text>(_pos, _end), TEXT);
+                }
+                // flex echoes bytes no rule matches and stays in the text state
+                ++_pos;
+                continue;
+        }
+    }
+
+    _text = _end;
+    _length = 0;
+    return END;
+}
+
+void SimdScanner::tokenize(const char* text, std::size_t size, TokenArray& tokens)
+{
+    reset(text, size);
+    tokens.clear();
+    tokens.source = std::string_view(text, size);
+    for (;;)
+    {
+        const auto type = next();
+        // As in Lexer::scan(), END is empty even when it is an "EOF" in the text
+        const auto length = type == END ? 0 : _length;
+        tokens.types.push_back(static_cast<std::uint8_t>(type));
+        tokens.offsets.push_back(static_cast<std::uint32_t>(_text - text));
+        tokens.lengths.push_back(static_cast<std::uint32_t>(length));
+        tokens.ids.push_back(nameId(type, std::string_view(_text, length)));
+        if (type == END)
+        {
+            return;
+        }
+    }
+}
+} // namespace TXL
+
+#ifdef TXL_LEXER_BACKEND_SIMD
+// The scanner entry points Lexer.cpp expects from LexerImpl.l
+namespace
+{
+struct ScanContext final
+{
+    TXL::SimdScanner scanner;
+    void* buffer = nullptr;
+    std::string input;
+};
+
+struct Buffer final
+{
+    const char* text = nullptr;
+};
+} // namespace
+
+extern "C"
+{
+int txllex_init(void* scanCtx)
+{
+    *static_cast<void**>(scanCtx) = new ScanContext;
+    return 0;
+}
+
+int txllex_destroy(void* scanCtx)
+{
+    delete static_cast<ScanContext*>(scanCtx);
+    return 0;
+}
+
+int txllex(void* scanCtx)
+{
+    auto ctx = static_cast<ScanContext*>(scanCtx);
+    if (!ctx->buffer && ctx->input.empty())
+    {
+        // Like flex without a buffer, read the formula from stdin
+        char chunk[4096];
+        for (std::size_t size; (size = std::fread(chunk, 1, sizeof(chunk), stdin)) > 0;)
+        {
+            ctx->input.append(chunk, size);
+        }
+        ctx->scanner.reset(ctx->input.data(), ctx->input.size());
+    }
+    return ctx->scanner.next();
+}
+
+std::size_t txlget_leng(void* scanCtx)
+{
+    return static_cast<ScanContext*>(scanCtx)->scanner.length();
+}
+
+char* txlget_text(void* scanCtx)
+{
+    return const_cast<char*>(static_cast<ScanContext*>(scanCtx)->scanner.text());
+}
+
+void* scanBuffer(void* buffer, char* text, std::size_t size, void* const scanCtx)
+{
+    auto ctx = static_cast<ScanContext*>(scanCtx);
+    auto b = buffer ? static_cast<Buffer*>(buffer) : new Buffer;
+    b->text = text;
+    ctx->scanner.reset(text, size - 2);
+    ctx->buffer = b;
+    return b;
+}
+
+void freeBuffer(void* buffer, void* const scanCtx)
+{
+    auto ctx = static_cast<ScanContext*>(scanCtx);
+    if (ctx->buffer == buffer)
+    {
+        ctx->buffer = nullptr;
+        ctx->scanner.reset(nullptr, 0);
+    }
+    delete static_cast<Buffer*>(buffer);
+}
+
+const char* bufferBase(void* buffer)
+{
+    return static_cast<Buffer*>(buffer)->text;
+}
+}
+#endif
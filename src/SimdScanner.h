@@ -0,0 +1,57 @@
+#pragma once
+
+#include "TokenType.h"
+
+#include <cstddef>
+
+namespace TXL
+{
+struct TokenArray;
+
+// Hand-written scanner implementing the grammar of LexerImpl.l.
+// Runs of text, digits and command letters are classified 16 (SSE2) or
+// 32 (AVX2) bytes at a time. Produces exactly the tokens of the flex
+// scanner, except that bytes flex would ECHO to stdout are dropped.
+class SimdScanner final
+{
+public:
+    // The scanner does not copy the text, it has to outlive the scanner
+    // or the next reset().
+    void reset(const char* text, std::size_t size);
+
+    TokenType next();
+
+    // Lexes the whole text into `tokens` like Lexer::tokenize(), but unlike
+    // flex never writes into the text, so it may be read-only memory
+    void tokenize(const char* text, std::size_t size, TokenArray& tokens);
+
+    const char* text() const
+    {
+        return _text;
+    }
+
+    std::size_t length() const
+    {
+        return _length;
+    }
+
+private:
+    enum class State
+    {
+        Initial,
+        Command,
+        Text,
+        BeginEnv,
+        EndEnv,
+    };
+
+    TokenType emit(const char* end, TokenType type);
+
+private:
+    const char* _pos = nullptr;
+    const char* _end = nullptr;
+    const char* _text = nullptr;
+    std::size_t _length = 0;
+    State _state = State::Initial;
+};
+} // namespace TXL
@@ -1,15 +1,27 @@
 #pragma once
 
+#include "NameId.h"
 #include "TokenType.h"
 
 #include <string>
+#include <string_view>
 
 namespace TXL
 {
 struct Token final
 {
     TokenType type;
-    std::string content; // TODO: Use string_view
+    std::string content;
+};
+
+// Non-owning token. The content points into the lexer's input buffer, see
+// Lexer::nextView() for how long it stays valid.
+struct TokenView final
+{
+    TokenType type;
+    std::string_view content;
+    // Follows from type and content, so it is not compared
+    NameId id = NO_NAME;
 };
 
 inline bool operator ==(const Token& l, const Token& r)
@@ -21,4 +33,14 @@ inline bool operator !=(const Token& l, const Token& r)
 {
     return !(l == r);
 }
+
+inline bool operator ==(const TokenView& l, const TokenView& r)
+{
+    return l.type == r.type && l.content == r.content;
+}
+
+inline bool operator !=(const TokenView& l, const TokenView& r)
+{
+    return !(l == r);
+}
 } // namespace TXL
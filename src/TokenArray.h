@@ -0,0 +1,48 @@
+#pragma once
+
+#include "Token.h"
+
+#include <cstdint>
+#include <string_view>
+#include <vector>
+
+namespace TXL
+{
+// Whole formula lexed in one go, stored as parallel arrays.
+// Offsets and lengths index into source, so the views returned by
+// operator[] are valid as long as the text passed to Lexer::tokenize() is.
+// The last token is always END.
+struct TokenArray final
+{
+    std::size_t size() const
+    {
+        return types.size();
+    }
+
+    bool empty() const
+    {
+        return types.empty();
+    }
+
+    void clear()
+    {
+        source = std::string_view();
+        types.clear();
+        offsets.clear();
+        lengths.clear();
+        ids.clear();
+    }
+
+    TokenView operator[](std::size_t index) const
+    {
+        return {TokenType(types[index]), source.substr(offsets[index], lengths[index]), ids[index]};
+    }
+
+    std::string_view source;
+    std::vector<std::uint8_t> types;
+    std::vector<std::uint32_t> offsets;
+    std::vector<std::uint32_t> lengths;
+    // See NameId.h
+    std::vector<NameId> ids;
+};
+} // namespace TXL
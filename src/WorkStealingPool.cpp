@@ -0,0 +1,96 @@
+#include "WorkStealingPool.h"
+
+#include <algorithm>
+
+namespace TXL
+{
+WorkStealingPool::WorkStealingPool(std::size_t threads)
+{
+    threads = std::max<std::size_t>(threads, 1);
+    for (std::size_t i = 0; i < threads; ++i)
+    {
+        _queues.push_back(std::make_unique<Queue>());
+    }
+    for (std::size_t i = 0; i < threads; ++i)
+    {
+        _threads.emplace_back([this, i] { run(i); });
+    }
+}
+
+WorkStealingPool::~WorkStealingPool()
+{
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        _stop = true;
+    }
+    _wakeUp.notify_all();
+
+    for (auto& thread : _threads)
+    {
+        thread.join();
+    }
+}
+
+void WorkStealingPool::submit(Task task)
+{
+    auto& queue = *_queues[_nextQueue++ % _queues.size()];
+    {
+        std::lock_guard<std::mutex> lock(queue.mutex);
+        queue.tasks.push_back(std::move(task));
+    }
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        ++_queued;
+    }
+    _wakeUp.notify_one();
+}
+
+bool WorkStealingPool::pop(std::size_t worker, Task& task)
+{
+    {
+        auto& own = *_queues[worker];
+        std::lock_guard<std::mutex> lock(own.mutex);
+        if (!own.tasks.empty())
+        {
+            task = std::move(own.tasks.back());
+            own.tasks.pop_back();
+            return true;
+        }
+    }
+
+    for (std::size_t i = 1; i < _queues.size(); ++i)
+    {
+        auto& victim = *_queues[(worker + i) % _queues.size()];
+        std::lock_guard<std::mutex> lock(victim.mutex);
+        if (!victim.tasks.empty())
+        {
+            task = std::move(victim.tasks.front());
+            victim.tasks.pop_front();
+            return true;
+        }
+    }
+    return false;
+}
+
+void WorkStealingPool::run(std::size_t worker)
+{
+    Task task;
+    for (;;)
+    {
+        if (pop(worker, task))
+        {
+            --_queued;
+            task(worker);
+            task = nullptr;
+            continue;
+        }
+
+        std::unique_lock<std::mutex> lock(_mutex);
+        _wakeUp.wait(lock, [this] { return _queued > 0 || _stop; });
+        if (_stop && _queued == 0)
+        {
+            return;
+        }
+    }
+}
+} // namespace TXL
@@ -0,0 +1,59 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace TXL
+{
+// Fixed set of worker threads, each with its own task queue.
+// Tasks are handed out round-robin; a worker takes its newest task first
+// and, when its queue is empty, steals the oldest task of another worker.
+class WorkStealingPool final
+{
+public:
+    // The task gets the index of the worker running it, in [0, size()).
+    using Task = std::function<void(std::size_t worker)>;
+
+public:
+    explicit WorkStealingPool(std::size_t threads);
+
+    // Runs all submitted tasks before joining the workers.
+    ~WorkStealingPool();
+
+    WorkStealingPool(const WorkStealingPool&) = delete;
+    WorkStealingPool& operator=(const WorkStealingPool&) = delete;
+
+    void submit(Task task);
+
+    std::size_t size() const
+    {
+        return _threads.size();
+    }
+
+private:
+    struct Queue final
+    {
+        std::mutex mutex;
+        std::deque<Task> tasks;
+    };
+
+    bool pop(std::size_t worker, Task& task);
+    void run(std::size_t worker);
+
+private:
+    std::vector<std::unique_ptr<Queue>> _queues;
+    std::vector<std::thread> _threads;
+    std::atomic<std::size_t> _nextQueue{0};
+    std::atomic<std::size_t> _queued{0};
+    std::mutex _mutex;
+    std::condition_variable _wakeUp;
+    bool _stop = false;
+};
+} // namespace TXL
@@ -0,0 +1,116 @@
+#include "txl.h"
+
+#include "src/mml/ConversionLimits.h"
+#include "src/mml/MathMLGenerator.h"
+#include "src/mml/OutputOptions.h"
+#include "src/mml/OutputSink.h"
+
+#include <chrono>
+#include <exception>
+#include <string>
+
+struct txl_generator
+{
+    // The generator keeps a reference, so the sink is declared first
+    TXL::BufferSink sink{nullptr, 0};
+    TXL::MathMLGenerator generator{sink};
+    std::string error;
+};
+
+extern "C" {
+
+txl_generator* txl_generator_new(void)
+{
+    try
+    {
+        return new txl_generator();
+    }
+    catch (...)
+    {
+        return nullptr;
+    }
+}
+
+void txl_free(txl_generator* gen)
+{
+    delete gen;
+}
+
+ptrdiff_t txl_convert(txl_generator* gen, const char* tex, size_t size, char* out_buf, size_t out_cap)
+{
+    if (!gen)
+    {
+        return TXL_ERROR_ARGUMENT;
+    }
+    gen->error.clear();
+    if ((!tex && size) || (!out_buf && out_cap))
+    {
+        gen->error = "null pointer with a non-zero size";
+        return TXL_ERROR_ARGUMENT;
+    }
+
+    // Exceptions must not cross into C
+    try
+    {
+        gen->sink.reset(out_buf, out_cap);
+        gen->generator.generate(std::string_view(tex ? tex : "", size));
+        return static_cast<ptrdiff_t>(gen->sink.size());
+    }
+    catch (const TXL::LimitExceeded& e)
+    {
+        gen->error = e.what();
+        return TXL_ERROR_LIMIT;
+    }
+    catch (const std::exception& e)
+    {
+        gen->error = e.what();
+    }
+    catch (...)
+    {
+        gen->error = "unknown error";
+    }
+    return TXL_ERROR_INTERNAL;
+}
+
+const char* txl_last_error(const txl_generator* gen)
+{
+    return gen ? gen->error.c_str() : "";
+}
+
+void txl_set_limits(txl_generator* gen, size_t max_depth, size_t max_tokens, size_t max_output_bytes,
+                    unsigned long timeout_ms)
+{
+    if (!gen)
+    {
+        return;
+    }
+    TXL::ConversionLimits limits;
+    limits.maxDepth = max_depth;
+    limits.maxTokens = max_tokens;
+    limits.maxOutputBytes = max_output_bytes;
+    limits.maxTime = std::chrono::milliseconds(timeout_ms);
+    gen->generator.setLimits(limits);
+}
+
+void txl_set_output(txl_generator* gen, unsigned flags)
+{
+    if (!gen)
+    {
+        return;
+    }
+    TXL::OutputOptions options;
+    options.prolog = !(flags & TXL_NO_PROLOG);
+    if (flags & TXL_BLOCK)
+    {
+        options.attributes += " display=\"block\"";
+    }
+    options.fragment = (flags & TXL_FRAGMENT) != 0;
+    if (flags & TXL_COMPACT)
+    {
+        options.whitespace = TXL::OutputOptions::Whitespace::Compact;
+    }
+    // Cannot throw, the element keeps its name
+    gen->generator.setOptions(options);
+}
+
+} // extern "C"
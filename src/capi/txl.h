@@ -0,0 +1,81 @@
+#ifndef TXL_CAPI_H
+#define TXL_CAPI_H
+
+/*
+ * C interface of the TeX to MathML converter, for use from other languages.
+ * Documents are written straight into buffers of the caller.
+ *
+ * A generator keeps its lexer and buffers between conversions. It must not
+ * be used by two threads at once; create one per thread instead.
+ */
+
+#include <stddef.h>
+
+#if defined(_WIN32) && defined(TXL_SHARED_BUILD)
+#define TXL_API __declspec(dllexport)
+#elif defined(__GNUC__)
+#define TXL_API __attribute__((visibility("default")))
+#else
+#define TXL_API
+#endif
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef struct txl_generator txl_generator;
+
+/* Negative results of txl_convert(), txl_last_error() has the details */
+enum
+{
+    /* A null generator, or a null pointer with a non-zero size */
+    TXL_ERROR_ARGUMENT = -1,
+    /* The formula went over one of the limits of txl_set_limits() */
+    TXL_ERROR_LIMIT = -2,
+    /* Anything else, like running out of memory */
+    TXL_ERROR_INTERNAL = -3
+};
+
+/* Flags of txl_set_output(), 0 is a standalone XML document */
+enum
+{
+    /* Leave out <?xml ...?> */
+    TXL_NO_PROLOG = 1,
+    /* <math display="block"> */
+    TXL_BLOCK = 2,
+    /* Only the <mrow> of the formula, without <math> */
+    TXL_FRAGMENT = 4,
+    /* No newlines around the formula */
+    TXL_COMPACT = 8
+};
+
+/* Null when out of memory */
+TXL_API txl_generator* txl_generator_new(void);
+
+/* Does nothing for null */
+TXL_API void txl_free(txl_generator* gen);
+
+/*
+ * Converts `size` bytes of TeX and writes the document to `out_buf`, at most
+ * `out_cap` bytes of it. Returns the size of the whole document. When it is
+ * larger than `out_cap` the buffer holds only its beginning, and converting
+ * again with a buffer that large gives all of it. `out_buf` may be null
+ * when `out_cap` is 0, to ask for the size. A negative result is an error.
+ */
+TXL_API ptrdiff_t txl_convert(txl_generator* gen, const char* tex, size_t size, char* out_buf, size_t out_cap);
+
+/* Message of the last failed txl_convert(), empty after a successful one */
+TXL_API const char* txl_last_error(const txl_generator* gen);
+
+/* Limits of the following conversions, 0 turns a limit off. All are off at first. */
+TXL_API void txl_set_limits(txl_generator* gen, size_t max_depth, size_t max_tokens, size_t max_output_bytes,
+                            unsigned long timeout_ms);
+
+/* Combination of the TXL_NO_PROLOG, ... flags */
+TXL_API void txl_set_output(txl_generator* gen, unsigned flags);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
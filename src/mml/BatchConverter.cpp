@@ -0,0 +1,200 @@
+#include "BatchConverter.h"
+#include "ConversionStats.h"
+#include "MathMLGenerator.h"
+#include "OutputSink.h"
+#include "src/WorkStealingPool.h"
+
+#include <algorithm>
+#include <utility>
+
+namespace TXL
+{
+struct BatchConverter::Worker final
+{
+    Worker()
+        : sink(buffer)
+        , generator(sink)
+    {
+    }
+
+    std::string buffer;
+    StringSink sink;
+    MathMLGenerator generator;
+    ConversionStats stats;
+};
+
+BatchConverter::BatchConverter(std::ostream& out, std::size_t threads, std::size_t window)
+    : _out(out)
+{
+    threads = std::max<std::size_t>(threads, 1);
+    _slots.resize(window ? window : threads * 64);
+    for (std::size_t i = 0; i < threads; ++i)
+    {
+        _workers.push_back(std::make_unique<Worker>());
+    }
+    // Created last so that the workers are gone before anything they use
+    _pool = std::make_unique<WorkStealingPool>(threads);
+}
+
+BatchConverter::~BatchConverter()
+{
+    // Let queued conversions run to completion, their output is dropped
+    _pool.reset();
+}
+
+void BatchConverter::add(std::string tex)
+{
+    std::unique_lock<std::mutex> lock(_mutex);
+    const auto index = _added;
+    auto& slot = _slots[index % _slots.size()];
+
+    // The slot is free once the formula it held `window` positions back is written
+    while (_written + _slots.size() <= index)
+    {
+        _slotDone.wait(lock, [&] { return _slots[_written % _slots.size()].done; });
+        writeReady(lock);
+    }
+    slot = Slot();
+    ++_added;
+    lock.unlock();
+
+    _pool->submit([this, index, tex = std::move(tex)](std::size_t worker)
+    {
+        convert(worker, index, tex);
+    });
+
+    lock.lock();
+    writeReady(lock);
+}
+
+void BatchConverter::setLimits(const ConversionLimits& limits)
+{
+    for (auto& worker : _workers)
+    {
+        worker->generator.setLimits(limits);
+    }
+}
+
+void BatchConverter::setLimitHandler(LimitHandler handler)
+{
+    _limitHandler = std::move(handler);
+}
+
+void BatchConverter::setOptions(const OutputOptions& options)
+{
+    for (auto& worker : _workers)
+    {
+        worker->generator.setOptions(options);
+    }
+}
+
+void BatchConverter::setStats(ConversionStats* stats)
+{
+    _stats = stats;
+    for (auto& worker : _workers)
+    {
+        worker->generator.setStats(stats ? &worker->stats : nullptr);
+    }
+}
+
+void BatchConverter::finish()
+{
+    std::unique_lock<std::mutex> lock(_mutex);
+    while (_written < _added)
+    {
+        _slotDone.wait(lock, [&] { return _slots[_written % _slots.size()].done; });
+        writeReady(lock);
+    }
+    _out.flush();
+
+    // Every conversion is done, so the workers have stopped counting
+    if (_stats)
+    {
+        for (auto& worker : _workers)
+        {
+            *_stats += worker->stats;
+            worker->stats = ConversionStats();
+        }
+    }
+}
+
+void BatchConverter::convert(std::size_t worker, std::size_t index, const std::string& tex)
+{
+    auto& w = *_workers[worker];
+    std::string output;
+    std::exception_ptr error;
+    std::optional<LimitExceeded> limit;
+    try
+    {
+        w.buffer.clear();
+        w.generator.generate(tex);
+        output = w.buffer;
+    }
+    catch (const LimitExceeded& e)
+    {
+        limit = e;
+    }
+    catch (...)
+    {
+        error = std::current_exception();
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        auto& slot = _slots[index % _slots.size()];
+        slot.output = std::move(output);
+        slot.error = error;
+        slot.limit = limit;
+        slot.done = true;
+    }
+    _slotDone.notify_all();
+}
+
+void BatchConverter::writeReady(std::unique_lock<std::mutex>& lock)
+{
+    bool wrote = false;
+    while (_written < _added)
+    {
+        auto& slot = _slots[_written % _slots.size()];
+        if (!slot.done)
+        {
+            break;
+        }
+
+        auto output = std::move(slot.output);
+        auto error = slot.error;
+        auto limit = std::move(slot.limit);
+        slot = Slot();
+        const auto index = _written++;
+
+        if (error)
+        {
+            std::rethrow_exception(error);
+        }
+        if (limit)
+        {
+            // Nothing was written for it, the next formulas follow as usual
+            if (_limitHandler)
+            {
+                lock.unlock();
+                _limitHandler(index, *limit);
+                lock.lock();
+            }
+            continue;
+        }
+
+        // Workers only need the lock to hand in results, don't hold it while writing
+        lock.unlock();
+        _out.write(output.data(), static_cast<std::streamsize>(output.size()));
+        wrote = true;
+        lock.lock();
+    }
+
+    if (wrote)
+    {
+        lock.unlock();
+        _out.flush();
+        lock.lock();
+    }
+}
+} // namespace TXL
@@ -0,0 +1,88 @@
+#pragma once
+
+#include "ConversionLimits.h"
+
+#include <condition_variable>
+#include <cstddef>
+#include <exception>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <ostream>
+#include <string>
+#include <vector>
+
+namespace TXL
+{
+class WorkStealingPool;
+struct ConversionStats;
+struct OutputOptions;
+
+// Converts formulas on several threads and writes the documents to the
+// output in the order the formulas were added. Every worker has its own
+// generator, so lexers and output buffers are never shared.
+class BatchConverter final
+{
+public:
+    // Gets the position of the formula in the input, counted from 0
+    using LimitHandler = std::function<void(std::size_t index, const LimitExceeded& error)>;
+
+public:
+    // At most `window` formulas are in flight, add() blocks when the oldest
+    // one is not written out yet. 0 picks a window based on the thread count.
+    BatchConverter(std::ostream& out, std::size_t threads, std::size_t window = 0);
+    ~BatchConverter();
+
+    BatchConverter(const BatchConverter&) = delete;
+    BatchConverter& operator=(const BatchConverter&) = delete;
+
+    void add(std::string tex);
+
+    // Applies to every conversion. A formula over a limit is left out of the
+    // output and the batch goes on, see setLimitHandler(). Call before the first add().
+    void setLimits(const ConversionLimits& limits);
+
+    // Called for each formula over a limit, in input order and on the thread
+    // that calls add() or finish(). Call before the first add().
+    void setLimitHandler(LimitHandler handler);
+
+    // Same as MathMLGenerator::setOptions(). Call before the first add().
+    void setOptions(const OutputOptions& options);
+
+    // Every worker counts into its own ConversionStats, finish() adds them
+    // to `stats`. Call before the first add().
+    void setStats(ConversionStats* stats);
+
+    // Waits for all formulas and writes the rest of the output.
+    // Rethrows the first exception a conversion threw, in input order,
+    // other than LimitExceeded.
+    void finish();
+
+private:
+    struct Slot final
+    {
+        std::string output;
+        std::exception_ptr error;
+        std::optional<LimitExceeded> limit;
+        bool done = false;
+    };
+
+    struct Worker;
+
+    void convert(std::size_t worker, std::size_t index, const std::string& tex);
+    void writeReady(std::unique_lock<std::mutex>& lock);
+
+private:
+    std::ostream& _out;
+    ConversionStats* _stats = nullptr;
+    LimitHandler _limitHandler;
+    std::vector<Slot> _slots;
+    std::vector<std::unique_ptr<Worker>> _workers;
+    std::size_t _added = 0;
+    std::size_t _written = 0;
+    std::mutex _mutex;
+    std::condition_variable _slotDone;
+    std::unique_ptr<WorkStealingPool> _pool;
+};
+} // namespace TXL
@@ -0,0 +1,91 @@
+#include "ConversionCache.h"
+#include "src/TokenArray.h"
+
+#include <cstring>
+
+namespace TXL
+{
+ConversionCache::ConversionCache(std::size_t maxBytes, std::size_t maxDocumentBytes)
+    : _maxBytes(maxBytes)
+    , _maxDocumentBytes(maxDocumentBytes)
+{
+}
+
+void ConversionCache::makeKey(const TokenArray& tokens, std::string& key)
+{
+    key.clear();
+    for (std::size_t i = 0; i < tokens.size(); ++i)
+    {
+        // The length keeps "ab" "c" apart from "a" "bc"
+        const auto length = tokens.lengths[i];
+        char header[1 + sizeof(length)];
+        header[0] = static_cast<char>(tokens.types[i]);
+        std::memcpy(header + 1, &length, sizeof(length));
+        key.append(header, sizeof(header));
+        key.append(tokens.source.data() + tokens.offsets[i], length);
+    }
+}
+
+ConversionCache::Document ConversionCache::find(std::string_view key)
+{
+    std::lock_guard<std::mutex> lock(_mutex);
+    const auto it = _index.find(key);
+    if (it == _index.end())
+    {
+        ++_stats.misses;
+        return nullptr;
+    }
+
+    ++_stats.hits;
+    _entries.splice(_entries.begin(), _entries, it->second);
+    return it->second->document;
+}
+
+void ConversionCache::insert(std::string_view key, std::string document)
+{
+    const auto size = key.size() + document.size();
+    if (document.size() > _maxDocumentBytes || size > _maxBytes)
+    {
+        return;
+    }
+
+    // Allocate outside the lock
+    Entry entry{std::string(key), std::make_shared<const std::string>(std::move(document))};
+
+    std::lock_guard<std::mutex> lock(_mutex);
+    if (_index.count(key))
+    {
+        // Another generator was faster
+        return;
+    }
+
+    _entries.push_front(std::move(entry));
+    _index.emplace(_entries.front().key, _entries.begin());
+    _stats.bytes += size;
+
+    while (_stats.bytes > _maxBytes)
+    {
+        const auto& last = _entries.back();
+        _stats.bytes -= last.key.size() + last.document->size();
+        _index.erase(last.key);
+        _entries.pop_back();
+        ++_stats.evictions;
+    }
+}
+
+ConversionCache::Stats ConversionCache::stats() const
+{
+    std::lock_guard<std::mutex> lock(_mutex);
+    auto stats = _stats;
+    stats.entries = _entries.size();
+    return stats;
+}
+
+void ConversionCache::clear()
+{
+    std::lock_guard<std::mutex> lock(_mutex);
+    _index.clear();
+    _entries.clear();
+    _stats.bytes = 0;
+}
+} // namespace TXL
@@ -0,0 +1,76 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+
+namespace TXL
+{
+struct TokenArray;
+
+// Bounded LRU cache of converted formulas, keyed by the tokens they were
+// generated from. Only the <mrow> of a formula is kept, without prolog or
+// wrapper, so generators with different OutputOptions can share it. It is
+// thread-safe, so generators on different threads can share one instance.
+class ConversionCache final
+{
+public:
+    using Document = std::shared_ptr<const std::string>;
+
+    struct Stats final
+    {
+        std::uint64_t hits = 0;
+        std::uint64_t misses = 0;
+        std::uint64_t evictions = 0;
+        std::size_t entries = 0;
+        std::size_t bytes = 0;
+    };
+
+    // Keys and documents together take at most `maxBytes`. Larger documents
+    // than `maxDocumentBytes` are not worth keeping and are never inserted.
+    explicit ConversionCache(std::size_t maxBytes = 4 << 20, std::size_t maxDocumentBytes = 16 << 10);
+
+    ConversionCache(const ConversionCache&) = delete;
+    ConversionCache& operator=(const ConversionCache&) = delete;
+
+    // Writes the key of the tokens to `key`, reusing its memory. The lexer
+    // already dropped whitespace and delimiters, so `x^2` and `$x ^ 2$` share it.
+    static void makeKey(const TokenArray& tokens, std::string& key);
+
+    // Null on a miss
+    Document find(std::string_view key);
+    void insert(std::string_view key, std::string document);
+
+    std::size_t maxDocumentBytes() const
+    {
+        return _maxDocumentBytes;
+    }
+
+    Stats stats() const;
+    void clear();
+
+private:
+    struct Entry final
+    {
+        std::string key;
+        Document document;
+    };
+
+    using Entries = std::list<Entry>;
+
+private:
+    const std::size_t _maxBytes;
+    const std::size_t _maxDocumentBytes;
+
+    mutable std::mutex _mutex;
+    // Most recently used first, the index points at the keys in the list
+    Entries _entries;
+    std::unordered_map<std::string_view, Entries::iterator> _index;
+    Stats _stats;
+};
+} // namespace TXL
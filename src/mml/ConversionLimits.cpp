@@ -0,0 +1,33 @@
+#include "ConversionLimits.h"
+
+#include <string>
+
+namespace TXL
+{
+namespace
+{
+std::string describe(LimitExceeded::Limit limit, std::uint64_t value)
+{
+    const auto text = std::to_string(value);
+    switch (limit)
+    {
+        case LimitExceeded::Limit::Depth:
+            return "formula is nested deeper than " + text + " levels";
+        case LimitExceeded::Limit::Tokens:
+            return "formula has more than " + text + " tokens";
+        case LimitExceeded::Limit::OutputBytes:
+            return "document is larger than " + text + " bytes";
+        case LimitExceeded::Limit::Time:
+            return "conversion took longer than " + text + " ms";
+    }
+    return "conversion limit exceeded";
+}
+} // namespace
+
+LimitExceeded::LimitExceeded(Limit limit, std::uint64_t value)
+    : std::runtime_error(describe(limit, value))
+    , _limit(limit)
+    , _value(value)
+{
+}
+} // namespace TXL
@@ -0,0 +1,55 @@
+#pragma once
+
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <stdexcept>
+
+namespace TXL
+{
+// Bounds on the work a single formula may cause, see
+// MathMLGenerator::setLimits(). Zero means no limit. Input from untrusted
+// sources should set all of them.
+struct ConversionLimits final
+{
+    // Commands and environments open inside each other
+    std::size_t maxDepth = 0;
+    // Tokens of the formula, which bound the memory of the tree as well
+    std::size_t maxTokens = 0;
+    std::size_t maxOutputBytes = 0;
+    // From the start of lexing to the end of the document
+    std::chrono::milliseconds maxTime{0};
+};
+
+// Thrown when a conversion runs into one of its ConversionLimits. Nothing of
+// that formula's document has reached the sink by then.
+class LimitExceeded final : public std::runtime_error
+{
+public:
+    enum class Limit
+    {
+        Depth,
+        Tokens,
+        OutputBytes,
+        Time,
+    };
+
+public:
+    // `value` is the limit that was exceeded, in its own unit
+    LimitExceeded(Limit limit, std::uint64_t value);
+
+    Limit limit() const
+    {
+        return _limit;
+    }
+
+    std::uint64_t value() const
+    {
+        return _value;
+    }
+
+private:
+    Limit _limit;
+    std::uint64_t _value;
+};
+} // namespace TXL
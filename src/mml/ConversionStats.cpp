@@ -0,0 +1,118 @@
+#include "ConversionStats.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <iterator>
+#include <string_view>
+
+namespace TXL
+{
+namespace
+{
+constexpr const char* TOKEN_NAMES[] = {
+    "END", "COMMAND", "START_GROUP", "END_GROUP", "BEGIN_ENV", "END_ENV", "DIGIT", "TEXT", "SIGN"};
+
+static_assert(std::size(TOKEN_NAMES) == std::tuple_size<decltype(ConversionStats::tokens)>::value,
+              "a name for every token type");
+
+void writeString(std::ostream& out, std::string_view text)
+{
+    out << '"';
+    for (const char c : text)
+    {
+        switch (c)
+        {
+            case '"': out << "\\\""; break;
+            case '\\': out << "\\\\"; break;
+            case '\n': out << "\\n"; break;
+            case '\t': out << "\\t"; break;
+            default:
+                if (static_cast<unsigned char>(c) < 0x20)
+                {
+                    char escaped[8];
+                    std::snprintf(escaped, sizeof(escaped), "\\u%04x", c);
+                    out << escaped;
+                }
+                else
+                {
+                    out << c;
+                }
+                break;
+        }
+    }
+    out << '"';
+}
+
+void writeCounts(std::ostream& out, const std::map<std::string, std::uint64_t, std::less<>>& counts)
+{
+    out << '{';
+    const char* separator = "";
+    for (const auto& count : counts)
+    {
+        out << separator;
+        writeString(out, count.first);
+        out << ": " << count.second;
+        separator = ", ";
+    }
+    out << '}';
+}
+
+void add(std::map<std::string, std::uint64_t, std::less<>>& to, const std::map<std::string, std::uint64_t, std::less<>>& from)
+{
+    for (const auto& count : from)
+    {
+        to[count.first] += count.second;
+    }
+}
+} // namespace
+
+void ConversionStats::count(std::map<std::string, std::uint64_t, std::less<>>& counts, std::string_view name)
+{
+    auto it = counts.find(name);
+    if (it == counts.end())
+    {
+        it = counts.emplace(std::string(name), 0).first;
+    }
+    ++it->second;
+}
+
+ConversionStats& ConversionStats::operator+=(const ConversionStats& other)
+{
+    formulas += other.formulas;
+    for (std::size_t i = 0; i < tokens.size(); ++i)
+    {
+        tokens[i] += other.tokens[i];
+    }
+    add(commands, other.commands);
+    add(environments, other.environments);
+    maxDepth = std::max(maxDepth, other.maxDepth);
+    reusedGroups += other.reusedGroups;
+    reusedBytes += other.reusedBytes;
+    outputBytes += other.outputBytes;
+    lexNs += other.lexNs;
+    buildNs += other.buildNs;
+    serializeNs += other.serializeNs;
+    return *this;
+}
+
+void ConversionStats::writeJson(std::ostream& out) const
+{
+    out << "{\n  \"formulas\": " << formulas << ",\n  \"tokens\": {";
+    for (std::size_t i = 0; i < tokens.size(); ++i)
+    {
+        out << (i ? ", " : "") << '"' << TOKEN_NAMES[i] << "\": " << tokens[i];
+    }
+    out << "},\n  \"commands\": ";
+    writeCounts(out, commands);
+    out << ",\n  \"environments\": ";
+    writeCounts(out, environments);
+    out << ",\n  \"max_depth\": " << maxDepth
+        << ",\n  \"reused_groups\": " << reusedGroups
+        << ",\n  \"reused_bytes\": " << reusedBytes
+        << ",\n  \"output_bytes\": " << outputBytes
+        << ",\n  \"lex_ns\": " << lexNs
+        << ",\n  \"build_ns\": " << buildNs
+        << ",\n  \"serialize_ns\": " << serializeNs
+        << "\n}\n";
+}
+} // namespace TXL
@@ -0,0 +1,50 @@
+#pragma once
+
+#include "src/TokenType.h"
+
+#include <array>
+#include <cstdint>
+#include <functional>
+#include <map>
+#include <ostream>
+#include <string>
+#include <string_view>
+
+namespace TXL
+{
+// Counters and timings MathMLGenerator adds to while converting, see
+// MathMLGenerator::setStats(). Built with -DTXL_STATS=OFF the generator has
+// no code for them and leaves the object alone.
+struct ConversionStats final
+{
+#ifdef TXL_STATS
+    static constexpr bool ENABLED = true;
+#else
+    static constexpr bool ENABLED = false;
+#endif
+
+    std::uint64_t formulas = 0;
+    // Indexed by TokenType
+    std::array<std::uint64_t, SIGN + 1> tokens = {};
+    // Builders made per command and per environment name
+    std::map<std::string, std::uint64_t, std::less<>> commands;
+    std::map<std::string, std::uint64_t, std::less<>> environments;
+    // Deepest nesting of commands and environments in one formula
+    std::uint64_t maxDepth = 0;
+    // Brace groups taken from the per-formula memo instead of being built again
+    std::uint64_t reusedGroups = 0;
+    std::uint64_t reusedBytes = 0;
+    std::uint64_t outputBytes = 0;
+
+    std::uint64_t lexNs = 0;
+    std::uint64_t buildNs = 0;
+    std::uint64_t serializeNs = 0;
+
+    // Adds one to the count of `name`, without allocating once it is there
+    static void count(std::map<std::string, std::uint64_t, std::less<>>& counts, std::string_view name);
+
+    ConversionStats& operator+=(const ConversionStats& other);
+
+    void writeJson(std::ostream& out) const;
+};
+} // namespace TXL
@@ -0,0 +1,62 @@
+#pragma once
+
+#include "OutputOptions.h"
+
+#include <cstddef>
+#include <memory>
+#include <string>
+#include <string_view>
+
+namespace TXL
+{
+// Keeps a formula and its MathML document up to date while it is edited.
+// An edit re-lexes only the tokens around it and rebuilds only the smallest
+// brace group or environment that encloses them. Outside of any group it
+// rebuilds the top-level children from the one before the edit up to the
+// first one after it that comes out the same, which is past the \right of
+// a \left ... \right around the edit.
+// Only the building is local: text, tokens, parts and document are flat
+// arrays, so an edit still moves or shifts everything after it. That pass
+// is cheap but linear, roughly 10 us per 1000 terms of a long formula.
+// It lives next to the builders in MathMLGenerator.cpp.
+class EditSession final
+{
+public:
+    struct Edit final
+    {
+        std::size_t offset;
+        std::size_t removed;
+        std::string_view inserted;
+    };
+
+    // The bytes of the previous document replaced by `inserted`, which
+    // points into document() and is valid until the next edit
+    struct Patch final
+    {
+        std::size_t offset;
+        std::size_t removed;
+        std::string_view inserted;
+    };
+
+public:
+    // Throws std::invalid_argument for options MathMLGenerator::setOptions() rejects
+    explicit EditSession(std::string_view tex = std::string_view(), const OutputOptions& options = OutputOptions());
+    ~EditSession();
+
+    EditSession(const EditSession&) = delete;
+    EditSession& operator=(const EditSession&) = delete;
+
+    // Throws std::out_of_range when the edit is not inside the text
+    Patch apply(const Edit& edit);
+
+    const std::string& text() const;
+
+    // The same document MathMLGenerator writes for text() with the same options
+    const std::string& document() const;
+
+private:
+    struct State;
+
+    std::unique_ptr<State> _state;
+};
+} // namespace TXL
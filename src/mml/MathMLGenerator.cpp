@@ -1,18 +1,116 @@
 #include "MathMLGenerator.h"
+#include "ConversionCache.h"
+#include "ConversionLimits.h"
+#include "ConversionStats.h"
+#include "EditSession.h"
+#include "MathMLTree.h"
+#include "OutputOptions.h"
+#include "OutputSink.h"
 #include "src/Lexer.h"
+#include "src/MappedFile.h"
+#include "src/Names.h"
+#include "src/SimdScanner.h"
 
 #include <algorithm>
 #include <cctype>
-#include <limits>
+#include <chrono>
+#include <cstdint>
+#include <iostream>
+#include <iterator>
 #include <memory>
-#include <stack>
-#include <unordered_map>
+#include <optional>
+#include <stdexcept>
+#include <string_view>
+#include <type_traits>
+#include <utility>
+#include <vector>
 
 namespace TXL
 {
 namespace
 {
-const auto MAX_INDEX = std::numeric_limits<std::size_t>::max();
+constexpr std::string_view XML_PROLOG = "<?xml version=\"1.0\" encoding=\"UTF-8\"?>";
+
+// Written before and after the <mrow> of a formula
+std::string documentBegin(const OutputOptions& options)
+{
+    const std::string newline = options.whitespace == OutputOptions::Whitespace::Lines ? "\n" : "";
+    if (options.fragment)
+    {
+        return std::string();
+    }
+    std::string result = options.prolog ? std::string(XML_PROLOG) + newline : std::string();
+    return result + "<" + options.element + options.attributes + ">" + newline;
+}
+
+std::string documentEnd(const OutputOptions& options)
+{
+    const std::string newline = options.whitespace == OutputOptions::Whitespace::Lines ? "\n" : "";
+    if (options.fragment)
+    {
+        return newline;
+    }
+    return newline + "</" + options.element + ">" + newline;
+}
+
+void checkOptions(const OutputOptions& options, const char* caller)
+{
+    if (!options.fragment && options.element.empty())
+    {
+        throw std::invalid_argument(std::string(caller) + ": the wrapper element needs a name");
+    }
+}
+
+// Guess of the size of a formula's <mrow>, one pass over the token types. The
+// numbers are average output bytes per token on test/files, so the estimate
+// is close for typical formulas and only a hint for the rest.
+std::size_t estimateSize(const TokenArray& tokens)
+{
+    // <mrow></mrow> around everything
+    std::size_t size = 13;
+    for (std::size_t i = 0; i < tokens.size(); ++i)
+    {
+        switch (tokens.types[i])
+        {
+            case COMMAND:
+                size += 20;
+                break;
+            case START_GROUP:
+            case END_GROUP:
+                size += 5;
+                break;
+            case BEGIN_ENV:
+                size += 64;
+                break;
+            case DIGIT:
+            case TEXT:
+                // <mn>, <mi> and the like around the text
+                size += 13 + tokens.lengths[i];
+                break;
+            case SIGN:
+                size += 16 + tokens.lengths[i];
+                break;
+            default:
+                break;
+        }
+    }
+    return size;
+}
+
+// Code that only exists in builds with TXL_STATS
+#ifdef TXL_STATS
+#define TXL_STATS_ONLY(...) __VA_ARGS__
+#else
+#define TXL_STATS_ONLY(...)
+#endif
+
+#ifdef TXL_STATS
+std::uint64_t nowNs()
+{
+    return static_cast<std::uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count());
+}
+#endif
 
 uint8_t getCharLength(const char firstByte)
 {
@@ -29,539 +127,1625 @@ uint8_t getCharLength(const char firstByte)
         return 0;
 }
 
-class TokenSequence final
+class TokenSequence;
+
+// Builders never call each other's add() for a nested command. add() hands
+// the nested builder to TokenSequence::call() and returns false, and is
+// called again with the node of it in TokenSequence::result() once it is
+// done. TokenSequence::run() keeps the builders in progress on a stack in
+// the heap, so deep input does not take more of the call stack.
+class Builder
 {
 public:
-    enum class Style
+    Builder() = default;
+    virtual ~Builder() = default;
+
+    // True once the builder is done. Builders that read a fixed number of
+    // arguments return true again when called after that, without reading.
+    virtual bool add(TokenSequence& sequence) = 0;
+    virtual NodeId take(MathMLTree& tree) = 0;
+};
+
+// Builders are made and dropped in LIFO order, a nested one lives only
+// inside add() of its parent, so they are placed on a stack of memory
+// blocks that is kept for the next formula instead of the heap.
+class BuilderStack final
+{
+private:
+    struct Mark
     {
-        BlackboardBold,
-        Roman,
+        std::size_t block;
+        std::size_t offset;
     };
 
 public:
-    TokenSequence(Lexer& lexer)
-        : _lexer(lexer)
-        , _t(lexer.next())
-    {}
-
-    const Token& top() const
+    struct Release
     {
-        return _t;
-    }
+        void operator()(Builder* builder) const
+        {
+            builder->~Builder();
+            stack->_top = mark;
+            --stack->_depth;
+        }
 
-    TokenSequence& next()
-    {
-        _t = _lexer.next();
-        return *this;
-    }
+        BuilderStack* stack;
+        Mark mark;
+    };
+
+    using Ptr = std::unique_ptr<Builder, Release>;
+
+public:
+    BuilderStack() = default;
 
-    std::string popChar()
+    BuilderStack(const BuilderStack&) = delete;
+    BuilderStack& operator=(const BuilderStack&) = delete;
+
+    template <typename T, typename... Args>
+    Ptr make(Args&&... args)
     {
-        if (_t.type == TEXT)
+        static_assert(sizeof(T) <= sizeof(Block), "builder does not fit in a block");
+
+        if (_depth == _depthLimit)
         {
-            auto& content = _t.content;
-            auto result = content.substr(0, getCharLength(content[0]));
-            content.erase(0, result.size());
-            if (content.empty())
-            {
-                next();
-            }
-            return result;
+            throw LimitExceeded(LimitExceeded::Limit::Depth, _depthLimit);
         }
-        return std::string();
+
+        const auto mark = _top;
+        void* memory = allocate(sizeof(T), alignof(T));
+        auto builder = Ptr(new (memory) T(std::forward<Args>(args)...), Release{this, mark});
+        ++_depth;
+        TXL_STATS_ONLY(_maxDepth = std::max(_maxDepth, _depth);)
+        return builder;
     }
 
-    bool empty() const
+    // At most `limit` builders alive at once, 0 for no limit
+    void setDepthLimit(std::size_t limit)
     {
-        return _t.type == END;
+        _depthLimit = limit ? limit : static_cast<std::size_t>(-1);
     }
 
-    void pushStyle(const Style& style)
+#ifdef TXL_STATS
+    // Most builders alive at once since the last call
+    std::size_t takeMaxDepth()
     {
-        _styles.push(style);
+        return std::exchange(_maxDepth, _depth);
     }
+#endif
 
-    const Style* getTopStyle()
+private:
+    void* allocate(std::size_t size, std::size_t alignment)
     {
-        if (_styles.empty())
+        for (;; ++_top.block, _top.offset = 0)
         {
-            return nullptr;
+            if (_top.block == _blocks.size())
+            {
+                _blocks.emplace_back(std::make_unique<Block>());
+            }
+
+            const auto offset = (_top.offset + alignment - 1) & ~(alignment - 1);
+            if (offset + size <= sizeof(Block))
+            {
+                _top.offset = offset + size;
+                return _blocks[_top.block]->data + offset;
+            }
         }
-        return &_styles.top();
     }
 
-    void popStyle()
+private:
+    struct Block
     {
-        _styles.pop();
-    }
+        alignas(std::max_align_t) char data[16 * 1024];
+    };
 
-private:
-    Lexer& _lexer;
-    Token _t;
-    std::stack<Style> _styles;
+    std::vector<std::unique_ptr<Block>> _blocks;
+    Mark _top = {0, 0};
+    std::size_t _depth = 0;
+    std::size_t _depthLimit = static_cast<std::size_t>(-1);
+#ifdef TXL_STATS
+    std::size_t _maxDepth = 0;
+#endif
 };
 
-class Builder
+// Brace groups already built in the current formula. A group with the same
+// tokens and style builds the same subtree, and nodes never change once made,
+// so the node of the first one is used again instead of building it anew.
+class GroupMemo final
 {
 public:
-    Builder() = default;
-    virtual ~Builder() = default;
-
-    virtual void add(TokenSequence& sequence) = 0;
-    virtual std::string take() = 0;
-};
-
-const std::unordered_map<std::string, std::string>& getCharCmdMap()
-{
-    static const std::unordered_map<std::string, std::string> map = {
-        // Greek letters
-        {"alpha", "\xCE\xB1"},
-        {"beta", "\xCE\xB2"},
-        {"Gamma", "\xCE\x93"},
-        {"gamma", "\xCE\xB3"},
-        {"Delta", "\xCE\x94"},
-        {"delta", "\xCE\xB4"},
-        {"epsilon", "\xCE\xB5"},
-        {"zeta", "\xCE\xB6"},
-        {"eta", "\xCE\xB7"},
-        {"Theta", "\xCE\x98"},
-        {"theta", "\xCE\xB8"},
-        {"iota", "\xCE\xB9"},
-        {"kappa", "\xCE\xBA"},
-        {"Lambda", "\xCE\x9B"},
-        {"lambda", "\xCE\xBB"},
-        {"mu", "\xCE\xBC"},
-        {"nu", "\xCE\xBD"},
-        {"Xi", "\xCE\x9E"},
-        {"xi", "\xCE\xBE"},
-        {"Pi", "\xCE\xA0"},
-        {"pi", "\xCF\x80"},
-        {"rho", "\xCF\x81"},
-        {"Sigma", "\xCE\xA3"},
-        {"sigma", "\xCF\x83"},
-        {"tau", "\xCF\x84"},
-        {"Upsilon", "\xCE\xA5"},
-        {"upsilon", "\xCF\x85"},
-        {"Phi", "\xCE\xA6"},
-        {"phi", "\xCF\x86"},
-        {"chi", "\xCF\x87"},
-        {"Psi", "\xCE\xA8"},
-        {"psi", "\xCF\x88"},
-        {"Omega", "\xCE\xA9"},
-        {"omega", "\xCF\x89"},
-        {"varsigma", "\xCF\x82"},
-        {"vartheta", "\xCF\x91"},
-        {"varphi", "\xCF\x95"},
-        {"varpi", "\xCF\x96"},
-        {"varkappa", "\xCF\xB0"},
-        {"varrho", "\xCF\xB1"},
-        {"varepsilon", "\xCF\xB5"},
-
-        {"dots", "\xE2\x80\xA6"},
-        {"ldots", "\xE2\x80\xA6"},
-        {"dotso", "\xE2\x80\xA6"},
-        {"dotsc", "\xE2\x80\xA6"},
-        {"vdots", "\xE2\x8B\xAE"},
-        {"cdots", "\xE2\x8B\xAF"},
-        {"dotsb", "\xE2\x8B\xAF"},
-        {"ddots", "\xE2\x8B\xB1"},
-        {"udots", "\xE2\x8B\xB0"},
-        {"hbar", "\xE2\x84\x8F"},
-    };
-    return map;
-}
-
-const std::unordered_map<std::string, std::string>& getSymbolCmdMap()
-{
-    static const std::unordered_map<std::string, std::string> map = {
-        {"Del", "\xE2\x88\x87"},
-        {"Im", "\xE2\x84\x91"},
-        {"Leftarrow", "\xE2\x87\x90"},
-        {"Re", "\xE2\x84\x9C"},
-        {"Rightarrow", "\xE2\x87\x92"},
-        {"aleph", "\xE2\x84\xB5"},
-        {"amalg", "\xE2\xA8\xBF"},
-        {"angle", "\xE2\x88\xA0"},
-        {"approx", "\xE2\x89\x88"},
-        {"ast", "\xE2\x88\x97"},
-        {"ast", "\xE2\x88\x97"},
-        {"bigcap", "\xE2\x8B\x82"},
-        {"bigcup", "\xE2\x8B\x83"},
-        {"bigvee", "\xE2\x8B\x81"},
-        {"bigwedge", "\xE2\x8B\x80"},
-        {"bullet", "\xE2\x80\xA2"},
-        {"cap", "\xE2\x88\xA9"},
-        {"cdot", "\xE2\x8B\x85"},
-        {"circ", "\xE2\x88\x98"},
-        {"complement", "\xE2\x88\x81"},
-        {"cong", "\xE2\x89\x85"},
-        {"conint", "\xE2\x88\xAE"},
-        {"contourintegral", "\xE2\x88\xAE"},
-        {"coprod", "\xE2\x88\x90"},
-        {"coproduct", "\xE2\x88\x90"},
-        {"cup", "\xE2\x88\xAA"},
-        {"div", "\xC3\xB7"},
-        {"doubleintegral", "\xE2\x88\xAC"},
-        {"downarrow", "\xE2\x86\x93"},
-        {"equiv", "\xE2\x89\xA1"},
-        {"exists", "\xE2\x88\x83"},
-        {"forall", "\xE2\x88\x80"},
-        {"ge", "\xE2\x89\xA5"},
-        {"geq", "\xE2\x89\xA5"},
-        {"geqslant", "\xE2\xA9\xBE"},
-        {"gg", "\xE2\x89\xAB"},
-        {"gt", "&gt;"},
-        {"hslash", "\xE2\x84\x8F"},
-        {"iff", "\xE2\x9F\xBA"},
-        {"in", "\xE2\x88\x8A"},
-        {"infinity", "\xE2\x88\x9E"},
-        {"infty", "\xE2\x88\x9E"},
-        {"le", "\xE2\x89\xA4"},
-        {"leftarrow", "\xE2\x86\x90"},
-        {"leq", "\xE2\x89\xA4"},
-        {"leqslant", "\xE2\xA9\xBD"},
-        {"ll", "\xE2\x89\xAA"},
-        {"longleftarrow", "\xE2\x9f\xB5"},
-        {"lt", "&lt;"},
-        {"measuredangle", "\xE2\x88\xA1"},
-        {"mid", "\xE2\x88\xA3"},
-        {"mp", "\xE2\x88\x93"},
-        {"nabla", "\xE2\x88\x87"},
-        {"ne", "\xE2\x89\xA0"},
-        {"neg", "\xC2\xAC"},
-        {"neq", "\xE2\x89\xA0"},
-        {"nexists", "\xE2\x88\x84"},
-        {"ngeq", "\xE2\x89\xB1"},
-        {"ngtr", "\xE2\x89\xAF"},
-        {"ni", "\xE2\x88\x8B"},
-        {"nleq","\xE2\x89\xB0"},
-        {"nless", "\xE2\x89\xAE"},
-        {"nmid", "\xE2\x88\xA4"},
-        {"not", "\x2F"},
-        {"notin", "\xE2\x88\x89"},
-        {"nparallel", "\xE2\x88\xA6"},
-        {"nprec", "\xE2\x8A\x80"},
-        {"nsubseteq", "\xE2\x8A\x88"},
-        {"nsucc", "\xE2\x8A\x81"},
-        {"nsupseteq", "\xE2\x8A\x89"},
-        {"odot", "\xE2\x8A\x99"},
-        {"ominus", "\xE2\x8A\x96"},
-        {"oplus", "\xE2\x8A\x95"},
-        {"oslash", "\xE2\x8A\x98"},
-        {"otimes", "\xE2\x8A\x97"},
-        {"parallel", "\xE2\x88\xA5"},
-        {"partial", "\xE2\x88\x82"},
-        {"perp", "\xE2\x8A\xA5"},
-        {"pm", "\xC2\xB1"},
-        {"prec", "\xE2\x89\xBA"},
-        {"preccurlyeq", "\xE2\x89\xBC"},
-        {"precsim", "\xE2\x89\xBE"},
-        {"prime", "\xE2\x80\xB2"},
-        {"propto", "\xE2\x88\x9D"},
-        {"quadrupleintegral", "\xE2\xA8\x8C"},
-        {"rightarrow", "\xE2\x86\x92"},
-        {"setminus", "\xE2\x88\x96"},
-        {"sim", "\xE2\x88\xBC"},
-        {"simeq", "\xE2\x89\x83"},
-        {"subset", "\xE2\x8A\x82"},
-        {"subseteq","\xE2\x8A\x86"},
-        {"succ", "\xE2\x89\xBB"},
-        {"succcurlyeq", "\xE2\x89\xBD"},
-        {"succsim", "\xE2\x89\xBF"},
-        {"supset", "\xE2\x8A\x83"},
-        {"supseteq", "\xE2\x8A\x87"},
-        {"times", "\xC3\x97"},
-        {"to", "\xE2\x86\x92"},
-        {"triangle", "\xE2\x96\xB3"},
-        {"triangledown", "\xE2\x96\xBF"},
-        {"tripleintegral", "\xE2\x88\xAD"},
-        {"uparrow", "\xE2\x86\x91"},
-        {"varnothing", "\xE2\x88\x85"},
-        {"vee", "\xE2\x88\xA8"},
-        {"wedge", "\xE2\x88\xA7"},
-        {"wp", "\xE2\x84\x98"},
+    struct Group
+    {
+        std::size_t begin;
+        // Past the closing '}', 0 when it is missing or the memo is off
+        std::size_t end;
+        std::uint64_t hash;
+        int style;
     };
-    return map;
-}
-
-const std::unordered_map<std::string, std::unique_ptr<Builder>(*)()>& getBuilderFactory();
-
-enum class SubSupType
-{
-    Limits,
-    NoLimits
-};
-
-std::unique_ptr<Builder> makeEnvBuilder(const std::string& name);
-std::unique_ptr<Builder> makeSubSup(std::string&& firstArg, SubSupType type);
 
-class RowBuilder final : public Builder
-{
 public:
-    RowBuilder(std::string&& nodeName = "mrow")
-        : _nodeName(std::move(nodeName))
+    void reset(const TokenArray& tokens)
     {
-        _out.append("<").append(_nodeName).append(">");
-        _lastTokenPos = _out.size();
+        _tokens = &tokens;
+        _prepared = false;
+        _count = 0;
+        if (++_generation == 0)
+        {
+            _slots.clear();
+            _generation = 1;
+        }
     }
 
-    void add(TokenSequence& sequence) override
+    void enable(bool enabled)
     {
-        const auto append = [&](const char* xmlNodeName, const std::string& content)
-        {
-            _lastTokenPos = _out.size();
-            _out.append("<").append(xmlNodeName);
-            appendContent(_out, content, sequence.getTopStyle());
-            _out.append("</").append(xmlNodeName).append(">");
-
-            sequence.next();
-        };
+        _enabled = enabled;
+    }
 
-        const auto& token = sequence.top();
-        switch (token.type)
+    // The group opened by the '{' at `begin`
+    Group group(std::size_t begin, int style)
+    {
+        if (!_enabled)
         {
-            case COMMAND:
-            {
-                const auto& content = token.content;
-
-                auto symbolCmdIt = getSymbolCmdMap().find(content);
-                if (symbolCmdIt != getSymbolCmdMap().end())
-                {
-                    append("mo", symbolCmdIt->second);
-                    return;
-                }
-
-                auto chCmdIt = getCharCmdMap().find(content);
-                if (chCmdIt != getCharCmdMap().end())
-                {
-                    append("mi", chCmdIt->second);
-                    return;
-                }
-
-
-                if (content == "left")
-                {
-                    _fences.push({_out.size(), sequence.next().top().content});
-                    sequence.next();
-                    return;
-                }
-
-                if (content == "right" && !_fences.empty())
-                {
-                    const auto& top = _fences.top();
-                    _lastTokenPos = top.first;
-                    _out.insert(top.first, "<mfenced open='" + (top.second == "." ? "" : top.second) +
-                                "' close='" + (sequence.next().top().content == "." ? "" : sequence.top().content) + "'><mrow>");
-                    _out.append("</mrow></mfenced>");
-                    _fences.pop();
-                    sequence.next();
-                    return;
-                }
-
-                auto builderIt = getBuilderFactory().find(content);
-                if (builderIt != getBuilderFactory().end())
-                {
-                    _lastTokenPos = _out.size();
-                    auto nestedBuilder = (*builderIt->second)();
-                    nestedBuilder->add(sequence.next());
-                    _out.append(nestedBuilder->take());
-                    return;
-                }
-            }
-
-            case TEXT:
-                append("mi", token.content);
-                return;
-
-            case DIGIT:
-                append("mn", token.content);
-                return;
+            return {begin, 0, 0, style};
+        }
 
-            case SIGN:
-            {
-                switch (token.content[0])
-                {
-                    case '^':
-                    case '_':
-                    {
-                        auto nestedBuilder = makeSubSup(_out.substr(_lastTokenPos), SubSupType::NoLimits);
-                        _out.erase(_lastTokenPos);
-                        nestedBuilder->add(sequence);
-                        _out.append(nestedBuilder->take());
-                        return;
-                    }
-                    case '<':
-                        append("mo", "&lt;");
-                        return;
+        prepare();
+        const auto end = _ends[begin];
+        if (!end)
+        {
+            return {begin, 0, 0, style};
+        }
 
-                    case '>':
-                        append("mo", "&gt;");
-                        return;
+        const auto span = _prefix[end] - _prefix[begin] * _powers[end - begin];
+        return {begin, end, span + static_cast<std::uint64_t>(style + 2) * 0xff51afd7ed558ccdull, style};
+    }
 
-                    default:
-                        break;
-                }
-                append("mo", token.content);
-                return;
-            }
+    // Returns the node of an earlier group like this one or nullptr
+    const NodeId* find(const Group& group)
+    {
+        if (!group.end || _slots.empty())
+        {
+            return nullptr;
+        }
 
-            case BEGIN_ENV:
+        for (auto i = group.hash & (_slots.size() - 1); _slots[i].generation == _generation; i = (i + 1) & (_slots.size() - 1))
+        {
+            auto& slot = _slots[i];
+            if (slot.hash == group.hash && slot.style == group.style && equal(slot.begin, slot.end, group.begin, group.end))
             {
-                _lastTokenPos = _out.size();
-                auto nestedBuilder = makeEnvBuilder(token.content);
-                nestedBuilder->add(sequence.next());
-                _out.append(nestedBuilder->take());
-                return;
+                _lastFound = &slot;
+                return &slot.node;
             }
-
-            case START_GROUP:
-            case END_GROUP:
-            case END_ENV:
-                sequence.next();
-                break;
-
-            case END:
-                break;
         }
+        return nullptr;
     }
 
-    void addCharOrToken(TokenSequence& sequence)
+    void insert(const Group& group, NodeId node)
     {
-        auto charSequence = sequence.popChar();
-        if (!charSequence.empty())
-        {            
-            _out.append("<mi");
-            appendContent(_out, charSequence, sequence.getTopStyle());
-            _out.append("</mi>");
-
+        if (!group.end)
+        {
             return;
         }
-        add(sequence);
+
+        if (2 * (_count + 1) > _slots.size())
+        {
+            grow();
+        }
+        place({group.hash, static_cast<std::uint32_t>(group.begin), static_cast<std::uint32_t>(group.end),
+               group.style, node, _generation, 0});
+        ++_count;
     }
 
-    std::string take() override
+    // Serialized size of the group last returned by find(), `size` computes it once
+    template <typename Size>
+    std::size_t foundBytes(Size&& size)
     {
-        _out.append("</").append(_nodeName).append(">");
-        return std::move(_out);
+        if (!_lastFound->bytes)
+        {
+            _lastFound->bytes = size(_lastFound->node);
+        }
+        return _lastFound->bytes;
     }
 
-    bool empty() const
+private:
+    struct Slot
     {
-        return _out.size() == (_nodeName.size() + 2);
-    }
+        std::uint64_t hash;
+        std::uint32_t begin;
+        std::uint32_t end;
+        int style;
+        NodeId node;
+        // Slots of earlier formulas are free
+        std::uint32_t generation;
+        std::size_t bytes;
+    };
 
 private:
-    void appendContent(std::string& out, const std::string& content, const TokenSequence::Style* const style)
+    // Matching braces and prefix hashes of the tokens, so that the hash of any
+    // group is two lookups. Done on the first group only.
+    void prepare()
     {
-        if (!style)
+        if (_prepared)
         {
-            out.append(">").append(content.data(), content.size());
             return;
         }
+        _prepared = true;
 
-        switch(*style)
+        constexpr std::uint64_t FACTOR = 0x9e3779b97f4a7c15ull;
+
+        const auto& tokens = *_tokens;
+        const auto size = tokens.size();
+        _ends.assign(size, 0);
+        _prefix.resize(size + 1);
+        _powers.resize(size + 1);
+        _open.clear();
+
+        _prefix[0] = 0;
+        _powers[0] = 1;
+        for (std::size_t i = 0; i < size; ++i)
         {
-            case TokenSequence::Style::Roman:
-                out.append(" mathvariant=\"normal\">").append(content.data(), content.size());
-                break;
+            const auto token = tokens[i];
+            _prefix[i + 1] = _prefix[i] * FACTOR + (hashText(token.content) ^ token.type);
+            _powers[i + 1] = _powers[i] * FACTOR;
 
-            case TokenSequence::Style::BlackboardBold:
+            if (token.type == START_GROUP && token.content[0] == '{')
             {
-                out.append(">");
-                for (auto it = content.begin(); it != content.end(); ++it)
-                {
-                    const auto chLen = getCharLength(*it);
-                    if (chLen == 1)
-                    {
-                        switch (*it)
-                        {
-                            case 'N':
-                                out.append("\xE2\x84\x95", 3);
-                                break;
-
-                            case 'Q':
-                                out.append("\xE2\x84\x9A", 3);
-                                break;
+                _open.push_back(i);
+            }
+            else if (token.type == END_GROUP && token.content[0] == '}' && !_open.empty())
+            {
+                _ends[_open.back()] = i + 1;
+                _open.pop_back();
+            }
+        }
+    }
 
-                            case 'Z':
-                                out.append("\xE2\x84\xA4", 3);
-                                break;
+    bool equal(std::size_t begin, std::size_t end, std::size_t otherBegin, std::size_t otherEnd) const
+    {
+        if (end - begin != otherEnd - otherBegin)
+        {
+            return false;
+        }
 
-                            default:
-                                break;
-                        }
-                    }
-                    else
-                    {
-                        out.append(&*it, chLen);
-                    }
-                }
-                break;
+        const auto& tokens = *_tokens;
+        for (; begin < end; ++begin, ++otherBegin)
+        {
+            if (tokens.types[begin] != tokens.types[otherBegin] || tokens[begin].content != tokens[otherBegin].content)
+            {
+                return false;
             }
         }
+        return true;
     }
 
-private:
-    std::string _nodeName;
-    std::string _out;
-    std::size_t _lastTokenPos;
-    std::stack<std::pair<std::size_t, std::string>> _fences;
-};
-
-class OptArgBuilder final : public Builder
-{
-public:
-    void add(TokenSequence& sequence) override
+    void place(const Slot& slot)
     {
-        if (sequence.top().content[0] != '[')
+        auto i = slot.hash & (_slots.size() - 1);
+        while (_slots[i].generation == _generation)
         {
-            return;
+            i = (i + 1) & (_slots.size() - 1);
         }
+        _slots[i] = slot;
+    }
 
-        for(bool finalize = false; !finalize && !sequence.empty();)
+    void grow()
+    {
+        _grown.clear();
+        for (const auto& slot : _slots)
         {
-            const auto& token = sequence.top();
-            switch (token.type)
+            if (slot.generation == _generation)
+            {
+                _grown.push_back(slot);
+            }
+        }
+
+        _slots.assign(std::max<std::size_t>(64, 2 * _slots.size()), Slot{0, 0, 0, 0, 0, 0, 0});
+        // The generation starts at 1, so the new slots are free
+        for (const auto& slot : _grown)
+        {
+            place(slot);
+        }
+    }
+
+private:
+    const TokenArray* _tokens = nullptr;
+    bool _enabled = true;
+    bool _prepared = false;
+    std::vector<std::uint32_t> _ends;
+    std::vector<std::uint64_t> _prefix;
+    std::vector<std::uint64_t> _powers;
+    std::vector<std::size_t> _open;
+
+    std::vector<Slot> _slots;
+    std::vector<Slot> _grown;
+    std::size_t _count = 0;
+    std::uint32_t _generation = 0;
+    Slot* _lastFound = nullptr;
+};
+
+// A brace group or environment, as logged for EditSession
+struct BuiltPart
+{
+    enum class Kind : std::uint8_t
+    {
+        Argument,
+        Environment,
+    };
+
+    Kind kind;
+    // The '{' or \begin token and past the closing one
+    std::uint32_t begin;
+    std::uint32_t end;
+    int style;
+    bool empty;
+    NodeId node;
+    MathMLTree::Span output;
+};
+
+class TokenSequence final
+{
+public:
+    using Clock = std::chrono::steady_clock;
+
+    enum class Style
+    {
+        BlackboardBold,
+        Roman,
+    };
+
+public:
+    // Open \left of all rows being built: mark in the tree and opening delimiter
+    using Fences = std::vector<std::pair<std::size_t, std::string_view>>;
+
+public:
+    TokenSequence(MathMLTree& tree, BuilderStack& builders)
+        : _tree(tree)
+        , _builders(builders)
+    {}
+
+    // Starts over with new tokens, keeping the memory of the stacks
+    void reset(const TokenArray& tokens)
+    {
+        _tokens = &tokens;
+        _pos = 0;
+        _t = tokens[0];
+        _styles.clear();
+        _fences.clear();
+        _memo.reset(tokens);
+    }
+
+    // Calls builder.add() until it returns true, running the nested builders
+    // it asks for in between
+    void run(Builder& builder)
+    {
+        const auto base = _frames.size();
+        try
+        {
+            for (auto* top = &builder;;)
+            {
+                if (!top->add(*this))
+                {
+                    top = _frames.back().get();
+                    continue;
+                }
+                if (_frames.size() == base)
+                {
+                    return;
+                }
+
+                _result = top->take(_tree);
+                _frames.pop_back();
+                top = _frames.size() == base ? &builder : _frames.back().get();
+            }
+        }
+        catch (...)
+        {
+            // In reverse order, as the builder stack needs
+            while (_frames.size() > base)
+            {
+                _frames.pop_back();
+            }
+            throw;
+        }
+    }
+
+    // Runs `nested` before the builder that calls this goes on, see Builder
+    bool call(BuilderStack::Ptr nested)
+    {
+        _frames.push_back(std::move(nested));
+        return false;
+    }
+
+    // The node of the nested builder that was done last
+    NodeId result() const
+    {
+        return _result;
+    }
+
+    MathMLTree& tree()
+    {
+        return _tree;
+    }
+
+    BuilderStack& builders()
+    {
+        return _builders;
+    }
+
+    Fences& fences()
+    {
+        return _fences;
+    }
+
+    GroupMemo& memo()
+    {
+        return _memo;
+    }
+
+    std::size_t position() const
+    {
+        return _pos;
+    }
+
+    // Continues at `pos`, e.g. past a group taken from the memo
+    void seek(std::size_t pos)
+    {
+        _pos = pos;
+        _t = (*_tokens)[pos];
+    }
+
+    const TokenView& top() const
+    {
+        return _t;
+    }
+
+    TokenSequence& next()
+    {
+        if (_pos + 1 < _tokens->size())
+        {
+            _t = (*_tokens)[++_pos];
+        }
+        if (--_untilClockCheck == 0)
+        {
+            checkDeadline();
+        }
+        return *this;
+    }
+
+    // Throws LimitExceeded once `deadline` has passed, the clock is read every
+    // CLOCK_CHECK_TOKENS tokens only. A zero `limit` turns the check off.
+    void setDeadline(Clock::time_point deadline, std::chrono::milliseconds limit)
+    {
+        _deadline = deadline;
+        _timeLimit = limit;
+        _untilClockCheck = limit.count() ? CLOCK_CHECK_TOKENS : static_cast<std::size_t>(-1);
+    }
+
+    void checkDeadline()
+    {
+        if (_timeLimit.count() && Clock::now() > _deadline)
+        {
+            throw LimitExceeded(LimitExceeded::Limit::Time, static_cast<std::uint64_t>(_timeLimit.count()));
+        }
+        _untilClockCheck = _timeLimit.count() ? CLOCK_CHECK_TOKENS : static_cast<std::size_t>(-1);
+    }
+
+    // Looks at the token `offset` positions after the top one without
+    // consuming anything. Past the end it returns the final END token.
+    TokenView peek(std::size_t offset = 1) const
+    {
+        return (*_tokens)[std::min(_pos + offset, _tokens->size() - 1)];
+    }
+
+    std::string_view popChar()
+    {
+        if (_t.type == TEXT)
+        {
+            auto& content = _t.content;
+            auto result = content.substr(0, getCharLength(content[0]));
+            content.remove_prefix(result.size());
+            if (content.empty())
+            {
+                next();
+            }
+            return result;
+        }
+        return std::string_view();
+    }
+
+    bool empty() const
+    {
+        return _t.type == END;
+    }
+
+    // False once popChar() took a part of the top token
+    bool atTokenStart() const
+    {
+        return _t.content.size() == _tokens->lengths[_pos];
+    }
+
+    void pushStyle(const Style& style)
+    {
+        _styles.push_back(style);
+    }
+
+    const Style* getTopStyle()
+    {
+        if (_styles.empty())
+        {
+            return nullptr;
+        }
+        return &_styles.back();
+    }
+
+    // The top style as a plain number, -1 without one
+    int styleKey() const
+    {
+        return _styles.empty() ? -1 : static_cast<int>(_styles.back());
+    }
+
+    // The group opened by the top token, which must be a '{'
+    GroupMemo::Group group()
+    {
+        return _memo.group(_pos, styleKey());
+    }
+
+    // While a log is set, builders add the parts they finish to it. Logged
+    // parts must not share nodes, so the memo is off meanwhile.
+    void setLog(std::vector<BuiltPart>* log)
+    {
+        _log = log;
+        _memo.enable(!log);
+    }
+
+    bool logging() const
+    {
+        return _log;
+    }
+
+    void log(BuiltPart::Kind kind, std::size_t begin, int style, NodeId node)
+    {
+        if (_log)
+        {
+            _log->push_back({kind, static_cast<std::uint32_t>(begin), static_cast<std::uint32_t>(_pos),
+                             style, _tree.node(node).childCount == 0, node, {}});
+        }
+    }
+
+    void popStyle()
+    {
+        _styles.pop_back();
+    }
+
+#ifdef TXL_STATS
+    void setStats(ConversionStats* stats)
+    {
+        _stats = stats;
+    }
+
+    ConversionStats* stats() const
+    {
+        return _stats;
+    }
+#endif
+
+private:
+    static constexpr std::size_t CLOCK_CHECK_TOKENS = 4096;
+
+    const TokenArray* _tokens = nullptr;
+    MathMLTree& _tree;
+    BuilderStack& _builders;
+    std::size_t _pos = 0;
+    TokenView _t;
+    std::vector<Style> _styles;
+    Fences _fences;
+    GroupMemo _memo;
+    std::vector<BuiltPart>* _log = nullptr;
+    std::vector<BuilderStack::Ptr> _frames;
+    NodeId _result = 0;
+    Clock::time_point _deadline;
+    std::chrono::milliseconds _timeLimit{0};
+    std::size_t _untilClockCheck = static_cast<std::size_t>(-1);
+#ifdef TXL_STATS
+    ConversionStats* _stats = nullptr;
+#endif
+};
+
+enum class CommandKind : std::uint8_t
+{
+    Char,
+    Symbol,
+    Builder,
+    // Read by the builder they appear in
+    Left,
+    Right,
+    Limits,
+    NoLimits,
+};
+
+// One entry of COMMANDS: the text of an <mi>/<mo> or the builder to make
+struct Command final
+{
+    std::string_view name;
+    CommandKind kind;
+    std::string_view text;
+    BuilderStack::Ptr (*factory)(BuilderStack& builders) = nullptr;
+};
+
+// The entry of a COMMAND token, nullptr for unknown commands
+const Command* commandOf(const TokenView& token);
+
+enum class SubSupType
+{
+    Limits,
+    NoLimits
+};
+
+BuilderStack::Ptr makeEnvBuilder(BuilderStack& builders, NameId id);
+BuilderStack::Ptr makeSubSup(BuilderStack& builders, NodeId base, SubSupType type);
+
+// The builder of the environment opened by the top token, which it consumes
+BuilderStack::Ptr startEnvironment(TokenSequence& sequence)
+{
+    TXL_STATS_ONLY(if (auto* stats = sequence.stats()) ConversionStats::count(stats->environments, sequence.top().content);)
+    auto builder = makeEnvBuilder(sequence.builders(), sequence.top().id);
+    sequence.next();
+    return builder;
+}
+
+// Builds the environment opened by the top token on its own
+NodeId buildEnvironment(TokenSequence& sequence)
+{
+    const auto begin = sequence.position();
+    const auto style = sequence.styleKey();
+    auto builder = startEnvironment(sequence);
+    sequence.run(*builder);
+    const auto node = builder->take(sequence.tree());
+    sequence.log(BuiltPart::Kind::Environment, begin, style, node);
+    return node;
+}
+
+class RowBuilder final : public Builder
+{
+public:
+    RowBuilder(const char* nodeName = "mrow")
+        : _nodeName(nodeName)
+    {
+    }
+
+    // Adds one token, or the command or environment starting there
+    bool add(TokenSequence& sequence) override
+    {
+        auto& tree = sequence.tree();
+        if (_waiting != Waiting::None)
+        {
+            const auto node = sequence.result();
+            if (_waiting == Waiting::Environment)
+            {
+                sequence.log(BuiltPart::Kind::Environment, _environmentBegin, _environmentStyle, node);
+            }
+            _waiting = Waiting::None;
+            tree.push(node);
+            return true;
+        }
+
+        auto& fences = sequence.fences();
+        start(sequence);
+
+        const auto append = [&](const char* xmlNodeName, std::string_view content)
+        {
+            _lastTokenPos = tree.mark();
+            tree.push(makeContent(tree, xmlNodeName, content, sequence.getTopStyle()));
+
+            sequence.next();
+        };
+
+        const auto& token = sequence.top();
+        switch (token.type)
+        {
+            case COMMAND:
+            {
+                if (const auto* command = commandOf(token))
+                {
+                    switch (command->kind)
+                    {
+                        case CommandKind::Char:
+                            append("mi", command->text);
+                            return true;
+
+                        case CommandKind::Symbol:
+                            append("mo", command->text);
+                            return true;
+
+                        case CommandKind::Builder:
+                        {
+                            TXL_STATS_ONLY(if (auto* stats = sequence.stats()) ConversionStats::count(stats->commands, token.content);)
+                            _lastTokenPos = tree.mark();
+                            auto nestedBuilder = command->factory(sequence.builders());
+                            sequence.next();
+                            _waiting = Waiting::Node;
+                            return sequence.call(std::move(nestedBuilder));
+                        }
+
+                        case CommandKind::Left:
+                            fences.push_back({tree.mark(), sequence.next().top().content});
+                            sequence.next();
+                            return true;
+
+                        case CommandKind::Right:
+                        {
+                            if (fences.size() == _fenceBegin)
+                            {
+                                break;
+                            }
+                            const auto& top = fences.back();
+                            const auto open = top.second == "." ? std::string_view() : top.second;
+                            const auto close = sequence.next().top().content;
+                            _lastTokenPos = std::min(top.first, tree.mark());
+                            const auto row = tree.element("mrow", "", _lastTokenPos);
+                            tree.push(tree.element("mfenced",
+                                                   tree.store({" open='", open, "' close='", close == "." ? std::string_view() : close, "'"}),
+                                                   {row}));
+                            fences.pop_back();
+                            sequence.next();
+                            return true;
+                        }
+
+                        default:
+                            break;
+                    }
+                }
+                // Anything else is written as its name
+            }
+
+            case TEXT:
+                append("mi", token.content);
+                return true;
+
+            case DIGIT:
+                append("mn", token.content);
+                return true;
+
+            case SIGN:
+            {
+                switch (token.content[0])
+                {
+                    case '^':
+                    case '_':
+                    {
+                        // An open \left after the base keeps its mark, which now points right after the new node
+                        _waiting = Waiting::Node;
+                        return sequence.call(makeSubSup(sequence.builders(), tree.fragment(_lastTokenPos), SubSupType::NoLimits));
+                    }
+                    case '<':
+                        append("mo", "&lt;");
+                        return true;
+
+                    case '>':
+                        append("mo", "&gt;");
+                        return true;
+
+                    default:
+                        break;
+                }
+                append("mo", token.content);
+                return true;
+            }
+
+            case BEGIN_ENV:
+                _lastTokenPos = tree.mark();
+                _environmentBegin = sequence.position();
+                _environmentStyle = sequence.styleKey();
+                _waiting = Waiting::Environment;
+                return sequence.call(startEnvironment(sequence));
+
+            case START_GROUP:
+            case END_GROUP:
+            case END_ENV:
+                sequence.next();
+                break;
+
+            case END:
+                break;
+        }
+        return true;
+    }
+
+    bool addCharOrToken(TokenSequence& sequence)
+    {
+        if (_waiting == Waiting::None)
+        {
+            auto charSequence = sequence.popChar();
+            if (!charSequence.empty())
+            {
+                auto& tree = sequence.tree();
+                start(sequence);
+                tree.push(makeContent(tree, "mi", charSequence, sequence.getTopStyle()));
+                return true;
+            }
+        }
+        return add(sequence);
+    }
+
+    // A nested builder is in progress, the next add() takes its node
+    bool waiting() const
+    {
+        return _waiting != Waiting::None;
+    }
+
+    NodeId take(MathMLTree& tree) override
+    {
+        if (!_started)
+        {
+            return tree.element(_nodeName, "", tree.mark());
+        }
+
+        // A \left without \right only loses its fence
+        _fences->resize(_fenceBegin);
+        return tree.element(_nodeName, "", _begin);
+    }
+
+    bool empty(const MathMLTree& tree) const
+    {
+        return !_started || tree.mark() == _begin;
+    }
+
+    // End of the pending ids that no later token can change: a sub/superscript
+    // takes the last one as its base and a \right wraps all after its \left.
+    std::size_t finished() const
+    {
+        if (!_started)
+        {
+            return 0;
+        }
+        return _fences->size() > _fenceBegin ? std::min(_lastTokenPos, (*_fences)[_fenceBegin].first) : _lastTokenPos;
+    }
+
+private:
+    // The children are the ids pushed after the first add()
+    void start(TokenSequence& sequence)
+    {
+        if (!_started)
+        {
+            _started = true;
+            _begin = sequence.tree().mark();
+            _lastTokenPos = _begin;
+            _fences = &sequence.fences();
+            _fenceBegin = _fences->size();
+        }
+    }
+
+    static NodeId makeContent(MathMLTree& tree, const char* name, std::string_view content, const TokenSequence::Style* const style)
+    {
+        if (!style)
+        {
+            return tree.textElement(name, "", content);
+        }
+
+        switch(*style)
+        {
+            case TokenSequence::Style::Roman:
+                return tree.textElement(name, " mathvariant=\"normal\"", content);
+
+            case TokenSequence::Style::BlackboardBold:
+            {
+                tree.startText();
+                for (auto it = content.begin(); it != content.end(); ++it)
+                {
+                    const auto chLen = getCharLength(*it);
+                    if (chLen == 1)
+                    {
+                        switch (*it)
+                        {
+                            case 'N':
+                                tree.appendText("\xE2\x84\x95");
+                                break;
+
+                            case 'Q':
+                                tree.appendText("\xE2\x84\x9A");
+                                break;
+
+                            case 'Z':
+                                tree.appendText("\xE2\x84\xA4");
+                                break;
+
+                            default:
+                                break;
+                        }
+                    }
+                    else
+                    {
+                        const auto left = static_cast<std::size_t>(content.end() - it);
+                        tree.appendText(std::string_view(&*it, std::min<std::size_t>(chLen, left)));
+                    }
+                }
+                return tree.textElement(name, "", tree.finishText());
+            }
+        }
+        return tree.textElement(name, "", content);
+    }
+
+private:
+    enum class Waiting : std::uint8_t
+    {
+        None,
+        Node,
+        Environment,
+    };
+
+private:
+    const char* _nodeName;
+    bool _started = false;
+    Waiting _waiting = Waiting::None;
+    std::size_t _begin = 0;
+    std::size_t _lastTokenPos = 0;
+    std::size_t _environmentBegin = 0;
+    int _environmentStyle = -1;
+    // The open \left of this row are the ones after _fenceBegin
+    TokenSequence::Fences* _fences = nullptr;
+    std::size_t _fenceBegin = 0;
+};
+
+class OptArgBuilder final : public Builder
+{
+public:
+    bool add(TokenSequence& sequence) override
+    {
+        if (_done)
+        {
+            return true;
+        }
+        if (!_started && sequence.top().content[0] != '[')
+        {
+            _done = true;
+            return true;
+        }
+        _started = true;
+
+        for (;;)
+        {
+            if (_rowBuilder.waiting() && !_rowBuilder.add(sequence))
+            {
+                return false;
+            }
+            if (_finalize || sequence.empty())
+            {
+                break;
+            }
+
+            const auto& token = sequence.top();
+            switch (token.type)
+            {
+                case START_GROUP:
+                    ++_groupIndex;
+                    break;
+
+                case END_GROUP:
+                    --_groupIndex;
+                    if (_groupIndex == 0 && token.content[0] == ']') _finalize = true;
+                    break;
+
+                default:
+                    break;
+            }
+            if (!_rowBuilder.add(sequence))
+            {
+                return false;
+            }
+        }
+        finish(sequence.tree());
+        _done = true;
+        return true;
+    }
+
+    NodeId take(MathMLTree& tree) override
+    {
+        finish(tree);
+        return _node;
+    }
+
+private:
+    // Finish the row now, the next argument pushes its children on top
+    void finish(MathMLTree& tree)
+    {
+        if (!_taken)
+        {
+            _node = _rowBuilder.take(tree);
+            _taken = true;
+        }
+    }
+
+private:
+    std::size_t _groupIndex = 0;
+    bool _started = false;
+    bool _finalize = false;
+    bool _done = false;
+    RowBuilder _rowBuilder;
+    NodeId _node = 0;
+    bool _taken = false;
+};
+
+class ArgBuilder final : public Builder
+{
+public:
+    bool add(TokenSequence& sequence) override
+    {
+        auto& tree = sequence.tree();
+        if (_step == Step::Start)
+        {
+            _step = sequence.top().content[0] == '{' ? Step::Group : Step::Token;
+            if (_step == Step::Group && reuse(sequence))
+            {
+                _step = Step::Done;
+            }
+        }
+
+        switch (_step)
+        {
+            case Step::Token:
+                if (!_rowBuilder.addCharOrToken(sequence))
+                {
+                    return false;
+                }
+                finish(tree);
+                break;
+
+            case Step::Group:
+                if (!addGroup(sequence))
+                {
+                    return false;
+                }
+                break;
+
+            default:
+                break;
+        }
+        _step = Step::Done;
+        return true;
+    }
+
+    NodeId take(MathMLTree& tree) override
+    {
+        finish(tree);
+        return _node;
+    }
+
+    bool empty() const
+    {
+        return _empty;
+    }
+
+private:
+    enum class Step : std::uint8_t
+    {
+        Start,
+        Token,
+        Group,
+        Done,
+    };
+
+private:
+    // Takes the node of an earlier group like the one at the top token
+    bool reuse(TokenSequence& sequence)
+    {
+        auto& memo = sequence.memo();
+        _group = sequence.group();
+        const auto* node = memo.find(_group);
+        if (!node)
+        {
+            return false;
+        }
+
+        auto& tree = sequence.tree();
+#ifdef TXL_STATS
+        if (auto* stats = sequence.stats())
+        {
+            ++stats->reusedGroups;
+            stats->reusedBytes += memo.foundBytes([&](NodeId id) { return tree.serializedSize(id); });
+        }
+#endif
+        sequence.seek(_group.end);
+        _node = *node;
+        _empty = tree.node(_node).childCount == 0;
+        _taken = true;
+        return true;
+    }
+
+    bool addGroup(TokenSequence& sequence)
+    {
+        for (;;)
+        {
+            if (_rowBuilder.waiting() && !_rowBuilder.add(sequence))
+            {
+                return false;
+            }
+            if (_finalize || sequence.empty())
+            {
+                break;
+            }
+
+            const auto& token = sequence.top();
+            switch (token.type)
             {
                 case START_GROUP:
                     ++_groupIndex;
                     break;
 
-                case END_GROUP:
-                    --_groupIndex;
-                    if (_groupIndex == 0 && token.content[0] == ']') finalize = true;
+                case END_GROUP:
+                    --_groupIndex;
+                    if (_groupIndex == 0 && token.content[0] == '}') _finalize = true;
+                    break;
+
+                default:
+                    break;
+            }
+            if (!_rowBuilder.add(sequence))
+            {
+                return false;
+            }
+        }
+        finish(sequence.tree());
+
+        // Unbalanced braces may end the argument somewhere else
+        if (sequence.position() == _group.end)
+        {
+            sequence.memo().insert(_group, _node);
+        }
+        sequence.log(BuiltPart::Kind::Argument, _group.begin, _group.style, _node);
+        return true;
+    }
+
+    // Finish the row now, the next argument pushes its children on top
+    void finish(MathMLTree& tree)
+    {
+        if (!_taken)
+        {
+            _empty = _rowBuilder.empty(tree);
+            _node = _rowBuilder.take(tree);
+            _taken = true;
+        }
+    }
+
+private:
+    Step _step = Step::Start;
+    std::size_t _groupIndex = 0;
+    bool _finalize = false;
+    GroupMemo::Group _group = {};
+    RowBuilder _rowBuilder;
+    NodeId _node = 0;
+    bool _taken = false;
+    bool _empty = true;
+};
+
+class TextArgBuilder final : public Builder
+{
+public:
+    explicit TextArgBuilder(bool preserveWhitespace = false)
+        : _preserveWhitespace(preserveWhitespace)
+    {
+    }
+
+    bool add(TokenSequence& sequence) override
+    {
+        if (_done)
+        {
+            return true;
+        }
+        _done = true;
+
+        if (sequence.top().content[0] != '{')
+        {
+            _text = sequence.top().content;
+            sequence.next();
+            return true;
+        }
+
+        auto& tree = sequence.tree();
+        tree.startText();
+        std::size_t size = 0;
+        std::size_t groupIndex = 1;
+        sequence.next();
+        for(bool finalize = false; !finalize && !sequence.empty(); sequence.next())
+        {
+            const auto& token = sequence.top();
+            switch (token.type)
+            {
+                case START_GROUP:
+                    ++groupIndex;
+                    break;
+
+                case END_GROUP:
+                    --groupIndex;
+                    if (groupIndex == 0 && token.content[0] == '}') finalize = true;
+                    break;
+
+                default:
+                    break;
+            }
+
+            if (!finalize)
+            {
+                if (_preserveWhitespace && size != 0) tree.appendText(" ");
+                tree.appendText(token.content);
+                size += token.content.size();
+            }
+        }
+        _text = tree.finishText();
+        return true;
+    }
+
+    std::string_view takeContent()
+    {
+        return _text;
+    }
+
+    NodeId take(MathMLTree& tree) override
+    {
+        return tree.textElement("mtext", "", _text);
+    }
+
+private:
+    std::string_view _text;
+    bool _preserveWhitespace;
+    bool _done = false;
+};
+
+
+BuilderStack::Ptr makeFRAC(BuilderStack& builders)
+{
+    class FRACBuilder final : public Builder
+    {
+        bool add(TokenSequence& sequence) override
+        {
+            return _arg1.add(sequence) && _arg2.add(sequence);
+        }
+
+        NodeId take(MathMLTree& tree) override
+        {
+            return tree.element("mfrac", "", {_arg1.take(tree), _arg2.take(tree)});
+        }
+
+    private:
+        ArgBuilder _arg1;
+        ArgBuilder _arg2;
+    };
+    return builders.make<FRACBuilder>();
+}
+
+BuilderStack::Ptr makeGENFRAC(BuilderStack& builders)
+{
+    class GENFRACBuilder final : public Builder
+    {
+        bool add(TokenSequence& sequence) override
+        {
+            return _left.add(sequence) && _right.add(sequence) && _barThickness.add(sequence) && _style.add(sequence) &&
+                   _numerator.add(sequence) && _denominator.add(sequence);
+        }
+
+        NodeId take(MathMLTree& tree) override
+        {
+            const auto frac = tree.element("mfrac",
+                                           tree.store({" linethickness='", _barThickness.takeContent(), "'"}),
+                                           {_numerator.take(tree), _denominator.take(tree)});
+            return tree.element("mfenced",
+                                tree.store({" open='", _left.takeContent(), "' close='", _right.takeContent(), "'"}),
+                                {tree.element("mrow", "", {frac})});
+        }
+
+    private:
+
+    private:
+        TextArgBuilder _left;
+        TextArgBuilder _right;
+        TextArgBuilder _barThickness;
+        TextArgBuilder _style;
+        ArgBuilder _numerator;
+        ArgBuilder _denominator;
+    };
+    return builders.make<GENFRACBuilder>();
+}
+
+BuilderStack::Ptr makeBINOM(BuilderStack& builders)
+{
+    class BINOMBuilder final : public Builder
+    {
+        bool add(TokenSequence& sequence) override
+        {
+            return _numerator.add(sequence) && _denominator.add(sequence);
+        }
+
+        NodeId take(MathMLTree& tree) override
+        {
+            const auto frac = tree.element("mfrac", " linethickness='0pt'", {_numerator.take(tree), _denominator.take(tree)});
+            return tree.element("mfenced", " open='(' close=')'", {tree.element("mrow", "", {frac})});
+        }
+    private:
+        ArgBuilder _numerator;
+        ArgBuilder _denominator;
+    };
+    return builders.make<BINOMBuilder>();
+}
+
+BuilderStack::Ptr makeSQRT(BuilderStack& builders)
+{
+    class SQRTBuilder final : public Builder
+    {
+        bool add(TokenSequence& sequence) override
+        {
+            return _arg1.add(sequence) && _arg2.add(sequence);
+        }
+
+        NodeId take(MathMLTree& tree) override
+        {
+            return tree.element("mroot", "", {_arg2.take(tree), _arg1.take(tree)});
+        }
+
+    private:
+        OptArgBuilder _arg1;
+        ArgBuilder _arg2;
+    };
+    return builders.make<SQRTBuilder>();
+}
+
+class SubSupBuilder final : public Builder
+{
+public:
+    SubSupBuilder(NodeId base, SubSupType type)
+        : _type(type)
+        , _base(base)
+    {
+    }
+
+    // The base is a fixed operator, its node is made in take()
+    SubSupBuilder(const char* operatorMarkup, SubSupType type)
+        : _type(type)
+        , _operator(operatorMarkup)
+    {
+    }
+
+    bool add(TokenSequence& sequence) override
+    {
+        for (;;)
+        {
+            if (_current)
+            {
+                if (!_current->add(sequence))
+                {
+                    return false;
+                }
+                _current = nullptr;
+            }
+            if (_finalize || sequence.empty())
+            {
+                break;
+            }
+
+            const auto& token = sequence.top();
+            switch (token.type)
+            {
+                case SIGN:
+                {
+                    switch (token.content[0])
+                    {
+                        case '^':
+                        {
+                            if (_hasSup)
+                            {
+                                _finalize = true;
+                                break;
+                            }
+                            _hasSup = true;
+                            sequence.next();
+                            _current = &_sup;
+                            break;
+                        }
+                        case '_':
+                        {
+                            if (_hasSub)
+                            {
+                                _finalize = true;
+                                break;
+                            }
+                            _hasSub = true;
+                            sequence.next();
+                            _current = &_sub;
+                            break;
+                        }
+
+                        default:
+                            _finalize = true;
+                            break;
+                    }
                     break;
+                }
+
+                case COMMAND:
+                {
+                    const auto* command = commandOf(token);
+                    if (command && command->kind == CommandKind::Limits)
+                    {
+                        _type = SubSupType::Limits;
+                        sequence.next();
+                        break;
+                    }
+
+                    if (command && command->kind == CommandKind::NoLimits)
+                    {
+                        _type = SubSupType::NoLimits;
+                        sequence.next();
+                        break;
+                    }
+                }
 
                 default:
+                    _finalize = true;
                     break;
             }
-            _rowBuilder.add(sequence);
         }
+        // Done, calls after this return right away
+        _finalize = true;
+        return true;
     }
 
-    std::string take() override
+    NodeId take(MathMLTree& tree) override
     {
-        return _rowBuilder.take();
+        const auto base = _operator ? tree.markup(_operator) : _base;
+        if(_hasSub && _hasSup)
+        {
+            return tree.element(_type == SubSupType::Limits ? "munderover" : "msubsup", "",
+                                {tree.element("mrow", "", {base}), _sub.take(tree), _sup.take(tree)});
+        }
+        if(_hasSub)
+        {
+            return tree.element(_type == SubSupType::Limits ? "munder" : "msub", "",
+                                {tree.element("mrow", "", {base}), _sub.take(tree)});
+        }
+        if(_hasSup)
+        {
+            return tree.element(_type == SubSupType::Limits ? "mover" : "msup", "",
+                                {tree.element("mrow", "", {base}), _sup.take(tree)});
+        }
+        return base;
     }
 
 private:
-    std::size_t _groupIndex = 0;
-    RowBuilder _rowBuilder;
+    SubSupType _type;
+    NodeId _base = 0;
+    const char* _operator = nullptr;
+    ArgBuilder _sub;
+    bool _hasSub = false;
+    ArgBuilder _sup;
+    bool _hasSup = false;
+    // The script being added and whether the scripts are over
+    ArgBuilder* _current = nullptr;
+    bool _finalize = false;
 };
 
-class ArgBuilder final : public Builder
+BuilderStack::Ptr makeSubSup(BuilderStack& builders, NodeId base, SubSupType type)
+{
+    return builders.make<SubSupBuilder>(base, type);
+}
+
+class TableBuilder final : public Builder
 {
 public:
-    void add(TokenSequence& sequence) override
+    // Adds one token, like RowBuilder
+    bool add(TokenSequence& sequence) override
     {
-        if (sequence.top().content[0] != '{')
+        if (_tdBuilder.waiting())
         {
-            _rowBuilder.addCharOrToken(sequence);
-            return;
+            return _tdBuilder.add(sequence);
+        }
+
+        auto& tree = sequence.tree();
+        start(tree);
+
+        const auto& token = sequence.top();
+        switch (token.type)
+        {
+            case SIGN:
+            {
+                switch (token.content[0])
+                {
+                    case '&':
+                    {
+                        tree.push(_tdBuilder.take(tree));
+                        _tdBuilder = RowBuilder("mtd");
+                        sequence.next();
+                        break;
+                    }
+
+                    case '\\':
+                    {
+                        tree.push(_tdBuilder.take(tree));
+                        tree.push(tree.element("mtr", "", _rowBegin));
+                        _rowBegin = tree.mark();
+                        _tdBuilder = RowBuilder("mtd");
+                        sequence.next();
+                        break;
+                    }
+                    default:
+                        return _tdBuilder.add(sequence);
+                }
+                break;
+            }
+
+            default:
+                return _tdBuilder.add(sequence);
+        }
+        return true;
+    }
+
+    bool waiting() const
+    {
+        return _tdBuilder.waiting();
+    }
+
+    NodeId take(MathMLTree& tree) override
+    {
+        start(tree);
+        const auto empty = _tdBuilder.empty(tree);
+        const auto td = _tdBuilder.take(tree);
+        if (!empty)
+        {
+            tree.push(td);
+            tree.push(tree.element("mtr", "", _rowBegin));
+        }
+        return tree.element("mtable", "", _begin);
+    }
+
+private:
+    void start(const MathMLTree& tree)
+    {
+        if (!_started)
+        {
+            _started = true;
+            _begin = tree.mark();
+            _rowBegin = _begin;
+        }
+    }
+
+private:
+    bool _started = false;
+    std::size_t _begin = 0;
+    // Cells of the current row, the row is only wrapped in <mtr> once it ends
+    std::size_t _rowBegin = 0;
+    RowBuilder _tdBuilder = RowBuilder("mtd");
+};
+
+class ArgTableBuilder final : public Builder
+{
+public:
+    bool add(TokenSequence& sequence) override
+    {
+        if (_done)
+        {
+            return true;
+        }
+
+        if (!_started)
+        {
+            _started = true;
+            if (sequence.top().content[0] != '{')
+            {
+                // A single token, unless a nested builder is still running
+                _finalize = true;
+                if (!_tableBuilder.add(sequence))
+                {
+                    return false;
+                }
+            }
         }
 
-        for(bool finalize = false; !finalize && !sequence.empty();)
+        for (;;)
         {
+            if (_tableBuilder.waiting() && !_tableBuilder.add(sequence))
+            {
+                return false;
+            }
+            if (_finalize || sequence.empty())
+            {
+                break;
+            }
+
             const auto& token = sequence.top();
             switch (token.type)
             {
@@ -571,1141 +1755,1938 @@ public:
 
                 case END_GROUP:
                     --_groupIndex;
-                    if (_groupIndex == 0 && token.content[0] == '}') finalize = true;
+                    if (_groupIndex == 0 && token.content[0] == '}') _finalize = true;
                     break;
 
                 default:
                     break;
             }
-            _rowBuilder.add(sequence);
+            if (!_tableBuilder.add(sequence))
+            {
+                return false;
+            }
+        }
+        _done = true;
+        return true;
+    }
+
+    NodeId take(MathMLTree& tree) override
+    {
+        return _tableBuilder.take(tree);
+    }
+
+private:
+    TableBuilder _tableBuilder;
+    int _groupIndex = 0;
+    bool _started = false;
+    bool _finalize = false;
+    bool _done = false;
+};
+
+// Environments the lexer gives an id to, with the fence of their table
+struct Environment final
+{
+    std::string_view name;
+    const char* fence;
+};
+
+constexpr Environment ENVIRONMENTS[] =
+{
+    {"matrix", nullptr},
+    {"array", nullptr},
+    {"pmatrix", " open='(' close=')'"},
+    {"bmatrix", " open='[' close=']'"},
+    {"Bmatrix", " open='{' close='}'"},
+    {"vmatrix", " open='|' close='|'"},
+    {"Vmatrix", " open='\xE2\x80\x96' close='\xE2\x80\x96'"},
+};
+
+BuilderStack::Ptr makeEnvBuilder(BuilderStack& builders, NameId id)
+{
+    class EnvBuilder final : public Builder
+    {
+    public:
+        EnvBuilder(NameId id)
+            : _fence(id < std::size(ENVIRONMENTS) ? ENVIRONMENTS[id].fence : nullptr)
+        {
+        }
+
+        bool add(TokenSequence& sequence) override
+        {
+            if (!_started)
+            {
+                _started = true;
+                _arg.add(sequence);
+            }
+
+            for (;;)
+            {
+                if (_tableBuilder.waiting() && !_tableBuilder.add(sequence))
+                {
+                    return false;
+                }
+                if (sequence.empty())
+                {
+                    return true;
+                }
+
+                if (sequence.top().type == END_ENV)
+                {
+                    sequence.next();
+                    return true;
+                }
+                if (!_tableBuilder.add(sequence))
+                {
+                    return false;
+                }
+            }
+        }
+
+        NodeId take(MathMLTree& tree) override
+        {
+            const auto table = _tableBuilder.take(tree);
+            return _fence ? tree.element("mfenced", _fence, {table}) : table;
+        }
+
+    private:
+        // Skips the column spec of array-like environments, it does not change the output
+        struct Arg final
+        {
+            void add(TokenSequence& sequence)
+            {
+                if (sequence.top().content[0] != '{')
+                {
+                    return;
+                }
+
+                std::size_t groupIndex = 0;
+                for(bool finalize = false; !finalize && !sequence.empty(); sequence.next())
+                {
+                    const auto& token = sequence.top();
+                    switch (token.type)
+                    {
+                        case START_GROUP:
+                            ++groupIndex;
+                            break;
+
+                        case END_GROUP:
+                            --groupIndex;
+                            if (groupIndex == 0 && token.content[0] == '}') finalize = true;
+                            break;
+
+                        default:
+                            break;
+                    }
+                }
+            }
+        };
+
+    private:
+        const char* _fence;
+        bool _started = false;
+        Arg _arg;
+        TableBuilder _tableBuilder;
+    };
+
+    return builders.make<EnvBuilder>(id);
+}
+
+class SumLikeBuilder final : public Builder
+{
+public:
+    SumLikeBuilder(const char* operatorMarkup, const SubSupType type)
+        : _operator(operatorMarkup, type)
+    {
+    }
+
+    bool add(TokenSequence& sequence) override
+    {
+        return _operator.add(sequence) && _arg.add(sequence);
+    }
+
+    NodeId take(MathMLTree& tree) override
+    {
+        const auto mark = tree.mark();
+        tree.push(_operator.take(tree));
+
+        if (!_arg.empty())
+        {
+            tree.push(_arg.take(tree));
         }
+        return tree.fragment(mark);
+    }
+
+private:
+    SubSupBuilder _operator;
+    ArgBuilder _arg;
+};
+
+BuilderStack::Ptr makeSUM(BuilderStack& builders)
+{
+    return builders.make<SumLikeBuilder>("<mo>\xE2\x88\x91</mo>", SubSupType::Limits);
+}
+
+BuilderStack::Ptr makePROD(BuilderStack& builders)
+{
+    return builders.make<SumLikeBuilder>("<mo>\xE2\x88\x8F</mo>", SubSupType::Limits);
+}
+
+BuilderStack::Ptr makeINT(BuilderStack& builders)
+{
+    return builders.make<SubSupBuilder>("<mo>\xE2\x88\xAB</mo>", SubSupType::NoLimits);
+}
+
+BuilderStack::Ptr makeIINT(BuilderStack& builders)
+{
+    return builders.make<SubSupBuilder>("<mo>\xE2\x88\xAC</mo>", SubSupType::NoLimits);
+}
+
+BuilderStack::Ptr makeIIINT(BuilderStack& builders)
+{
+    return builders.make<SubSupBuilder>("<mo>\xE2\x88\xAD</mo>", SubSupType::NoLimits);
+}
+
+BuilderStack::Ptr makeIIIINT(BuilderStack& builders)
+{
+    return builders.make<SubSupBuilder>("<mo>\xE2\xA8\x8C</mo>", SubSupType::NoLimits);
+}
+
+BuilderStack::Ptr makeOINT(BuilderStack& builders)
+{
+    return builders.make<SubSupBuilder>("<mo>\xE2\x88\xAE</mo>", SubSupType::NoLimits);
+}
+
+BuilderStack::Ptr makeOIINT(BuilderStack& builders)
+{
+    return builders.make<SubSupBuilder>("<mo>\xE2\x88\xAF</mo>", SubSupType::NoLimits);
+}
+
+BuilderStack::Ptr makeOIIINT(BuilderStack& builders)
+{
+    return builders.make<SubSupBuilder>("<mo>\xE2\x88\xB0</mo>", SubSupType::NoLimits);
+}
+
+BuilderStack::Ptr makeSMALLINT(BuilderStack& builders)
+{
+    return builders.make<SubSupBuilder>("<mo largeop=\"false\">\xE2\x88\xAB</mo>", SubSupType::NoLimits);
+}
+
+BuilderStack::Ptr makeLIM(BuilderStack& builders)
+{
+    return builders.make<SubSupBuilder>("<mi mathvariant=\"normal\">lim</mi>", SubSupType::Limits);
+}
+
+class ReverseTwoArgBuilder final : public Builder
+{
+public:
+    ReverseTwoArgBuilder(const char* nodeName)
+        : _nodeName(nodeName)
+    {
     }
 
-    std::string take() override
+    bool add(TokenSequence& sequence) override
     {
-        return _rowBuilder.take();
+        return _arg1.add(sequence) && _arg2.add(sequence);
     }
 
-    bool empty() const
+    NodeId take(MathMLTree& tree) override
     {
-        return _rowBuilder.empty();
+        return tree.element(_nodeName, "", {_arg2.take(tree), _arg1.take(tree)});
     }
 
 private:
-    std::size_t _groupIndex = 0;
-    RowBuilder _rowBuilder;
+    const char* _nodeName;
+    ArgBuilder _arg1;
+    ArgBuilder _arg2;
 };
 
-class TextArgBuilder final : public Builder
+BuilderStack::Ptr makeOVERSET(BuilderStack& builders)
+{
+    return builders.make<ReverseTwoArgBuilder>("mover");
+}
+
+BuilderStack::Ptr makeUNDERSET(BuilderStack& builders)
+{
+    return builders.make<ReverseTwoArgBuilder>("munder");
+}
+
+class MATHStyleBuilder final : public Builder
 {
 public:
-    explicit TextArgBuilder(bool preserveWhitespace = false)
-        : _preserveWhitespace(preserveWhitespace)
-    {
-    }
+    MATHStyleBuilder(const TokenSequence::Style style)
+        : _style(style)
+    {}
 
-    void add(TokenSequence& sequence) override
+    bool add(TokenSequence& sequence) override
     {
-        if (sequence.top().content[0] != '{')
+        // The style stays on while nested builders of the argument run
+        if (!_started)
         {
-            _out = sequence.top().content;
-            sequence.next();
-            return;
+            _started = true;
+            sequence.pushStyle(_style);
         }
-
-        std::size_t groupIndex = 1;
-        sequence.next();
-        for(bool finalize = false; !finalize && !sequence.empty(); sequence.next())
+        if (!_arg.add(sequence))
         {
-            const auto& token = sequence.top();
-            switch (token.type)
-            {
-                case START_GROUP:
-                    ++groupIndex;
-                    break;
+            return false;
+        }
+        if (!_done)
+        {
+            _done = true;
+            sequence.popStyle();
+        }
+        return true;
+    }
 
-                case END_GROUP:
-                    --groupIndex;
-                    if (groupIndex == 0 && token.content[0] == '}') finalize = true;
-                    break;
+    NodeId take(MathMLTree& tree) override
+    {
+        return _arg.take(tree);
+    }
 
-                default:
-                    break;
-            }
+private:
+    ArgBuilder _arg;
+    TokenSequence::Style _style;
+    bool _started = false;
+    bool _done = false;
+};
 
-            if (!finalize)
-            {
-                if (_preserveWhitespace && !_out.empty()) _out.append(" ");
-                _out.append(token.content);
-            }
-        }
-    }
+BuilderStack::Ptr makeMATHBB(BuilderStack& builders)
+{
+    return builders.make<MATHStyleBuilder>(TokenSequence::Style::BlackboardBold);
+}
+
+BuilderStack::Ptr makeMATHRM(BuilderStack& builders)
+{
+    return builders.make<MATHStyleBuilder>(TokenSequence::Style::Roman);
+}
 
-    std::string takeContent()
+class AccentBuilder final : public Builder
+{
+public:
+    AccentBuilder(const char* accent, const char* nodeArgs = "")
+        : _accent(accent)
+        , _nodeArgs(nodeArgs)
+    {}
+
+    bool add(TokenSequence& sequence) override
     {
-        return std::move(_out);
+        return _arg.add(sequence);
     }
 
-    std::string take() override
+    NodeId take(MathMLTree& tree) override
     {
-        return "<mtext>" + _out + "</mtext>";
+        return tree.element("mover", _nodeArgs, {_arg.take(tree), tree.markup(_accent)});
     }
 
 private:
-    std::string _out;
-    bool _preserveWhitespace;
+    const char* _accent;
+    const char* _nodeArgs;
+    ArgBuilder _arg;
 };
 
+BuilderStack::Ptr makeBAR(BuilderStack& builders)
+{
+    return builders.make<AccentBuilder>("<mo>\xC2\xAF</mo>");
+}
 
-std::unique_ptr<Builder> makeFRAC()
+BuilderStack::Ptr makeDOT(BuilderStack& builders)
 {
-    class FRACBuilder final : public Builder
-    {
-        void add(TokenSequence& sequence) override
-        {
-            _arg1.add(sequence);
-            _arg2.add(sequence);
-        }
+    return builders.make<AccentBuilder>("<mo>\x2E</mo>");
+}
 
-        std::string take() override
-        {
-            std::string out(R"(<mfrac>)");
-            out.append(_arg1.take());
-            out.append(_arg2.take());
-            out.append(R"(</mfrac>)");
-            return out;
-        }
+BuilderStack::Ptr makeDDOT(BuilderStack& builders)
+{
+    return builders.make<AccentBuilder>("<mo>\xC2\xA8</mo>");
+}
 
-    private:
-        ArgBuilder _arg1;
-        ArgBuilder _arg2;
-    };
-    return std::make_unique<FRACBuilder>();
+BuilderStack::Ptr makeTILDE(BuilderStack& builders)
+{
+    return builders.make<AccentBuilder>("<mo stretchy=\"false\">\x7E</mo>");
 }
 
-std::unique_ptr<Builder> makeGENFRAC()
+BuilderStack::Ptr makeWIDETILDE(BuilderStack& builders)
 {
-    class GENFRACBuilder final : public Builder
-    {
-        void add(TokenSequence& sequence) override
-        {
-            _left.add(sequence);
-            _right.add(sequence);
-            _barThickness.add(sequence);
-            _style.add(sequence);
-            _numerator.add(sequence);
-            _denominator.add(sequence);
-        }
+    return builders.make<AccentBuilder>("<mo>\x7E</mo>");
+}
 
-        std::string take() override
-        {
-            std::string out;
-            out.append("<mfenced open='").append(_left.takeContent()).append("' close='").append(_right.takeContent()).append("'><mrow>")
-               .append("<mfrac linethickness='").append(_barThickness.takeContent()).append("'>")
-               .append(_numerator.take())
-               .append(_denominator.take())
-               .append("</mfrac></mrow></mfenced>");
-            return out;
-        }
+BuilderStack::Ptr makeOVERLINE(BuilderStack& builders)
+{
+    return builders.make<AccentBuilder>("<mo>\xC2\xAF</mo>");
+}
 
-    private:
+BuilderStack::Ptr makeVEC(BuilderStack& builders)
+{
+    return builders.make<AccentBuilder>("<mo>\xE2\x86\x92</mo>");
+}
 
-    private:
-        TextArgBuilder _left;
-        TextArgBuilder _right;
-        TextArgBuilder _barThickness;
-        TextArgBuilder _style;
-        ArgBuilder _numerator;
-        ArgBuilder _denominator;
-    };
-    return std::make_unique<GENFRACBuilder>();
+BuilderStack::Ptr makeHAT(BuilderStack& builders)
+{
+    return builders.make<AccentBuilder>("<mo>\x5E</mo>");
 }
 
-std::unique_ptr<Builder> makeBINOM()
+BuilderStack::Ptr makeWIDEHAT(BuilderStack& builders)
 {
-    class BINOMBuilder final : public Builder
+    return builders.make<AccentBuilder>("<mo>\x5E</mo>", " accent=\"true\"");
+}
+
+BuilderStack::Ptr makeUNDERLINE(BuilderStack& builders)
+{
+    class UNDERLINEBuilder final : public Builder
     {
-        void add(TokenSequence& sequence) override
+    public:
+
+        bool add(TokenSequence& sequence) override
         {
-            _numerator.add(sequence);
-            _denominator.add(sequence);
+            return _arg.add(sequence);
         }
 
-        std::string take() override
+        NodeId take(MathMLTree& tree) override
         {
-            std::string out;
-            out.append("<mfenced open='(' close=')'><mrow><mfrac linethickness='0pt'>")
-               .append(_numerator.take())
-               .append(_denominator.take())
-               .append("</mfrac></mrow></mfenced>");
-            return out;
+            return tree.element("munder", "", {_arg.take(tree), tree.markup("<mo>\x5F</mo>")});
         }
+
     private:
-        ArgBuilder _numerator;
-        ArgBuilder _denominator;
+        ArgBuilder _arg;
     };
-    return std::make_unique<BINOMBuilder>();
+
+    return builders.make<UNDERLINEBuilder>();
 }
 
-std::unique_ptr<Builder> makeSQRT()
+BuilderStack::Ptr makeHSPACE(BuilderStack& builders)
 {
-    class SQRTBuilder final : public Builder
+    class HSPACEBuilder final : public Builder
     {
-        void add(TokenSequence& sequence) override
+        bool add(TokenSequence& sequence) override
         {
-            _arg1.add(sequence);
-            _arg2.add(sequence);
+            return _arg.add(sequence);
         }
 
-        std::string take() override
+        NodeId take(MathMLTree& tree) override
         {
-            std::string out(R"(<mroot>)");
-            out.append(_arg2.take());
-            out.append(_arg1.take());
-            out.append(R"(</mroot>)");
-            return out;
+            return tree.markup("<mo>\xE2\x80\x89</mo>");
         }
 
     private:
-        OptArgBuilder _arg1;
-        ArgBuilder _arg2;
+        ArgBuilder _arg;
     };
-    return std::make_unique<SQRTBuilder>();
+    return builders.make<HSPACEBuilder>();
 }
 
-class SubSupBuilder final : public Builder
+class SingleNodeBuilder final : public Builder
 {
 public:
-    SubSupBuilder(std::string&& cmdNode, SubSupType type)
-        : _cmdNode(std::move(cmdNode))
-        , _type(type)
+    SingleNodeBuilder(const char* node)
+        : _node(node)
     {
     }
 
-    void add(TokenSequence& sequence) override
+    bool add(TokenSequence&) override
     {
-        for (bool finalize = false; !finalize && !sequence.empty();)
-        {
-            const auto& token = sequence.top();
-            switch (token.type)
-            {
-                case SIGN:
-                {
-                    switch (token.content[0])
-                    {
-                        case '^':
-                        {
-                            if (_hasSup)
-                            {
-                                finalize = true;
-                                break;
-                            }
-                            _hasSup = true;
-                            _sup.add(sequence.next());
-                            break;
-                        }
-                        case '_':
-                        {
-                            if (_hasSub)
-                            {
-                                finalize = true;
-                                break;
-                            }
-                            _hasSub = true;
-                            _sub.add(sequence.next());
-                            break;
-                        }
-
-                        default:
-                            finalize = true;
-                            break;
-                    }
-                    break;
-                }
-
-                case COMMAND:
-                {
-                    const auto& content = token.content;
-
-                    if (content == "limits")
-                    {
-                        _type = SubSupType::Limits;
-                        sequence.next();
-                        break;
-                    }
-
-                    if (content == "nolimits")
-                    {
-                        _type = SubSupType::NoLimits;
-                        sequence.next();
-                        break;
-                    }
-                }
-
-                default:
-                    finalize = true;
-                    break;
-            }
-        }
+        return true;
     }
 
-    std::string take() override
+    NodeId take(MathMLTree& tree) override
     {
-        if(_hasSub && _hasSup)
-        {
-            std::string out;
-            out.append(_type == SubSupType::Limits ? "<munderover>" : "<msubsup>")
-                    .append("<mrow>")
-                    .append(_cmdNode)
-                    .append("</mrow>")
-                    .append(_sub.take())
-                    .append(_sup.take())
-                    .append(_type == SubSupType::Limits ? "</munderover>" : "</msubsup>");
-            return out;
-        }
-        if(_hasSub)
-        {
-            std::string out;
-            out.append(_type == SubSupType::Limits ? "<munder>" : "<msub>")
-                    .append("<mrow>")
-                    .append(_cmdNode)
-                    .append("</mrow>")
-                    .append(_sub.take())
-                    .append(_type == SubSupType::Limits ? "</munder>" : "</msub>");
-            return out;
-        }
-        if(_hasSup)
-        {
-            std::string out;
-            out.append(_type == SubSupType::Limits ? "<mover>" : "<msup>")
-                    .append("<mrow>")
-                    .append(_cmdNode)
-                    .append("</mrow>")
-                    .append(_sup.take())
-                    .append(_type == SubSupType::Limits ? "</mover>" : "</msup>");
-            return out;
-        }
-        return _cmdNode;
+        return tree.markup(_node);
     }
 
 private:
-    SubSupType _type;
-    std::string _cmdNode;
-    ArgBuilder _sub;
-    bool _hasSub = false;
-    ArgBuilder _sup;
-    bool _hasSup = false;
+    const char* _node;
 };
 
-std::unique_ptr<Builder> makeSubSup(std::string&& firstArg, SubSupType type)
+BuilderStack::Ptr makeQUAD(BuilderStack& builders)
 {
-    return std::make_unique<SubSupBuilder>(std::move(firstArg), type);
+    return builders.make<SingleNodeBuilder>("<mi>\xE2\x80\x81</mi>");
 }
 
-class TableBuilder final : public Builder
+BuilderStack::Ptr makeQQUAD(BuilderStack& builders)
 {
-public:
-    void add(TokenSequence& sequence) override
-    {
-        const auto& token = sequence.top();
-        switch (token.type)
-        {
-            case SIGN:
-            {
-                switch (token.content[0])
-                {
-                    case '&':
-                    {
-                        _out.append(_tdBuilder.take());
-                        _tdBuilder = RowBuilder("mtd");
-                        sequence.next();
-                        break;
-                    }
+    return builders.make<SingleNodeBuilder>(R"(<mspace width="2em"/>)");
+}
 
-                    case '\\':
-                    {
-                        _out.insert(_rowBeginPos, "<mtr>");
-                        _out.append(_tdBuilder.take()).append("</mtr>");
-                        _rowBeginPos = _out.size();
-                        _tdBuilder = RowBuilder("mtd");
-                        sequence.next();
-                        break;
-                    }
-                    default:
-                        _tdBuilder.add(sequence);
-                        break;
-                }
-                break;
-            }
+BuilderStack::Ptr makeTHICKSPACE(BuilderStack& builders)
+{
+    return builders.make<SingleNodeBuilder>(R"(<mspace width="0.27778em"/>)");
+}
 
-            default:
-                _tdBuilder.add(sequence);
-                break;
-        }
-    }
+BuilderStack::Ptr makeMEDSPACE(BuilderStack& builders)
+{
+    return builders.make<SingleNodeBuilder>("<mi>\xE2\x81\x9F</mi>");
+}
+
+BuilderStack::Ptr makeTHINSPACE(BuilderStack& builders)
+{
+    return builders.make<SingleNodeBuilder>("<mi>\xE2\x80\x89</mi>");
+}
+
+BuilderStack::Ptr makeNEGSPACE(BuilderStack& builders)
+{
+    return builders.make<SingleNodeBuilder>(R"(<mspace width="-0.16667em"/>)");
+}
 
-    std::string take() override
+BuilderStack::Ptr makeNEGMEDSPACE(BuilderStack& builders)
+{
+    return builders.make<SingleNodeBuilder>(R"(<mspace width="-0.22222em"/>)");
+}
+
+BuilderStack::Ptr makeNEGTHICKSPACE(BuilderStack& builders)
+{
+    return builders.make<SingleNodeBuilder>(R"(<mspace width="-0.27778em"/>)");
+}
+
+BuilderStack::Ptr makeSUBSTACK(BuilderStack& builders)
+{
+    class SUBSTACKBuilder final : public Builder
     {
-        auto result = _tdBuilder.take();
-        if (result.size() > 11)
+        bool add(TokenSequence& sequence) override
         {
-            _out.insert(_rowBeginPos, "<mtr>");
-            _out.append(std::move(result)).append("</mtr>");
+            return _arg.add(sequence);
         }
-        _rowBeginPos = MAX_INDEX;
-        _out.append("</mtable>");
 
-        return std::move(_out);
-    }
+        NodeId take(MathMLTree& tree) override
+        {
+            return _arg.take(tree);
+        }
+
+    private:
+        ArgTableBuilder _arg;
+    };
+    return builders.make<SUBSTACKBuilder>();
+}
 
-private:
-    std::string _out = std::string("<mtable>");
-    std::size_t _rowBeginPos = _out.size();
-    RowBuilder _tdBuilder = RowBuilder("mtd");
-};
+BuilderStack::Ptr makeMBOX(BuilderStack& builders)
+{
+    return builders.make<TextArgBuilder>(true);
+}
 
-class ArgTableBuilder final : public Builder
+BuilderStack::Ptr makeDISPLAYSTYLE(BuilderStack& builders)
 {
-public:
-    void add(TokenSequence& sequence) override
+    class DISPLAYSTYLEBuilder final : public Builder
     {
-        if (sequence.top().content[0] != '{')
+        bool add(TokenSequence& sequence) override
         {
-            _tableBuilder.add(sequence);
-            return;
+            return _arg.add(sequence);
         }
 
-        auto groupIndex = 0;
-        for(bool finalize = false; !finalize && !sequence.empty();)
+        NodeId take(MathMLTree& tree) override
         {
-            const auto& token = sequence.top();
-            switch (token.type)
-            {
-                case START_GROUP:
-                    ++groupIndex;
-                    break;
-
-                case END_GROUP:
-                    --groupIndex;
-                    if (groupIndex == 0 && token.content[0] == '}') finalize = true;
-                    break;
-
-                default:
-                    break;
-            }
-            _tableBuilder.add(sequence);
+            return tree.element("mstyle", R"( displaystyle="true")", {_arg.take(tree)});
         }
-    }
-
-    std::string take() override
-    {
-        return _tableBuilder.take();
-    }
 
-private:
-    TableBuilder _tableBuilder;
-};
+    private:
+        ArgBuilder _arg;
+    };
+    return builders.make<DISPLAYSTYLEBuilder>();
+}
 
-std::unique_ptr<Builder> makeEnvBuilder(const std::string& name)
+BuilderStack::Ptr makeTEXTSTYLE(BuilderStack& builders)
 {
-    class EnvBuilder final : public Builder
+    class TEXTSTYLEBuilder final : public Builder
     {
-    public:
-        EnvBuilder(const std::string& name)
-            : _name(name)
+        bool add(TokenSequence& sequence) override
         {
+            return _arg.add(sequence);
         }
 
-        void add(TokenSequence& sequence) override
+        NodeId take(MathMLTree& tree) override
         {
-            _arg.add(sequence);
+            return tree.element("mstyle", R"( displaystyle="false")", {_arg.take(tree)});
+        }
 
-            for(; !sequence.empty();)
-            {
-                const auto& token = sequence.top();
-                switch (token.type)
-                {
-                    case END_ENV:
-                    {
-                        sequence.next();
-                        return;
-                    }
+    private:
+        ArgBuilder _arg;
+    };
+    return builders.make<TEXTSTYLEBuilder>();
+}
 
-                    default:
-                        _tableBuilder.add(sequence);
-                        break;
-                }
-            }
+BuilderStack::Ptr makePHANTOM(BuilderStack& builders)
+{
+    class PHANTOMBuilder final : public Builder
+    {
+        bool add(TokenSequence& sequence) override
+        {
+            return _arg.add(sequence);
         }
 
-        std::string take() override
+        NodeId take(MathMLTree& tree) override
         {
-            auto out = _tableBuilder.take();
+            return tree.element("mphantom", "", {_arg.take(tree)});
+        }
 
-            if (_name == "pmatrix")
-            {
-                out.insert(0, "<mfenced open='(' close=')'>");
-                out.append("</mfenced>");
+    private:
+        ArgBuilder _arg;
+    };
+    return builders.make<PHANTOMBuilder>();
+}
 
-            }
-            else if (_name == "bmatrix")
-            {
-                out.insert(0, "<mfenced open='[' close=']'>");
-                out.append("</mfenced>");
-            }
-            else if (_name == "Bmatrix")
-            {
-                out.insert(0, "<mfenced open='{' close='}'>");
-                out.append("</mfenced>");
-            }
-            else if (_name == "vmatrix")
-            {
-                out.insert(0, "<mfenced open='|' close='|'>");
-                out.append("</mfenced>");
-            }
-            else if (_name == "Vmatrix")
-            {
-                out.insert(0, "<mfenced open='\xE2\x80\x96' close='\xE2\x80\x96'>");
-                out.append("</mfenced>");
-            }
-            return out;
+BuilderStack::Ptr makeTEXTCOLOR(BuilderStack& builders)
+{
+    class TEXTCOLORBuilder final : public Builder
+    {
+        bool add(TokenSequence& sequence) override
+        {
+            return _params.add(sequence) && _color.add(sequence) && _arg.add(sequence);
         }
 
-    private:
-        struct Arg final
+        NodeId take(MathMLTree& tree) override
         {
-            void add(TokenSequence& sequence)
+            std::string_view attributes;
+
+            auto colorStr = _color.takeContent();
+            if (!colorStr.empty() && colorStr[0] == '#')
             {
-                if (sequence.top().content[0] != '{')
+                tree.startText();
+                for (const unsigned char c : colorStr)
                 {
-                    return;
+                    const auto upper = static_cast<char>(std::toupper(c));
+                    tree.appendText(std::string_view(&upper, 1));
                 }
+                colorStr = tree.finishText();
 
-                std::size_t groupIndex = 0;
-                for(bool finalize = false; !finalize && !sequence.empty(); sequence.next())
-                {
-                    const auto& token = sequence.top();
-                    switch (token.type)
-                    {
-                        case START_GROUP:
-                            ++groupIndex;
-                            break;
-
-                        case END_GROUP:
-                            --groupIndex;
-                            if (groupIndex == 0 && token.content[0] == '}') finalize = true;
-                            break;
+                if ("#000000" == colorStr) colorStr = "black";
+                else if ("#0000FF" == colorStr) colorStr = "blue";
+                else if ("#008000" == colorStr) colorStr = "green";
+                else if ("#00FFFF" == colorStr) colorStr = "cyan";
+                else if ("#FF0000" == colorStr) colorStr = "red";
+                else if ("#FF00FF" == colorStr) colorStr = "magenta";
+                else if ("#FFFF00" == colorStr) colorStr = "yellow";
+                else if ("#FFFFFF" == colorStr) colorStr = "white";
 
-                        default:
-                            break;
-                    }
-                    data += token.content;
-                }
+                attributes = tree.store({" color='", colorStr, "'"});
             }
 
-        public:
-            std::string data;
-        };
+            return tree.element("mstyle", attributes, {_arg.take(tree)});
+        }
 
     private:
-        std::string _name;
-        Arg _arg;
-        TableBuilder _tableBuilder;
+        OptArgBuilder _params;
+        TextArgBuilder _color;
+        ArgBuilder _arg;
     };
-
-    return std::make_unique<EnvBuilder>(name);
+    return builders.make<TEXTCOLORBuilder>();
 }
 
-class SumLikeBuilder final : public Builder
-{
-public:
-    SumLikeBuilder(std::string&& cmdNode, const SubSupType type)
-        : _operator(std::move(cmdNode), type)
-    {
-    }
+constexpr Command COMMANDS[] =
+{
+    // Written as <mi>
+    // Greek letters
+    {"alpha", CommandKind::Char, "\xCE\xB1"},
+    {"beta", CommandKind::Char, "\xCE\xB2"},
+    {"Gamma", CommandKind::Char, "\xCE\x93"},
+    {"gamma", CommandKind::Char, "\xCE\xB3"},
+    {"Delta", CommandKind::Char, "\xCE\x94"},
+    {"delta", CommandKind::Char, "\xCE\xB4"},
+    {"epsilon", CommandKind::Char, "\xCE\xB5"},
+    {"zeta", CommandKind::Char, "\xCE\xB6"},
+    {"eta", CommandKind::Char, "\xCE\xB7"},
+    {"Theta", CommandKind::Char, "\xCE\x98"},
+    {"theta", CommandKind::Char, "\xCE\xB8"},
+    {"iota", CommandKind::Char, "\xCE\xB9"},
+    {"kappa", CommandKind::Char, "\xCE\xBA"},
+    {"Lambda", CommandKind::Char, "\xCE\x9B"},
+    {"lambda", CommandKind::Char, "\xCE\xBB"},
+    {"mu", CommandKind::Char, "\xCE\xBC"},
+    {"nu", CommandKind::Char, "\xCE\xBD"},
+    {"Xi", CommandKind::Char, "\xCE\x9E"},
+    {"xi", CommandKind::Char, "\xCE\xBE"},
+    {"Pi", CommandKind::Char, "\xCE\xA0"},
+    {"pi", CommandKind::Char, "\xCF\x80"},
+    {"rho", CommandKind::Char, "\xCF\x81"},
+    {"Sigma", CommandKind::Char, "\xCE\xA3"},
+    {"sigma", CommandKind::Char, "\xCF\x83"},
+    {"tau", CommandKind::Char, "\xCF\x84"},
+    {"Upsilon", CommandKind::Char, "\xCE\xA5"},
+    {"upsilon", CommandKind::Char, "\xCF\x85"},
+    {"Phi", CommandKind::Char, "\xCE\xA6"},
+    {"phi", CommandKind::Char, "\xCF\x86"},
+    {"chi", CommandKind::Char, "\xCF\x87"},
+    {"Psi", CommandKind::Char, "\xCE\xA8"},
+    {"psi", CommandKind::Char, "\xCF\x88"},
+    {"Omega", CommandKind::Char, "\xCE\xA9"},
+    {"omega", CommandKind::Char, "\xCF\x89"},
+    {"varsigma", CommandKind::Char, "\xCF\x82"},
+    {"vartheta", CommandKind::Char, "\xCF\x91"},
+    {"varphi", CommandKind::Char, "\xCF\x95"},
+    {"varpi", CommandKind::Char, "\xCF\x96"},
+    {"varkappa", CommandKind::Char, "\xCF\xB0"},
+    {"varrho", CommandKind::Char, "\xCF\xB1"},
+    {"varepsilon", CommandKind::Char, "\xCF\xB5"},
+
+    {"dots", CommandKind::Char, "\xE2\x80\xA6"},
+    {"ldots", CommandKind::Char, "\xE2\x80\xA6"},
+    {"dotso", CommandKind::Char, "\xE2\x80\xA6"},
+    {"dotsc", CommandKind::Char, "\xE2\x80\xA6"},
+    {"vdots", CommandKind::Char, "\xE2\x8B\xAE"},
+    {"cdots", CommandKind::Char, "\xE2\x8B\xAF"},
+    {"dotsb", CommandKind::Char, "\xE2\x8B\xAF"},
+    {"ddots", CommandKind::Char, "\xE2\x8B\xB1"},
+    {"udots", CommandKind::Char, "\xE2\x8B\xB0"},
+    {"hbar", CommandKind::Char, "\xE2\x84\x8F"},
+
+    // Written as <mo>
+    {"Del", CommandKind::Symbol, "\xE2\x88\x87"},
+    {"Im", CommandKind::Symbol, "\xE2\x84\x91"},
+    {"Leftarrow", CommandKind::Symbol, "\xE2\x87\x90"},
+    {"Re", CommandKind::Symbol, "\xE2\x84\x9C"},
+    {"Rightarrow", CommandKind::Symbol, "\xE2\x87\x92"},
+    {"aleph", CommandKind::Symbol, "\xE2\x84\xB5"},
+    {"amalg", CommandKind::Symbol, "\xE2\xA8\xBF"},
+    {"angle", CommandKind::Symbol, "\xE2\x88\xA0"},
+    {"approx", CommandKind::Symbol, "\xE2\x89\x88"},
+    {"ast", CommandKind::Symbol, "\xE2\x88\x97"},
+    {"bigcap", CommandKind::Symbol, "\xE2\x8B\x82"},
+    {"bigcup", CommandKind::Symbol, "\xE2\x8B\x83"},
+    {"bigvee", CommandKind::Symbol, "\xE2\x8B\x81"},
+    {"bigwedge", CommandKind::Symbol, "\xE2\x8B\x80"},
+    {"bullet", CommandKind::Symbol, "\xE2\x80\xA2"},
+    {"cap", CommandKind::Symbol, "\xE2\x88\xA9"},
+    {"cdot", CommandKind::Symbol, "\xE2\x8B\x85"},
+    {"circ", CommandKind::Symbol, "\xE2\x88\x98"},
+    {"complement", CommandKind::Symbol, "\xE2\x88\x81"},
+    {"cong", CommandKind::Symbol, "\xE2\x89\x85"},
+    {"conint", CommandKind::Symbol, "\xE2\x88\xAE"},
+    {"contourintegral", CommandKind::Symbol, "\xE2\x88\xAE"},
+    {"coprod", CommandKind::Symbol, "\xE2\x88\x90"},
+    {"coproduct", CommandKind::Symbol, "\xE2\x88\x90"},
+    {"cup", CommandKind::Symbol, "\xE2\x88\xAA"},
+    {"div", CommandKind::Symbol, "\xC3\xB7"},
+    {"doubleintegral", CommandKind::Symbol, "\xE2\x88\xAC"},
+    {"downarrow", CommandKind::Symbol, "\xE2\x86\x93"},
+    {"equiv", CommandKind::Symbol, "\xE2\x89\xA1"},
+    {"exists", CommandKind::Symbol, "\xE2\x88\x83"},
+    {"forall", CommandKind::Symbol, "\xE2\x88\x80"},
+    {"ge", CommandKind::Symbol, "\xE2\x89\xA5"},
+    {"geq", CommandKind::Symbol, "\xE2\x89\xA5"},
+    {"geqslant", CommandKind::Symbol, "\xE2\xA9\xBE"},
+    {"gg", CommandKind::Symbol, "\xE2\x89\xAB"},
+    {"gt", CommandKind::Symbol, "&gt;"},
+    {"hslash", CommandKind::Symbol, "\xE2\x84\x8F"},
+    {"iff", CommandKind::Symbol, "\xE2\x9F\xBA"},
+    {"in", CommandKind::Symbol, "\xE2\x88\x8A"},
+    {"infinity", CommandKind::Symbol, "\xE2\x88\x9E"},
+    {"infty", CommandKind::Symbol, "\xE2\x88\x9E"},
+    {"le", CommandKind::Symbol, "\xE2\x89\xA4"},
+    {"leftarrow", CommandKind::Symbol, "\xE2\x86\x90"},
+    {"leq", CommandKind::Symbol, "\xE2\x89\xA4"},
+    {"leqslant", CommandKind::Symbol, "\xE2\xA9\xBD"},
+    {"ll", CommandKind::Symbol, "\xE2\x89\xAA"},
+    {"longleftarrow", CommandKind::Symbol, "\xE2\x9f\xB5"},
+    {"lt", CommandKind::Symbol, "&lt;"},
+    {"measuredangle", CommandKind::Symbol, "\xE2\x88\xA1"},
+    {"mid", CommandKind::Symbol, "\xE2\x88\xA3"},
+    {"mp", CommandKind::Symbol, "\xE2\x88\x93"},
+    {"nabla", CommandKind::Symbol, "\xE2\x88\x87"},
+    {"ne", CommandKind::Symbol, "\xE2\x89\xA0"},
+    {"neg", CommandKind::Symbol, "\xC2\xAC"},
+    {"neq", CommandKind::Symbol, "\xE2\x89\xA0"},
+    {"nexists", CommandKind::Symbol, "\xE2\x88\x84"},
+    {"ngeq", CommandKind::Symbol, "\xE2\x89\xB1"},
+    {"ngtr", CommandKind::Symbol, "\xE2\x89\xAF"},
+    {"ni", CommandKind::Symbol, "\xE2\x88\x8B"},
+    {"nleq", CommandKind::Symbol, "\xE2\x89\xB0"},
+    {"nless", CommandKind::Symbol, "\xE2\x89\xAE"},
+    {"nmid", CommandKind::Symbol, "\xE2\x88\xA4"},
+    {"not", CommandKind::Symbol, "\x2F"},
+    {"notin", CommandKind::Symbol, "\xE2\x88\x89"},
+    {"nparallel", CommandKind::Symbol, "\xE2\x88\xA6"},
+    {"nprec", CommandKind::Symbol, "\xE2\x8A\x80"},
+    {"nsubseteq", CommandKind::Symbol, "\xE2\x8A\x88"},
+    {"nsucc", CommandKind::Symbol, "\xE2\x8A\x81"},
+    {"nsupseteq", CommandKind::Symbol, "\xE2\x8A\x89"},
+    {"odot", CommandKind::Symbol, "\xE2\x8A\x99"},
+    {"ominus", CommandKind::Symbol, "\xE2\x8A\x96"},
+    {"oplus", CommandKind::Symbol, "\xE2\x8A\x95"},
+    {"oslash", CommandKind::Symbol, "\xE2\x8A\x98"},
+    {"otimes", CommandKind::Symbol, "\xE2\x8A\x97"},
+    {"parallel", CommandKind::Symbol, "\xE2\x88\xA5"},
+    {"partial", CommandKind::Symbol, "\xE2\x88\x82"},
+    {"perp", CommandKind::Symbol, "\xE2\x8A\xA5"},
+    {"pm", CommandKind::Symbol, "\xC2\xB1"},
+    {"prec", CommandKind::Symbol, "\xE2\x89\xBA"},
+    {"preccurlyeq", CommandKind::Symbol, "\xE2\x89\xBC"},
+    {"precsim", CommandKind::Symbol, "\xE2\x89\xBE"},
+    {"prime", CommandKind::Symbol, "\xE2\x80\xB2"},
+    {"propto", CommandKind::Symbol, "\xE2\x88\x9D"},
+    {"quadrupleintegral", CommandKind::Symbol, "\xE2\xA8\x8C"},
+    {"rightarrow", CommandKind::Symbol, "\xE2\x86\x92"},
+    {"setminus", CommandKind::Symbol, "\xE2\x88\x96"},
+    {"sim", CommandKind::Symbol, "\xE2\x88\xBC"},
+    {"simeq", CommandKind::Symbol, "\xE2\x89\x83"},
+    {"subset", CommandKind::Symbol, "\xE2\x8A\x82"},
+    {"subseteq", CommandKind::Symbol, "\xE2\x8A\x86"},
+    {"succ", CommandKind::Symbol, "\xE2\x89\xBB"},
+    {"succcurlyeq", CommandKind::Symbol, "\xE2\x89\xBD"},
+    {"succsim", CommandKind::Symbol, "\xE2\x89\xBF"},
+    {"supset", CommandKind::Symbol, "\xE2\x8A\x83"},
+    {"supseteq", CommandKind::Symbol, "\xE2\x8A\x87"},
+    {"times", CommandKind::Symbol, "\xC3\x97"},
+    {"to", CommandKind::Symbol, "\xE2\x86\x92"},
+    {"triangle", CommandKind::Symbol, "\xE2\x96\xB3"},
+    {"triangledown", CommandKind::Symbol, "\xE2\x96\xBF"},
+    {"tripleintegral", CommandKind::Symbol, "\xE2\x88\xAD"},
+    {"uparrow", CommandKind::Symbol, "\xE2\x86\x91"},
+    {"varnothing", CommandKind::Symbol, "\xE2\x88\x85"},
+    {"vee", CommandKind::Symbol, "\xE2\x88\xA8"},
+    {"wedge", CommandKind::Symbol, "\xE2\x88\xA7"},
+    {"wp", CommandKind::Symbol, "\xE2\x84\x98"},
+
+    // Made by a builder
+    {" ", CommandKind::Builder, {}, makeTHICKSPACE},
+    {"!", CommandKind::Builder, {}, makeNEGSPACE},
+    {",", CommandKind::Builder, {}, makeTHINSPACE},
+    {":", CommandKind::Builder, {}, makeMEDSPACE},
+    {";", CommandKind::Builder, {}, makeTHICKSPACE},
+    {">", CommandKind::Builder, {}, makeMEDSPACE},
+    {"bar", CommandKind::Builder, {}, makeBAR},
+    {"binom", CommandKind::Builder, {}, makeBINOM},
+    {"cfrac", CommandKind::Builder, {}, makeFRAC},
+    {"closure", CommandKind::Builder, {}, makeOVERLINE},
+    {"ddot", CommandKind::Builder, {}, makeDDOT},
+    {"dfrac", CommandKind::Builder, {}, makeFRAC},
+    {"displaystyle", CommandKind::Builder, {}, makeDISPLAYSTYLE},
+    {"dot", CommandKind::Builder, {}, makeDOT},
+    {"frac", CommandKind::Builder, {}, makeFRAC},
+    {"genfrac", CommandKind::Builder, {}, makeGENFRAC},
+    {"hat", CommandKind::Builder, {}, makeHAT},
+    {"hspace", CommandKind::Builder, {}, makeHSPACE},
+    {"iiiint", CommandKind::Builder, {}, makeIIIINT},
+    {"iiint", CommandKind::Builder, {}, makeIIINT},
+    {"iint", CommandKind::Builder, {}, makeIINT},
+    {"int", CommandKind::Builder, {}, makeINT},
+    {"integral", CommandKind::Builder, {}, makeINT},
+    {"lim", CommandKind::Builder, {}, makeLIM},
+    {"mathbb", CommandKind::Builder, {}, makeMATHBB},
+    {"mathrm", CommandKind::Builder, {}, makeMATHRM},
+    {"mbox", CommandKind::Builder, {}, makeMBOX},
+    {"medspace", CommandKind::Builder, {}, makeMEDSPACE},
+    {"negmedspace", CommandKind::Builder, {}, makeNEGMEDSPACE},
+    {"negspace", CommandKind::Builder, {}, makeNEGSPACE},
+    {"negthickspace", CommandKind::Builder, {}, makeNEGTHICKSPACE},
+    {"negthinspace", CommandKind::Builder, {}, makeNEGSPACE},
+    {"oiiint", CommandKind::Builder, {}, makeOIIINT},
+    {"oiint", CommandKind::Builder, {}, makeOIINT},
+    {"oint", CommandKind::Builder, {}, makeOINT},
+    {"overline", CommandKind::Builder, {}, makeOVERLINE},
+    {"overrightarrow", CommandKind::Builder, {}, makeVEC},
+    {"overset", CommandKind::Builder, {}, makeOVERSET},
+    {"phantom", CommandKind::Builder, {}, makePHANTOM},
+    {"prod", CommandKind::Builder, {}, makePROD},
+    {"product", CommandKind::Builder, {}, makePROD},
+    {"qquad", CommandKind::Builder, {}, makeQQUAD},
+    {"quad", CommandKind::Builder, {}, makeQUAD},
+    {"rm", CommandKind::Builder, {}, makeMATHRM},
+    {"smallint", CommandKind::Builder, {}, makeSMALLINT},
+    {"sqrt", CommandKind::Builder, {}, makeSQRT},
+    {"stackrel", CommandKind::Builder, {}, makeOVERSET},
+    {"substack", CommandKind::Builder, {}, makeSUBSTACK},
+    {"sum", CommandKind::Builder, {}, makeSUM},
+    {"tbinom", CommandKind::Builder, {}, makeBINOM},
+    {"textcolor", CommandKind::Builder, {}, makeTEXTCOLOR},
+    {"textstyle", CommandKind::Builder, {}, makeTEXTSTYLE},
+    {"tfrac", CommandKind::Builder, {}, makeFRAC},
+    {"thickspace", CommandKind::Builder, {}, makeTHICKSPACE},
+    {"thinspace", CommandKind::Builder, {}, makeTHINSPACE},
+    {"tilde", CommandKind::Builder, {}, makeTILDE},
+    {"underline", CommandKind::Builder, {}, makeUNDERLINE},
+    {"underset", CommandKind::Builder, {}, makeUNDERSET},
+    {"vec", CommandKind::Builder, {}, makeVEC},
+    {"widebar", CommandKind::Builder, {}, makeOVERLINE},
+    {"widehat", CommandKind::Builder, {}, makeWIDEHAT},
+    {"widetilde", CommandKind::Builder, {}, makeWIDETILDE},
+    {"widevec", CommandKind::Builder, {}, makeVEC},
+    {"~", CommandKind::Builder, {}, makeTILDE},
+
+    // Read by the row or the scripts they are in
+    {"left", CommandKind::Left, {}},
+    {"right", CommandKind::Right, {}},
+    {"limits", CommandKind::Limits, {}},
+    {"nolimits", CommandKind::NoLimits, {}},
+};
 
-    void add(TokenSequence& sequence) override
+// The lexer gives the index in COMMAND_NAMES and ENVIRONMENT_NAMES as the
+// id, which is used as index in these tables
+template <typename Entry, std::size_t N, std::size_t M>
+constexpr bool sameNames(const Entry (&entries)[N], const std::string_view (&names)[M])
+{
+    if (N != M)
     {
-        _operator.add(sequence);
-        _arg.add(sequence);
+        return false;
     }
-
-    std::string take() override
+    for (std::size_t i = 0; i < N; ++i)
     {
-        auto result = _operator.take();
-
-        if (!_arg.empty())
+        if (entries[i].name != names[i])
         {
-            result.append(_arg.take());
+            return false;
         }
-        return result;
     }
-
-private:
-    SubSupBuilder _operator;
-    ArgBuilder _arg;
-};
-
-std::unique_ptr<Builder> makeSUM()
-{
-    return std::make_unique<SumLikeBuilder>("<mo>\xE2\x88\x91</mo>", SubSupType::Limits);
+    return true;
 }
 
-std::unique_ptr<Builder> makePROD()
-{
-    return std::make_unique<SumLikeBuilder>("<mo>\xE2\x88\x8F</mo>", SubSupType::Limits);
-}
+static_assert(sameNames(COMMANDS, COMMAND_NAMES), "COMMANDS must list COMMAND_NAMES in the same order");
+static_assert(sameNames(ENVIRONMENTS, ENVIRONMENT_NAMES), "ENVIRONMENTS must list ENVIRONMENT_NAMES in the same order");
 
-std::unique_ptr<Builder> makeINT()
+const Command* commandOf(const TokenView& token)
 {
-    return std::make_unique<SubSupBuilder>("<mo>\xE2\x88\xAB</mo>", SubSupType::NoLimits);
+    return token.id < std::size(COMMANDS) ? &COMMANDS[token.id] : nullptr;
 }
 
-std::unique_ptr<Builder> makeIINT()
+// Element of a formula that is a single identifier, number or symbol
+enum AtomElement
 {
-    return std::make_unique<SubSupBuilder>("<mo>\xE2\x88\xAC</mo>", SubSupType::NoLimits);
-}
+    MI,
+    MN,
+    MO,
+    ATOM_ELEMENTS,
+};
 
-std::unique_ptr<Builder> makeIIINT()
-{
-    return std::make_unique<SubSupBuilder>("<mo>\xE2\x88\xAD</mo>", SubSupType::NoLimits);
-}
+constexpr std::string_view ATOM_NAMES[ATOM_ELEMENTS] = {"mi", "mn", "mo"};
 
-std::unique_ptr<Builder> makeIIIINT()
+// Such a formula, like "x", "42" or "\alpha". ATOM_ELEMENTS means the
+// formula is something else.
+struct Atom final
 {
-    return std::make_unique<SubSupBuilder>("<mo>\xE2\xA8\x8C</mo>", SubSupType::NoLimits);
-}
+    AtomElement element = ATOM_ELEMENTS;
+    std::string_view text;
+};
 
-std::unique_ptr<Builder> makeOINT()
+// Recognizes only what the lexer turns into one token with nothing around
+// it, so the document is the same as from the general path
+Atom findAtom(std::string_view tex)
 {
-    return std::make_unique<SubSupBuilder>("<mo>\xE2\x88\xAE</mo>", SubSupType::NoLimits);
-}
+    const auto isLetter = [](char c)
+    {
+        return (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z');
+    };
+    const auto isDigit = [](char c)
+    {
+        return c >= '0' && c <= '9';
+    };
 
-std::unique_ptr<Builder> makeOIINT()
-{
-    return std::make_unique<SubSupBuilder>("<mo>\xE2\x88\xAF</mo>", SubSupType::NoLimits);
-}
+    if (tex.size() > 1 && tex[0] == '\\')
+    {
+        const auto name = tex.substr(1);
+        if (!std::all_of(name.begin(), name.end(), isLetter) || name == "begin" || name == "end")
+        {
+            return {};
+        }
 
-std::unique_ptr<Builder> makeOIIINT()
-{
-    return std::make_unique<SubSupBuilder>("<mo>\xE2\x88\xB0</mo>", SubSupType::NoLimits);
-}
+        const auto id = commandId(name);
+        if (id == NO_NAME)
+        {
+            return {MI, name};
+        }
+        switch (COMMANDS[id].kind)
+        {
+            case CommandKind::Char:
+                return {MI, COMMANDS[id].text};
 
-std::unique_ptr<Builder> makeSMALLINT()
-{
-    return std::make_unique<SubSupBuilder>("<mo largeop=\"false\">\xE2\x88\xAB</mo>", SubSupType::NoLimits);
-}
+            case CommandKind::Symbol:
+                return {MO, COMMANDS[id].text};
 
-std::unique_ptr<Builder> makeLIM()
-{
-    return std::make_unique<SubSupBuilder>("<mi mathvariant=\"normal\">lim</mi>", SubSupType::Limits);
+            default:
+                return {};
+        }
+    }
+
+    if (tex.empty())
+    {
+        return {};
+    }
+    if (std::all_of(tex.begin(), tex.end(), isDigit))
+    {
+        return {MN, tex};
+    }
+    // "EOF" ends the input for the lexer
+    if (std::all_of(tex.begin(), tex.end(), isLetter) && tex.substr(0, 3) != "EOF")
+    {
+        return {MI, tex};
+    }
+    return {};
 }
 
-class ReverseTwoArgBuilder final : public Builder
+// Passes everything on and keeps a copy, as long as it stays small
+class CaptureSink final : public OutputSink
 {
 public:
-    ReverseTwoArgBuilder(std::string&& nodeName)
-        : _nodeName(std::move(nodeName))
+    CaptureSink(OutputSink& target, std::string& copy, std::size_t maxSize)
+        : _target(target)
+        , _copy(copy)
+        , _maxSize(maxSize)
+    {
+        _copy.clear();
+    }
+
+    void write(std::string_view text) override
+    {
+        _target.write(text);
+        if (_complete && _copy.size() + text.size() <= _maxSize)
+        {
+            _copy.append(text.data(), text.size());
+        }
+        else
+        {
+            _complete = false;
+        }
+    }
+
+    void flush() override
     {
+        _target.flush();
     }
 
-    void add(TokenSequence& sequence) override
+    void reserve(std::size_t size) override
     {
-        _arg1.add(sequence);
-        _arg2.add(sequence);
+        _target.reserve(size);
     }
 
-    std::string take() override
+    bool complete() const
     {
-        std::string out;
-        out.append("<").append(_nodeName).append(">")
-           .append(_arg2.take())
-           .append(_arg1.take())
-           .append("</").append(_nodeName).append(">");
-        return out;
+        return _complete;
     }
 
 private:
-    std::string _nodeName;
-    ArgBuilder _arg1;
-    ArgBuilder _arg2;
+    OutputSink& _target;
+    std::string& _copy;
+    const std::size_t _maxSize;
+    bool _complete = true;
 };
 
-std::unique_ptr<Builder> makeOVERSET()
+// Passes everything on until more than `maxBytes` were written
+class LimitSink final : public OutputSink
 {
-    return std::make_unique<ReverseTwoArgBuilder>("mover");
-}
+public:
+    LimitSink(OutputSink& target, std::size_t maxBytes)
+        : _target(target)
+        , _maxBytes(maxBytes)
+    {
+    }
 
-std::unique_ptr<Builder> makeUNDERSET()
-{
-    return std::make_unique<ReverseTwoArgBuilder>("munder");
-}
+    void write(std::string_view text) override
+    {
+        _written += text.size();
+        if (_written > _maxBytes)
+        {
+            throw LimitExceeded(LimitExceeded::Limit::OutputBytes, _maxBytes);
+        }
+        _target.write(text);
+    }
 
-class MATHStyleBuilder final : public Builder
+    void flush() override
+    {
+        _target.flush();
+    }
+
+    void reserve(std::size_t size) override
+    {
+        _target.reserve(std::min(size, _maxBytes - _written));
+    }
+
+private:
+    OutputSink& _target;
+    const std::size_t _maxBytes;
+    std::size_t _written = 0;
+};
+
+#ifdef TXL_STATS
+// Passes everything on and counts the bytes
+class TallySink final : public OutputSink
 {
 public:
-    MATHStyleBuilder(const TokenSequence::Style style)
-        : _style(style)
-    {}
+    TallySink(OutputSink& target, std::uint64_t& bytes)
+        : _target(target)
+        , _bytes(bytes)
+    {
+    }
+
+    void write(std::string_view text) override
+    {
+        _target.write(text);
+        _bytes += text.size();
+    }
 
-    void add(TokenSequence& sequence) override
+    void flush() override
     {
-        sequence.pushStyle(_style);
-        _arg.add(sequence);
-        sequence.popStyle();
+        _target.flush();
     }
 
-    std::string take() override
+    void reserve(std::size_t size) override
     {
-        return _arg.take();
+        _target.reserve(size);
     }
 
 private:
-    ArgBuilder _arg;
-    TokenSequence::Style _style;
+    OutputSink& _target;
+    std::uint64_t& _bytes;
+};
+#endif
+} // namespace
+
+// Everything a conversion needs besides its tokens, kept for the next formula
+struct MathMLGenerator::Workspace
+{
+    // Whole document of one <mi>, <mn> or <mo>, the text goes in between
+    struct AtomTemplate final
+    {
+        std::string begin;
+        std::string end;
+    };
+
+    Workspace()
+    {
+        setOptions(OutputOptions());
+    }
+
+    void setOptions(const OutputOptions& options)
+    {
+        begin = documentBegin(options);
+        end = documentEnd(options);
+        for (std::size_t i = 0; i < ATOM_ELEMENTS; ++i)
+        {
+            const std::string name(ATOM_NAMES[i]);
+            atoms[i].begin = begin + "<mrow><" + name + ">";
+            atoms[i].end = "</" + name + "></mrow>" + end;
+        }
+    }
+
+    MathMLTree tree;
+    BuilderStack builders;
+    TokenSequence sequence{tree, builders};
+
+    // Around the <mrow> of every formula
+    std::string begin;
+    std::string end;
+    AtomTemplate atoms[ATOM_ELEMENTS];
+
+    // The document while a limit may still stop it, see generate()
+    std::string staged;
 };
 
-std::unique_ptr<Builder> makeMATHBB()
+MathMLGenerator::MathMLGenerator(std::ostream& out)
+    : _streamSink(std::make_unique<StreamSink>(out))
+    , _sink(*_streamSink)
+    , _lexer(std::make_unique<Lexer>())
+    , _tokens(std::make_unique<TokenArray>())
+    , _workspace(std::make_unique<Workspace>())
 {
-    return std::make_unique<MATHStyleBuilder>(TokenSequence::Style::BlackboardBold);
 }
 
-std::unique_ptr<Builder> makeMATHRM()
+MathMLGenerator::MathMLGenerator(OutputSink& sink)
+    : _sink(sink)
+    , _lexer(std::make_unique<Lexer>())
+    , _tokens(std::make_unique<TokenArray>())
+    , _workspace(std::make_unique<Workspace>())
 {
-    return std::make_unique<MATHStyleBuilder>(TokenSequence::Style::Roman);
 }
 
-class AccentBuilder final : public Builder
+MathMLGenerator::~MathMLGenerator() = default;
+
+void MathMLGenerator::generate(std::string_view tex)
 {
-public:
-    AccentBuilder(const char* accent, const char* nodeArgs = nullptr)
-        : _accent(accent)
-        , _nodeArgs(nodeArgs)
-    {}
+    generate(tex, *_lexer);
+}
 
-    void add(TokenSequence& sequence) override
+void MathMLGenerator::generate(std::string_view tex, Lexer& lexer)
+{
+    // Sinks like IovecSink keep pointing into the text, so it is copied to
+    // a buffer of the generator and lexed there in place, which spares the
+    // lexer its own copy
+    _text.assign(tex.data(), tex.size());
+    _text.append(2, '\0');
+    if (generateAtom(std::string_view(_text.data(), tex.size())))
     {
-        _arg.add(sequence);
+        return;
     }
 
-    std::string take() override
+    startClock();
+    TXL_STATS_ONLY(const auto start = _stats ? nowNs() : 0;)
+    lexer.tokenize(&_text[0], _text.size(), *_tokens);
+    TXL_STATS_ONLY(if (_stats) _stats->lexNs += nowNs() - start;)
+    generate(*_tokens);
+}
+
+bool MathMLGenerator::generateAtom(std::string_view tex)
+{
+    // Counters are only kept by the general path
+    if (_stats)
     {
-        std::string out("<mover");
-        if (_nodeArgs)
-        {
-            out.append(" ");
-            out.append(_nodeArgs);
-        }
-        out.append(">")
-           .append(_arg.take())
-           .append(_accent)
-           .append("</mover>");
-        return out;
+        return false;
     }
 
-private:
-    const char* _accent;
-    const char* _nodeArgs;
-    ArgBuilder _arg;
-};
+    const auto atom = findAtom(tex);
+    if (atom.element == ATOM_ELEMENTS)
+    {
+        return false;
+    }
+
+    const auto& layout = _workspace->atoms[atom.element];
+    const auto size = layout.begin.size() + atom.text.size() + layout.end.size();
+    if (_limits.maxOutputBytes && size > _limits.maxOutputBytes)
+    {
+        // Let the general path fail the usual way
+        return false;
+    }
 
-std::unique_ptr<Builder> makeBAR()
-{
-    return std::make_unique<AccentBuilder>("<mo>\xC2\xAF</mo>");
+    _sink.reserve(size);
+    _sink.write(layout.begin);
+    _sink.write(atom.text);
+    _sink.write(layout.end);
+    if (_flushMode == FlushMode::EachDocument)
+    {
+        _sink.flush();
+    }
+    return true;
 }
 
-std::unique_ptr<Builder> makeDOT()
+void MathMLGenerator::generateFromIN()
 {
-    return std::make_unique<AccentBuilder>("<mo>\x2E</mo>");
+    const std::string tex((std::istreambuf_iterator<char>(std::cin)),
+                          std::istreambuf_iterator<char>());
+    generate(tex);
 }
 
-std::unique_ptr<Builder> makeDDOT()
+void MathMLGenerator::setCache(std::shared_ptr<ConversionCache> cache)
 {
-    return std::make_unique<AccentBuilder>("<mo>\xC2\xA8</mo>");
+    _cache = std::move(cache);
 }
 
-std::unique_ptr<Builder> makeTILDE()
+void MathMLGenerator::setOptions(const OutputOptions& options)
 {
-    return std::make_unique<AccentBuilder>("<mo stretchy=\"false\">\x7E</mo>");
+    checkOptions(options, "MathMLGenerator::setOptions");
+    _workspace->setOptions(options);
 }
 
-std::unique_ptr<Builder> makeWIDETILDE()
+void MathMLGenerator::setFlushMode(FlushMode mode)
 {
-    return std::make_unique<AccentBuilder>("<mo>\x7E</mo>");
+    _flushMode = mode;
 }
 
-std::unique_ptr<Builder> makeOVERLINE()
+void MathMLGenerator::flush()
 {
-    return std::make_unique<AccentBuilder>("<mo>\xC2\xAF</mo>");
+    _sink.flush();
 }
 
-std::unique_ptr<Builder> makeVEC()
+void MathMLGenerator::setLimits(const ConversionLimits& limits)
 {
-    return std::make_unique<AccentBuilder>("<mo>\xE2\x86\x92</mo>");
+    _limits = limits;
+    _workspace->builders.setDepthLimit(limits.maxDepth);
 }
 
-std::unique_ptr<Builder> makeHAT()
+void MathMLGenerator::startClock()
 {
-    return std::make_unique<AccentBuilder>("<mo>\x5E</mo>");
+    if (_limits.maxTime.count())
+    {
+        _deadline = std::chrono::steady_clock::now() + _limits.maxTime;
+    }
 }
 
-std::unique_ptr<Builder> makeWIDEHAT()
+void MathMLGenerator::setStats(ConversionStats* stats)
 {
-    return std::make_unique<AccentBuilder>("<mo>\x5E</mo>", "accent=\"true\"");
+#ifdef TXL_STATS
+    _stats = stats;
+    _workspace->sequence.setStats(stats);
+#else
+    static_cast<void>(stats);
+#endif
+}
+
+void MathMLGenerator::generateFromFile(const std::string& path)
+{
+    _file.reset();
+    startClock();
+    // flex would write a NUL after every token and so get every page copied
+    _file = std::make_unique<MappedFile>(path, MappedFile::Access::ReadOnly);
+    TXL_STATS_ONLY(const auto start = _stats ? nowNs() : 0;)
+    SimdScanner scanner;
+    scanner.tokenize(_file->text().data(), _file->text().size(), *_tokens);
+    TXL_STATS_ONLY(if (_stats) _stats->lexNs += nowNs() - start;)
+    generate(*_tokens);
 }
 
-std::unique_ptr<Builder> makeUNDERLINE()
+void MathMLGenerator::generate(const TokenArray& tokens)
 {
-    class UNDERLINEBuilder final : public Builder
+    // Not counting the final END token
+    if (_limits.maxTokens && tokens.size() - 1 > _limits.maxTokens)
     {
-    public:
-
-        void add(TokenSequence& sequence) override
-        {
-            _arg.add(sequence);
-        }
+        throw LimitExceeded(LimitExceeded::Limit::Tokens, _limits.maxTokens);
+    }
 
-        std::string take() override
+    OutputSink* sink = &_sink;
+#ifdef TXL_STATS
+    std::optional<TallySink> tally;
+    if (_stats)
+    {
+        ++_stats->formulas;
+        for (const auto type : tokens.types)
         {
-            std::string out(R"(<munder>)");
-            out.append(_arg.take())
-               .append("<mo>\x5F</mo>")
-               .append("</munder>");
-            return out;
+            ++_stats->tokens[type];
         }
+        sink = &tally.emplace(*sink, _stats->outputBytes);
+    }
+#endif
+    if (!_limits.maxDepth && !_limits.maxOutputBytes && !_limits.maxTime.count())
+    {
+        generate(tokens, *sink);
+        return;
+    }
 
-    private:
-        ArgBuilder _arg;
-    };
-
-    return std::make_unique<UNDERLINEBuilder>();
+    // A formula over a limit must not leave half a document behind, so it
+    // only reaches the sink once it is complete
+    auto& staged = _workspace->staged;
+    staged.clear();
+    StringSink staging(staged);
+    std::optional<LimitSink> limited;
+    OutputSink* const target = _limits.maxOutputBytes ? &limited.emplace(staging, _limits.maxOutputBytes)
+                                                      : static_cast<OutputSink*>(&staging);
+    generate(tokens, *target);
+    sink->reserve(staged.size());
+    sink->write(staged);
+    if (_flushMode == FlushMode::EachDocument)
+    {
+        sink->flush();
+    }
 }
 
-std::unique_ptr<Builder> makeHSPACE()
+void MathMLGenerator::generate(const TokenArray& tokens, OutputSink& sink)
 {
-    class HSPACEBuilder final : public Builder
+    const auto& begin = _workspace->begin;
+    const auto& end = _workspace->end;
+    sink.reserve(begin.size() + estimateSize(tokens) + end.size());
+    sink.write(begin);
+
+    if (!_cache)
+    {
+        convert(tokens, sink);
+    }
+    else
     {
-        void add(TokenSequence& sequence) override
+        // Only the formula is cached, what goes around it depends on the options
+        ConversionCache::makeKey(tokens, _cacheKey);
+        // A hit skips the depth and time checks, so a document is only served
+        // under the limits it was converted with. The output limit is checked
+        // on the hit itself. Nothing follows the END token of a key otherwise.
+        if (_limits.maxDepth || _limits.maxTime.count())
         {
-            _arg.add(sequence);
+            const std::uint64_t limits[] = {_limits.maxDepth, static_cast<std::uint64_t>(_limits.maxTime.count())};
+            _cacheKey.append(reinterpret_cast<const char*>(limits), sizeof(limits));
         }
-
-        std::string take() override
+        _cacheHit = _cache->find(_cacheKey);
+        if (_cacheHit)
+        {
+            sink.write(*_cacheHit);
+        }
+        else
         {
-            return "<mo>\xE2\x80\x89</mo>";
+            CaptureSink capture(sink, _cacheDocument, _cache->maxDocumentBytes());
+            convert(tokens, capture);
+            if (capture.complete())
+            {
+                _cache->insert(_cacheKey, _cacheDocument);
+            }
         }
+    }
 
-    private:
-        ArgBuilder _arg;
-    };
-    return std::make_unique<HSPACEBuilder>();
+    sink.write(end);
+    if (_flushMode == FlushMode::EachDocument)
+    {
+        sink.flush();
+    }
 }
 
-class SingleNodeBuilder final : public Builder
+void MathMLGenerator::convert(const TokenArray& tokens, OutputSink& sink)
 {
-public:
-    SingleNodeBuilder(std::string&& node)
-        : _node(std::move(node))
+    sink.write("<mrow>");
+
+    auto& tree = _workspace->tree;
+    auto& sequence = _workspace->sequence;
+    tree.clear();
+    // Most tokens make about one node
+    tree.reserve(tokens.size());
+    sequence.reset(tokens);
+    // Lexing may have used up the time already
+    sequence.setDeadline(_deadline, _limits.maxTime);
+    sequence.checkDeadline();
+
+#ifdef TXL_STATS
+    // Serializing happens in between building, its time is taken out of the total
+    std::uint64_t serializeNs = 0;
+    const auto start = _stats ? nowNs() : 0;
+#endif
+
+    // The top row starts on an empty tree, so its children are the pending ids
+    // from 0 and each can be written as soon as it is finished.
+    RowBuilder builder;
+    std::size_t written = 0;
+    while(!sequence.empty())
     {
+        sequence.run(builder);
+        TXL_STATS_ONLY(const auto serializeStart = _stats ? nowNs() : 0;)
+        for (const auto end = builder.finished(); written < end; ++written)
+        {
+            tree.serialize(tree.pending(written), sink);
+        }
+        TXL_STATS_ONLY(if (_stats) serializeNs += nowNs() - serializeStart;)
     }
 
-    void add(TokenSequence&) override
+    const auto& row = tree.node(builder.take(tree));
+    TXL_STATS_ONLY(const auto built = _stats ? nowNs() : 0;)
+    for (; written < row.childCount; ++written)
     {
+        tree.serialize(tree.child(row, written), sink);
     }
 
-    std::string take() override
+    sink.write("</mrow>");
+
+#ifdef TXL_STATS
+    const auto maxDepth = _workspace->builders.takeMaxDepth();
+    if (_stats)
     {
-        return std::move(_node);
+        _stats->buildNs += built - start - serializeNs;
+        _stats->serializeNs += serializeNs + nowNs() - built;
+        _stats->maxDepth = std::max<std::uint64_t>(_stats->maxDepth, maxDepth);
     }
+#endif
+}
 
-private:
-    std::string _node;
+struct EditSession::State
+{
+    // Tokens replaced by an edit: [first, oldEnd) became [first, newEnd)
+    struct TokenChange
+    {
+        std::size_t first;
+        std::size_t oldEnd;
+        std::size_t newEnd;
+    };
+
+    // A token where a new RowBuilder can take over the formula and build the
+    // same children: no \left is open, no char of the token is taken yet and
+    // the token starts a child of its own. After '^', '_', \left or a skipped
+    // brace a sub/superscript would take the child before as its base.
+    // `output` is where the children after it start.
+    struct Cut
+    {
+        std::uint32_t token;
+        std::size_t output;
+    };
+
+    static constexpr std::string_view ROW_BEGIN = "<mrow>";
+    static constexpr std::string_view ROW_END = "</mrow>";
+
+    Patch rebuildAll();
+    Patch rebuildAround(const TokenChange& change);
+    Patch rebuildTop(const TokenChange& change);
+    bool rebuild(const BuiltPart& part, std::ptrdiff_t tokenShift);
+    NodeId buildTop(std::size_t from, std::size_t resume, std::ptrdiff_t tokenShift);
+    void placeFound(NodeId root);
+    TokenChange relex(std::size_t offset, std::size_t removed, std::size_t inserted);
+
+    Lexer lexer;
+    std::string text;
+    TokenArray tokens;
+    TokenArray window;
+    // Written around the <mrow> of the formula
+    std::string begin;
+    std::string end;
+    std::string document;
+
+    MathMLTree tree;
+    BuilderStack builders;
+    TokenSequence sequence{tree, builders};
+
+    // Parts of the current document with their place in it
+    std::vector<BuiltPart> parts;
+    std::vector<BuiltPart> log;
+    std::vector<MathMLTree::Span> spans;
+    std::string output;
+    std::vector<std::size_t> candidates;
+    // Cuts of the current document in order, the first at token 0 and the last at END
+    std::vector<Cut> cuts;
+    // Cuts passed by buildTop(), with the index of the child after them
+    // until placeFound() turns it into the output
+    std::vector<Cut> found;
+    // The cut where buildTop() stopped, cuts.size() if it went on to the END
+    std::size_t resumed = 0;
+    // False while the parts may not match the text, e.g. after an exception
+    bool valid = false;
 };
 
-std::unique_ptr<Builder> makeQUAD()
+EditSession::EditSession(std::string_view tex, const OutputOptions& options)
+    : _state(std::make_unique<State>())
 {
-    return std::make_unique<SingleNodeBuilder>("<mi>\xE2\x80\x81</mi>");
+    checkOptions(options, "EditSession");
+    _state->begin = documentBegin(options);
+    _state->end = documentEnd(options);
+    _state->text.assign(tex.data(), tex.size());
+    _state->sequence.setLog(&_state->log);
+    _state->rebuildAll();
 }
 
-std::unique_ptr<Builder> makeQQUAD()
-{
-    return std::make_unique<SingleNodeBuilder>(R"(<mspace width="2em"/>)");
-}
+EditSession::~EditSession() = default;
 
-std::unique_ptr<Builder> makeTHICKSPACE()
+const std::string& EditSession::text() const
 {
-    return std::make_unique<SingleNodeBuilder>(R"(<mspace width="0.27778em"/>)");
+    return _state->text;
 }
 
-std::unique_ptr<Builder> makeMEDSPACE()
+const std::string& EditSession::document() const
 {
-    return std::make_unique<SingleNodeBuilder>("<mi>\xE2\x81\x9F</mi>");
+    return _state->document;
 }
 
-std::unique_ptr<Builder> makeTHINSPACE()
+EditSession::Patch EditSession::apply(const Edit& edit)
 {
-    return std::make_unique<SingleNodeBuilder>("<mi>\xE2\x80\x89</mi>");
-}
+    auto& state = *_state;
+    if (edit.offset > state.text.size() || edit.removed > state.text.size() - edit.offset)
+    {
+        throw std::out_of_range("EditSession::apply: the edit is outside of the text");
+    }
 
-std::unique_ptr<Builder> makeNEGSPACE()
-{
-    return std::make_unique<SingleNodeBuilder>(R"(<mspace width="-0.16667em"/>)");
+    state.text.replace(edit.offset, edit.removed, edit.inserted.data(), edit.inserted.size());
+    state.tokens.source = state.text;
+    if (!state.valid)
+    {
+        return state.rebuildAll();
+    }
+
+    state.valid = false;
+    return state.rebuildAround(state.relex(edit.offset, edit.removed, edit.inserted.size()));
 }
 
-std::unique_ptr<Builder> makeNEGMEDSPACE()
+EditSession::Patch EditSession::State::rebuildAll()
 {
-    return std::make_unique<SingleNodeBuilder>(R"(<mspace width="-0.22222em"/>)");
+    valid = false;
+    const auto removed = document.size();
+
+    lexer.tokenize(text, tokens);
+    cuts.clear();
+    const auto root = buildTop(0, static_cast<std::size_t>(-1), 0);
+
+    document = begin;
+    StringSink sink(document);
+    tree.serialize(root, sink, document.size(), spans);
+    document += end;
+
+    parts.swap(log);
+    for (auto& part : parts)
+    {
+        part.output = spans[part.node];
+    }
+    placeFound(root);
+    cuts.swap(found);
+
+    valid = true;
+    return {0, removed, document};
 }
 
-std::unique_ptr<Builder> makeNEGTHICKSPACE()
+namespace
+{
+template <typename T>
+void shiftBy(T& value, std::ptrdiff_t by)
 {
-    return std::make_unique<SingleNodeBuilder>(R"(<mspace width="-0.27778em"/>)");
+    value = static_cast<T>(static_cast<std::ptrdiff_t>(value) + by);
 }
+} // namespace
 
-std::unique_ptr<Builder> makeSUBSTACK()
+EditSession::Patch EditSession::State::rebuildAround(const TokenChange& change)
 {
-    class SUBSTACKBuilder final : public Builder
+    const auto tokenShift = static_cast<std::ptrdiff_t>(change.newEnd) - static_cast<std::ptrdiff_t>(change.oldEnd);
+
+    // Written parts around the changed tokens whose own delimiters did not change, smallest first
+    candidates.clear();
+    for (std::size_t i = 0; i < parts.size(); ++i)
     {
-        void add(TokenSequence& sequence) override
+        const auto& part = parts[i];
+        if (part.begin < change.first && part.end > change.oldEnd && part.output.begin != MathMLTree::NOT_WRITTEN)
         {
-            _arg.add(sequence);
+            candidates.push_back(i);
         }
+    }
+    std::sort(candidates.begin(), candidates.end(), [this](std::size_t a, std::size_t b)
+    {
+        return parts[a].end - parts[a].begin < parts[b].end - parts[b].begin;
+    });
 
-        std::string take() override
+    for (const auto index : candidates)
+    {
+        const auto part = parts[index];
+        if (!rebuild(part, tokenShift))
         {
-            return _arg.take();
+            continue;
         }
 
-    private:
-        ArgTableBuilder _arg;
-    };
-    return std::make_unique<SUBSTACKBuilder>();
-}
+        const auto byteShift = static_cast<std::ptrdiff_t>(output.size()) -
+                               static_cast<std::ptrdiff_t>(part.output.end - part.output.begin);
+        document.replace(part.output.begin, part.output.end - part.output.begin, output);
 
-std::unique_ptr<Builder> makeMBOX()
-{
-    return std::make_unique<TextArgBuilder>(true);
-}
+        // Parts inside are replaced by the new ones, later parts and cuts
+        // move. Tokens and output need not be in the same order, e.g. the
+        // index of \sqrt[n]{x} is written after the base.
+        parts.erase(std::remove_if(parts.begin(), parts.end(), [&](const BuiltPart& p)
+        {
+            return p.begin >= part.begin && p.end <= part.end;
+        }), parts.end());
+        for (auto& p : parts)
+        {
+            if (p.begin >= part.end)
+            {
+                shiftBy(p.begin, tokenShift);
+                shiftBy(p.end, tokenShift);
+            }
+            else if (p.end >= part.end)
+            {
+                shiftBy(p.end, tokenShift);
+            }
 
-std::unique_ptr<Builder> makeDISPLAYSTYLE()
-{
-    class DISPLAYSTYLEBuilder final : public Builder
-    {
-        void add(TokenSequence& sequence) override
+            if (p.output.begin == MathMLTree::NOT_WRITTEN)
+            {
+                continue;
+            }
+            if (p.output.begin >= part.output.end)
+            {
+                shiftBy(p.output.begin, byteShift);
+                shiftBy(p.output.end, byteShift);
+            }
+            else if (p.output.end >= part.output.end)
+            {
+                shiftBy(p.output.end, byteShift);
+            }
+        }
+        for (auto& p : log)
         {
-            _arg.add(sequence);
+            p.output = spans[p.node];
+            parts.push_back(p);
         }
-
-        std::string take() override
+        for (auto& cut : cuts)
         {
-            std::string out(R"(<mstyle displaystyle="true">)");
-            out.append(_arg.take())
-               .append(R"(</mstyle>)");
-            return out;
+            if (cut.token >= part.end)
+            {
+                shiftBy(cut.token, tokenShift);
+                shiftBy(cut.output, byteShift);
+            }
         }
 
-    private:
-        ArgBuilder _arg;
-    };
-    return std::make_unique<DISPLAYSTYLEBuilder>();
+        valid = true;
+        return {part.output.begin, part.output.end - part.output.begin,
+                std::string_view(document).substr(part.output.begin, output.size())};
+    }
+
+    return rebuildTop(change);
 }
 
-std::unique_ptr<Builder> makeTEXTSTYLE()
+// Builds the formula again from the last cut before the changed tokens up to
+// the first cut after them that is still one, since from there on the
+// formula is built as before. Only at the END this takes the whole rest.
+EditSession::Patch EditSession::State::rebuildTop(const TokenChange& change)
 {
-    class TEXTSTYLEBuilder final : public Builder
+    const auto tokenShift = static_cast<std::ptrdiff_t>(change.newEnd) - static_cast<std::ptrdiff_t>(change.oldEnd);
+
+    const auto after = std::lower_bound(cuts.begin(), cuts.end(), change.first, [](const Cut& cut, std::size_t token)
     {
-        void add(TokenSequence& sequence) override
+        return cut.token < token;
+    });
+    const auto first = std::max<std::size_t>(after - cuts.begin(), 1) - 1;
+    const auto from = cuts[first];
+
+    const auto root = buildTop(from.token, change.newEnd, tokenShift);
+    const auto last = resumed < cuts.size() ? resumed : cuts.size() - 1;
+    const auto removed = cuts[last].output - from.output;
+
+    output.clear();
+    StringSink sink(output);
+    tree.serialize(root, sink, from.output - ROW_BEGIN.size(), spans);
+    const auto inserted = output.size() - ROW_BEGIN.size() - ROW_END.size();
+    const auto byteShift = static_cast<std::ptrdiff_t>(inserted) - static_cast<std::ptrdiff_t>(removed);
+    document.replace(from.output, removed, output, ROW_BEGIN.size(), inserted);
+
+    // The same for parts as in rebuildAround(), no part contains a cut
+    const auto end = cuts[last].token;
+    parts.erase(std::remove_if(parts.begin(), parts.end(), [&](const BuiltPart& p)
+    {
+        return p.begin >= from.token && p.end <= end;
+    }), parts.end());
+    for (auto& p : parts)
+    {
+        if (p.begin >= end)
         {
-            _arg.add(sequence);
+            shiftBy(p.begin, tokenShift);
+            shiftBy(p.end, tokenShift);
+            if (p.output.begin != MathMLTree::NOT_WRITTEN)
+            {
+                shiftBy(p.output.begin, byteShift);
+                shiftBy(p.output.end, byteShift);
+            }
         }
+    }
+    for (auto& p : log)
+    {
+        p.output = spans[p.node];
+        parts.push_back(p);
+    }
 
-        std::string take() override
-        {
-            std::string out(R"(<mstyle displaystyle="false">)");
-            out.append(_arg.take())
-               .append(R"(</mstyle>)");
-            return out;
-        }
+    placeFound(root);
+    cuts.erase(cuts.begin() + static_cast<std::ptrdiff_t>(first), cuts.begin() + static_cast<std::ptrdiff_t>(resumed));
+    for (auto cut = cuts.begin() + static_cast<std::ptrdiff_t>(first); cut != cuts.end(); ++cut)
+    {
+        shiftBy(cut->token, tokenShift);
+        shiftBy(cut->output, byteShift);
+    }
+    cuts.insert(cuts.begin() + static_cast<std::ptrdiff_t>(first), found.begin(), found.end());
 
-    private:
-        ArgBuilder _arg;
-    };
-    return std::make_unique<TEXTSTYLEBuilder>();
+    valid = true;
+    return {from.output, removed, std::string_view(document).substr(from.output, inserted)};
 }
 
-std::unique_ptr<Builder> makePHANTOM()
+// Builds the formula with a new RowBuilder from the cut at `from`. From
+// `resume` on it stops at the first cut that, moved back by `tokenShift`,
+// was a cut before the edit: the builder is in the same state there, and
+// the tokens after it are the same.
+NodeId EditSession::State::buildTop(std::size_t from, std::size_t resume, std::ptrdiff_t tokenShift)
 {
-    class PHANTOMBuilder final : public Builder
+    tree.clear();
+    log.clear();
+    found.clear();
+    resumed = cuts.size();
+    sequence.reset(tokens);
+    sequence.seek(from);
+
+    RowBuilder builder;
+    for (;;)
     {
-        void add(TokenSequence& sequence) override
+        const auto position = sequence.position();
+        const auto& token = sequence.top();
+        bool cut = position == from || sequence.empty();
+        if (!cut && sequence.fences().empty() && sequence.atTokenStart())
         {
-            _arg.add(sequence);
+            switch (token.type)
+            {
+                case SIGN:
+                    cut = token.content[0] != '^' && token.content[0] != '_';
+                    break;
+
+                case COMMAND:
+                {
+                    const auto* command = commandOf(token);
+                    cut = !command || command->kind != CommandKind::Left;
+                    break;
+                }
+
+                // Like \left they add no child, a sub/superscript after them
+                // takes the child before
+                case START_GROUP:
+                case END_GROUP:
+                case END_ENV:
+                    break;
+
+                default:
+                    cut = true;
+                    break;
+            }
         }
 
-        std::string take() override
+        if (cut)
         {
-            std::string out(R"(<mphantom>)");
-            out.append(_arg.take())
-               .append(R"(</mphantom>)");
-            return out;
+            if (position >= resume)
+            {
+                const auto old = static_cast<std::size_t>(static_cast<std::ptrdiff_t>(position) - tokenShift);
+                const auto match = std::lower_bound(cuts.begin(), cuts.end(), old, [](const Cut& c, std::size_t t)
+                {
+                    return c.token < t;
+                });
+                if (match != cuts.end() && match->token == old)
+                {
+                    resumed = static_cast<std::size_t>(match - cuts.begin());
+                    break;
+                }
+            }
+            found.push_back({static_cast<std::uint32_t>(position), tree.mark()});
         }
 
-    private:
-        ArgBuilder _arg;
-    };
-    return std::make_unique<PHANTOMBuilder>();
+        if (sequence.empty())
+        {
+            break;
+        }
+        sequence.run(builder);
+    }
+    return builder.take(tree);
 }
 
-std::unique_ptr<Builder> makeTEXTCOLOR()
+// Turns the child indexes of the found cuts into their place in the
+// serialized `root`, the row buildTop() returned
+void EditSession::State::placeFound(NodeId root)
 {
-    class TEXTCOLORBuilder final : public Builder
+    const auto& row = tree.node(root);
+    for (auto& cut : found)
     {
-        void add(TokenSequence& sequence) override
-        {
-            _params.add(sequence);
-            _color.add(sequence);
-            _arg.add(sequence);
-        }
+        cut.output = cut.output < row.childCount ? spans[tree.child(row, cut.output)].begin
+                                                 : spans[root].end - ROW_END.size();
+    }
+}
 
-        std::string take() override
+// Builds the part again from the new tokens into `output`. Fails when it
+// no longer ends where it did, or an argument became empty or not, since
+// the builder around it would then build something else.
+bool EditSession::State::rebuild(const BuiltPart& part, std::ptrdiff_t tokenShift)
+{
+    tree.clear();
+    log.clear();
+    sequence.reset(tokens);
+    sequence.seek(part.begin);
+    if (part.style >= 0)
+    {
+        sequence.pushStyle(static_cast<TokenSequence::Style>(part.style));
+    }
+
+    NodeId node;
+    if (part.kind == BuiltPart::Kind::Argument)
+    {
+        ArgBuilder builder;
+        sequence.run(builder);
+        node = builder.take(tree);
+        if ((tree.node(node).childCount == 0) != part.empty)
         {
-            std::string out("<mstyle");
+            return false;
+        }
+    }
+    else
+    {
+        node = buildEnvironment(sequence);
+    }
 
-            auto colorStr = _color.takeContent();
-            if (!colorStr.empty() && colorStr[0] == '#')
-            {
-                std::transform(colorStr.begin(), colorStr.end(), colorStr.begin(),
-                               [](unsigned char c){ return std::toupper(c); });
+    if (static_cast<std::ptrdiff_t>(sequence.position()) != static_cast<std::ptrdiff_t>(part.end) + tokenShift)
+    {
+        return false;
+    }
 
-                if ("#000000" == colorStr) colorStr = "black";
-                else if ("#0000FF" == colorStr) colorStr = "blue";
-                else if ("#008000" == colorStr) colorStr = "green";
-                else if ("#00FFFF" == colorStr) colorStr = "cyan";
-                else if ("#FF0000" == colorStr) colorStr = "red";
-                else if ("#FF00FF" == colorStr) colorStr = "magenta";
-                else if ("#FFFF00" == colorStr) colorStr = "yellow";
-                else if ("#FFFFFF" == colorStr) colorStr = "white";
+    output.clear();
+    StringSink sink(output);
+    tree.serialize(node, sink, part.output.begin, spans);
+    return true;
+}
 
-                out.append(" color='").append(colorStr).append("'");
-            }
+// Lexes again from the last token that surely stays as it is until the new
+// tokens line up with the old ones. That is a token ending at the same place
+// of the unchanged rest of the text, after which the scanner is back in its
+// initial state. Only a window of the text is lexed, it grows when needed.
+EditSession::State::TokenChange EditSession::State::relex(std::size_t offset, std::size_t removed, std::size_t inserted)
+{
+    const auto delta = static_cast<std::ptrdiff_t>(inserted) - static_cast<std::ptrdiff_t>(removed);
+    const auto tokenEnd = [](const TokenArray& array, std::size_t i)
+    {
+        return static_cast<std::size_t>(array.offsets[i]) + array.lengths[i];
+    };
 
-            out.append(">")
-               .append(_arg.take())
-               .append("</mstyle>");
-            return out;
+    // Flex looks up to three bytes past a token to find where it ends, and
+    // after an environment name the scanner is still inside its braces. The
+    // END is always lexed again, text after an "EOF" has no tokens.
+    std::size_t first = 0;
+    for (std::size_t low = 0, high = tokens.size() - 1; low < high;)
+    {
+        const auto middle = (low + high) / 2;
+        if (tokenEnd(tokens, middle) + 3 <= offset)
+        {
+            first = low = middle + 1;
         }
+        else
+        {
+            high = middle;
+        }
+    }
+    while (first > 0 && (tokens.types[first - 1] == BEGIN_ENV || tokens.types[first - 1] == END_ENV))
+    {
+        --first;
+    }
+    const auto restart = first ? tokenEnd(tokens, first - 1) : 0;
+    const auto editEnd = offset + inserted;
 
-    private:
-        OptArgBuilder _params;
-        TextArgBuilder _color;
-        ArgBuilder _arg;
-    };
-    return std::make_unique<TEXTCOLORBuilder>();
-}
-
-const std::unordered_map<std::string, std::unique_ptr<Builder>(*)()>& getBuilderFactory()
-{
-    static const std::unordered_map<std::string, std::unique_ptr<Builder>(*)()> map =
-    {
-        {" ", makeTHICKSPACE},
-        {"!", makeNEGSPACE},
-        {",", makeTHINSPACE},
-        {":", makeMEDSPACE},
-        {";", makeTHICKSPACE},
-        {">", makeMEDSPACE},
-        {"bar", makeBAR},
-        {"binom", makeBINOM},
-        {"cfrac", makeFRAC},
-        {"closure", makeOVERLINE},
-        {"ddot", makeDDOT},
-        {"dfrac", makeFRAC},
-        {"displaystyle", makeDISPLAYSTYLE},
-        {"dot", makeDOT},
-        {"frac", makeFRAC},
-        {"genfrac", makeGENFRAC},
-        {"hat", makeHAT},
-        {"hspace", makeHSPACE},
-        {"iiiint", makeIIIINT},
-        {"iiint", makeIIINT},
-        {"iint", makeIINT},
-        {"int", makeINT},
-        {"integral", makeINT},
-        {"lim", makeLIM},
-        {"mathbb", makeMATHBB},
-        {"mathrm", makeMATHRM},
-        {"mbox", makeMBOX},
-        {"medspace", makeMEDSPACE},
-        {"negmedspace", makeNEGMEDSPACE},
-        {"negspace", makeNEGSPACE},
-        {"negthickspace", makeNEGTHICKSPACE},
-        {"negthinspace", makeNEGSPACE},
-        {"oiiint", makeOIIINT},
-        {"oiint", makeOIINT},
-        {"oint", makeOINT},
-        {"overline", makeOVERLINE},
-        {"overrightarrow", makeVEC},
-        {"overset", makeOVERSET},
-        {"phantom", makePHANTOM},
-        {"prod", makePROD},
-        {"product", makePROD},
-        {"qquad", makeQQUAD},
-        {"quad", makeQUAD},
-        {"rm", makeMATHRM},
-        {"smallint", makeSMALLINT},
-        {"sqrt", makeSQRT},
-        {"stackrel", makeOVERSET},
-        {"substack", makeSUBSTACK},
-        {"sum", makeSUM},
-        {"tbinom", makeBINOM},
-        {"textcolor", makeTEXTCOLOR},
-        {"textstyle", makeTEXTSTYLE},
-        {"tfrac", makeFRAC},
-        {"thickspace", makeTHICKSPACE},
-        {"thinspace", makeTHINSPACE},
-        {"tilde", makeTILDE},
-        {"underline", makeUNDERLINE},
-        {"underset", makeUNDERSET},
-        {"vec", makeVEC},
-        {"widebar", makeOVERLINE},
-        {"widehat", makeWIDEHAT},
-        {"widetilde", makeWIDETILDE},
-        {"widevec", makeVEC},
-        {"~", makeTILDE},
-    };
-    return map;
-}
-
-} // namespace
+    // Puts the first `count` window tokens in place of the old ones from `first`
+    // to `oldEnd`, leaving out those that did not change at either end
+    const auto replace = [&](std::size_t oldEnd, std::size_t count)
+    {
+        const auto same = [&](std::size_t oldIndex, std::size_t newIndex, std::ptrdiff_t shift)
+        {
+            return tokens.types[oldIndex] == window.types[newIndex] &&
+                   tokens.lengths[oldIndex] == window.lengths[newIndex] &&
+                   static_cast<std::ptrdiff_t>(tokens.offsets[oldIndex]) + shift ==
+                       static_cast<std::ptrdiff_t>(restart + window.offsets[newIndex]);
+        };
 
-MathMLGenerator::MathMLGenerator(std::ostream& out)
-    : _out(out)
-{
-}
+        std::size_t from = 0;
+        while (from < count && first < oldEnd && restart + tokenEnd(window, from) <= offset && same(first, from, 0))
+        {
+            ++from;
+            ++first;
+        }
+        while (count > from && oldEnd > first && restart + window.offsets[count - 1] >= editEnd &&
+               same(oldEnd - 1, count - 1, delta))
+        {
+            --count;
+            --oldEnd;
+        }
 
-MathMLGenerator::~MathMLGenerator() = default;
+        // Overwrites in place as far as it can, so only a change in the
+        // number of tokens moves the ones after it
+        const auto splice = [&](auto& to, const auto& source)
+        {
+            const auto same = std::min(oldEnd - first, count - from);
+            std::copy(source.begin() + from, source.begin() + from + same, to.begin() + first);
+            to.erase(to.begin() + first + same, to.begin() + oldEnd);
+            to.insert(to.begin() + first + same, source.begin() + from + same, source.begin() + count);
+        };
+        splice(tokens.types, window.types);
+        splice(tokens.offsets, window.offsets);
+        splice(tokens.lengths, window.lengths);
+        splice(tokens.ids, window.ids);
 
-void MathMLGenerator::generate(const std::string& tex)
-{
-    Lexer lexer(tex);
-    generate(lexer);
-}
+        const auto newEnd = first + count - from;
+        for (std::size_t i = first; i < newEnd; ++i)
+        {
+            tokens.offsets[i] += static_cast<std::uint32_t>(restart);
+        }
+        for (std::size_t i = newEnd; i < tokens.size(); ++i)
+        {
+            tokens.offsets[i] = static_cast<std::uint32_t>(static_cast<std::ptrdiff_t>(tokens.offsets[i]) + delta);
+        }
+        return TokenChange{first, oldEnd, newEnd};
+    };
 
-void MathMLGenerator::generateFromIN()
-{
-    Lexer lexer;
-    generate(lexer);
-}
+    for (auto size = std::max<std::size_t>(256, 2 * (editEnd - restart));; size *= 2)
+    {
+        const auto windowEnd = std::min(text.size(), restart + size);
+        const bool complete = windowEnd == text.size();
+        lexer.tokenize(std::string_view(text).substr(restart, windowEnd - restart), window);
 
-void MathMLGenerator::generate(Lexer& lexer)
-{
-    _out << R"(<?xml version="1.0" encoding="UTF-8"?>)" << std::endl
-         << R"(<math xmlns="http://www.w3.org/1998/Math/MathML">)" << std::endl;
+        for (std::size_t i = 0, old = first; i < window.size(); ++i)
+        {
+            const auto type = window.types[i];
+            if (type == END)
+            {
+                // The real end, or "EOF" in the text, which ends it as well
+                if (complete || window.offsets[i] < windowEnd - restart)
+                {
+                    return replace(tokens.size(), i + 1);
+                }
+                break;
+            }
 
-    TokenSequence sequence{lexer};
-    RowBuilder builder;
-    while(!sequence.empty()) builder.add(sequence);
+            const auto end = restart + tokenEnd(window, i);
+            if (!complete && end + 3 > windowEnd)
+            {
+                // Might end elsewhere in the whole text
+                break;
+            }
+            if (end < editEnd || type == BEGIN_ENV || type == END_ENV)
+            {
+                continue;
+            }
 
-    _out << builder.take() << std::endl
-         << R"(</math>)" << std::endl;
+            const auto oldEnd = static_cast<std::size_t>(static_cast<std::ptrdiff_t>(end) - delta);
+            while (old + 1 < tokens.size() && tokenEnd(tokens, old) < oldEnd)
+            {
+                ++old;
+            }
+            if (old + 1 < tokens.size() && tokenEnd(tokens, old) == oldEnd && tokens.types[old] == type)
+            {
+                return replace(old + 1, i + 1);
+            }
+        }
+    }
 }
 } // namespace TXL
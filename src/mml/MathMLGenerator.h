@@ -1,24 +1,114 @@
 #pragma once
 
+#include "ConversionLimits.h"
+#include "OutputOptions.h"
+
+#include <chrono>
+#include <memory>
 #include <ostream>
+#include <string>
+#include <string_view>
 
 namespace TXL
 {
+class ConversionCache;
+struct ConversionStats;
 class Lexer;
+class MappedFile;
+class OutputSink;
+class StreamSink;
+struct TokenArray;
 
 class MathMLGenerator final
 {
+public:
+    enum class FlushMode
+    {
+        // The sink is flushed after the closing tag of every document
+        EachDocument,
+        // Only by flush(), e.g. once per batch. Until then output leaves
+        // the sink only when its buffer is full.
+        OnDemand,
+    };
+
 public:
     MathMLGenerator(std::ostream& out);
+    // Streams each formula into the sink
+    MathMLGenerator(OutputSink& sink);
     ~MathMLGenerator();
 
-    void generate(const std::string& tex);
+    // Reuses the same lexer and token storage for every call,
+    // so converting many formulas does not set up a new scanner each time.
+    // The text is copied, `tex` need not outlive the call.
+    void generate(std::string_view tex);
+
+    // Same, with a lexer owned by the caller, e.g. shared by several generators.
+    void generate(std::string_view tex, Lexer& lexer);
+
     void generateFromIN();
 
+    // Converts a whole file as one formula. The file is mapped read-only and
+    // lexed in place by SimdScanner, whatever the lexer backend, so it is
+    // never copied. SimdScannerTestSuite checks that flex gives the same
+    // tokens. It stays mapped until the next generateFromFile(). The
+    // tokens of the whole file are kept as well, 11 bytes each.
+    void generateFromFile(const std::string& path);
+
+    // Formulas with the same tokens as an earlier one are written from the
+    // cache, which may be shared with other generators. Null turns it off.
+    // Under depth or time limits only documents converted with the same
+    // limits are hits.
+    void setCache(std::shared_ptr<ConversionCache> cache);
+
+    // Every formula converted from now on adds its counters and timings to
+    // `stats`, until it is reset to null. Does nothing when the library is
+    // built without TXL_STATS, see ConversionStats::ENABLED.
+    void setStats(ConversionStats* stats);
+
+    // Prolog, wrapper element and whitespace of the documents written from
+    // now on. Throws std::invalid_argument when the element has no name
+    // and the output is not a fragment.
+    void setOptions(const OutputOptions& options);
+
+    // EachDocument by default
+    void setFlushMode(FlushMode mode);
+    void flush();
+
+    // Checked while converting, a formula over one of the limits throws
+    // LimitExceeded and writes nothing. While a limit is set, documents are
+    // put together in memory and written in one piece. There are none by default.
+    void setLimits(const ConversionLimits& limits);
+
 private:
-    void generate(Lexer& in);
+    struct Workspace;
+
+    // Writes formulas like "x", "42" or "\alpha" from a template without
+    // lexing them. False if the formula needs the general path.
+    bool generateAtom(std::string_view tex);
+    void generate(const TokenArray& tokens);
+    void generate(const TokenArray& tokens, OutputSink& sink);
+    void convert(const TokenArray& tokens, OutputSink& sink);
+    void startClock();
 
 private:
-    std::ostream& _out;
+    std::unique_ptr<StreamSink> _streamSink;
+    OutputSink& _sink;
+    std::unique_ptr<Lexer> _lexer;
+    // The formula of the last generate(), followed by the two NUL bytes of
+    // the lexer
+    std::string _text;
+    std::unique_ptr<TokenArray> _tokens;
+    std::unique_ptr<MappedFile> _file;
+    std::unique_ptr<Workspace> _workspace;
+    std::shared_ptr<ConversionCache> _cache;
+    std::string _cacheKey;
+    std::string _cacheDocument;
+    // Held until the next formula, sinks like IovecSink keep pointing into it
+    // while the shared cache may already have evicted it
+    std::shared_ptr<const std::string> _cacheHit;
+    ConversionStats* _stats = nullptr;
+    ConversionLimits _limits;
+    FlushMode _flushMode = FlushMode::EachDocument;
+    std::chrono::steady_clock::time_point _deadline;
 };
 } // namespace TXL
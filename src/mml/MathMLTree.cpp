@@ -0,0 +1,279 @@
+#include "MathMLTree.h"
+
+#include "OutputSink.h"
+
+#include <algorithm>
+#include <cstring>
+
+namespace TXL
+{
+namespace
+{
+constexpr std::size_t CHUNK_SIZE = 4096;
+} // namespace
+
+void MathMLTree::clear()
+{
+    _nodes.clear();
+    _children.clear();
+    _pending.clear();
+    _chunk = 0;
+    _chunkUsed = 0;
+}
+
+void MathMLTree::reserve(std::size_t nodes)
+{
+    _nodes.reserve(nodes);
+    _children.reserve(nodes);
+    _pending.reserve(nodes);
+}
+
+std::string_view MathMLTree::store(std::initializer_list<std::string_view> parts)
+{
+    std::size_t size = 0;
+    for (const auto& part : parts)
+    {
+        size += part.size();
+    }
+
+    if (size == 0)
+    {
+        return std::string_view();
+    }
+
+    char* const begin = allocate(size);
+    char* dst = begin;
+    for (const auto& part : parts)
+    {
+        // An empty view may have no data at all
+        if (part.empty())
+        {
+            continue;
+        }
+        std::memcpy(dst, part.data(), part.size());
+        dst += part.size();
+    }
+    return std::string_view(begin, size);
+}
+
+void MathMLTree::startText()
+{
+    _textBegin = _chunkUsed;
+}
+
+void MathMLTree::appendText(std::string_view text)
+{
+    if (text.empty())
+    {
+        return;
+    }
+
+    if (_chunk < _chunks.size() && _chunkUsed + text.size() <= _chunks[_chunk].second)
+    {
+        std::memcpy(_chunks[_chunk].first.get() + _chunkUsed, text.data(), text.size());
+        _chunkUsed += text.size();
+        return;
+    }
+
+    // Move what is written so far to a chunk with room for the rest, the old copy just stays unused
+    const auto written = _chunkUsed - _textBegin;
+    const char* const old = written ? _chunks[_chunk].first.get() + _textBegin : nullptr;
+    char* const begin = allocate(written + text.size());
+    if (written)
+    {
+        std::memcpy(begin, old, written);
+    }
+    std::memcpy(begin + written, text.data(), text.size());
+    _textBegin = _chunkUsed - written - text.size();
+}
+
+std::string_view MathMLTree::finishText()
+{
+    if (_chunkUsed == _textBegin)
+    {
+        return std::string_view();
+    }
+    return std::string_view(_chunks[_chunk].first.get() + _textBegin, _chunkUsed - _textBegin);
+}
+
+NodeId MathMLTree::textElement(std::string_view name, std::string_view attributes, std::string_view text)
+{
+    return add({Kind::TextElement, name, attributes, text});
+}
+
+NodeId MathMLTree::markup(std::string_view text)
+{
+    return add({Kind::Markup, {}, {}, text});
+}
+
+NodeId MathMLTree::element(std::string_view name, std::string_view attributes, std::initializer_list<NodeId> children)
+{
+    const auto first = static_cast<std::uint32_t>(_children.size());
+    _children.insert(_children.end(), children);
+    return add({Kind::Element, name, attributes, {}, first, static_cast<std::uint32_t>(children.size())});
+}
+
+NodeId MathMLTree::element(std::string_view name, std::string_view attributes, std::size_t mark)
+{
+    const auto count = static_cast<std::uint32_t>(_pending.size() - mark);
+    return add({Kind::Element, name, attributes, {}, takePending(mark), count});
+}
+
+NodeId MathMLTree::fragment(std::size_t mark)
+{
+    if (_pending.size() == mark + 1)
+    {
+        const auto id = _pending.back();
+        _pending.pop_back();
+        return id;
+    }
+
+    const auto count = static_cast<std::uint32_t>(_pending.size() - mark);
+    return add({Kind::Fragment, {}, {}, {}, takePending(mark), count});
+}
+
+template <typename Enter, typename Leave>
+void MathMLTree::walk(NodeId root, OutputSink& out, Enter&& enter, Leave&& leave) const
+{
+    auto& stack = _stack;
+    stack.clear();
+    stack.push_back({root, 0});
+
+    while (!stack.empty())
+    {
+        auto& frame = stack.back();
+        const auto& node = _nodes[frame.node];
+
+        if (frame.next == 0)
+        {
+            enter(frame.node);
+            switch (node.kind)
+            {
+                case Kind::Markup:
+                    out.write(node.text);
+                    leave(frame.node);
+                    stack.pop_back();
+                    continue;
+
+                case Kind::TextElement:
+                    out.write("<");
+                    out.write(node.name);
+                    out.write(node.attributes);
+                    out.write(">");
+                    out.write(node.text);
+                    out.write("</");
+                    out.write(node.name);
+                    out.write(">");
+                    leave(frame.node);
+                    stack.pop_back();
+                    continue;
+
+                case Kind::Element:
+                    out.write("<");
+                    out.write(node.name);
+                    out.write(node.attributes);
+                    out.write(">");
+                    break;
+
+                case Kind::Fragment:
+                    break;
+            }
+        }
+
+        if (frame.next < node.childCount)
+        {
+            const auto child = _children[node.firstChild + frame.next++];
+            stack.push_back({child, 0});
+            continue;
+        }
+
+        if (node.kind == Kind::Element)
+        {
+            out.write("</");
+            out.write(node.name);
+            out.write(">");
+        }
+        leave(frame.node);
+        stack.pop_back();
+    }
+}
+
+void MathMLTree::serialize(NodeId root, OutputSink& out) const
+{
+    const auto skip = [](NodeId) {};
+    walk(root, out, skip, skip);
+}
+
+void MathMLTree::serialize(NodeId root, OutputSink& out, std::size_t offset, std::vector<Span>& spans) const
+{
+    struct Counter final : public OutputSink
+    {
+        Counter(OutputSink& out, std::size_t position)
+            : out(out)
+            , position(position)
+        {
+        }
+
+        void write(std::string_view text) override
+        {
+            out.write(text);
+            position += text.size();
+        }
+
+        OutputSink& out;
+        std::size_t position;
+    };
+
+    spans.assign(_nodes.size(), Span{NOT_WRITTEN, NOT_WRITTEN});
+    Counter counter(out, offset);
+    walk(root, counter,
+         [&](NodeId id) { spans[id].begin = counter.position; },
+         [&](NodeId id) { spans[id].end = counter.position; });
+}
+
+void MathMLTree::serialize(NodeId root, std::string& out) const
+{
+    StringSink sink(out);
+    serialize(root, sink);
+}
+
+std::size_t MathMLTree::serializedSize(NodeId root) const
+{
+    CountingSink sink;
+    serialize(root, sink);
+    return sink.size();
+}
+
+NodeId MathMLTree::add(const Node& node)
+{
+    _nodes.push_back(node);
+    return static_cast<NodeId>(_nodes.size() - 1);
+}
+
+char* MathMLTree::allocate(std::size_t size)
+{
+    while (_chunk < _chunks.size() && _chunkUsed + size > _chunks[_chunk].second)
+    {
+        ++_chunk;
+        _chunkUsed = 0;
+    }
+    if (_chunk == _chunks.size())
+    {
+        const auto capacity = std::max(size, CHUNK_SIZE);
+        _chunks.emplace_back(std::make_unique<char[]>(capacity), capacity);
+        _chunkUsed = 0;
+    }
+
+    char* const result = _chunks[_chunk].first.get() + _chunkUsed;
+    _chunkUsed += size;
+    return result;
+}
+
+std::uint32_t MathMLTree::takePending(std::size_t mark)
+{
+    const auto first = static_cast<std::uint32_t>(_children.size());
+    _children.insert(_children.end(), _pending.begin() + mark, _pending.end());
+    _pending.resize(mark);
+    return first;
+}
+} // namespace TXL
@@ -0,0 +1,151 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <initializer_list>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace TXL
+{
+class OutputSink;
+
+using NodeId = std::uint32_t;
+
+// MathML of one formula. Nodes and their text live in arrays owned by the
+// tree and are dropped all at once by clear(), which keeps the memory for
+// the next formula. Children of a node are a range in one shared index array.
+//
+// Builders collect children on a stack of pending ids: a node takes the ids
+// pushed since a given mark, so nested builders only have to finish in the
+// reverse order they started.
+class MathMLTree final
+{
+public:
+    enum class Kind : std::uint8_t
+    {
+        Element,     // <name attributes>children</name>
+        TextElement, // <name attributes>text</name>
+        Markup,      // text is already serialized MathML
+        Fragment,    // children without a wrapping element
+    };
+
+    struct Node final
+    {
+        Kind kind;
+        std::string_view name;
+        // Written right after the name, so it starts with a space when not empty
+        std::string_view attributes;
+        std::string_view text;
+        std::uint32_t firstChild = 0;
+        std::uint32_t childCount = 0;
+    };
+
+    // Bytes of a node in the serialized output
+    struct Span final
+    {
+        std::size_t begin;
+        std::size_t end;
+    };
+
+    static constexpr std::size_t NOT_WRITTEN = static_cast<std::size_t>(-1);
+
+public:
+    MathMLTree() = default;
+
+    MathMLTree(const MathMLTree&) = delete;
+    MathMLTree& operator=(const MathMLTree&) = delete;
+
+    void clear();
+
+    // Makes room for `nodes` nodes, so the arrays do not grow step by step.
+    // Capacity is kept by clear() anyway.
+    void reserve(std::size_t nodes);
+
+    const Node& node(NodeId id) const
+    {
+        return _nodes[id];
+    }
+
+    NodeId child(const Node& node, std::size_t index) const
+    {
+        return _children[node.firstChild + index];
+    }
+
+    std::size_t size() const
+    {
+        return _nodes.size();
+    }
+
+    // Copies the parts, one after another, into storage that stays valid until clear()
+    std::string_view store(std::initializer_list<std::string_view> parts);
+
+    // Same for text that is only known piece by piece. Only one text can be
+    // open at a time and no store() may happen before it is finished.
+    void startText();
+    void appendText(std::string_view text);
+    std::string_view finishText();
+
+    NodeId textElement(std::string_view name, std::string_view attributes, std::string_view text);
+    NodeId markup(std::string_view text);
+
+    NodeId element(std::string_view name, std::string_view attributes, std::initializer_list<NodeId> children);
+    // Takes the pending ids from `mark` to the top as children
+    NodeId element(std::string_view name, std::string_view attributes, std::size_t mark);
+    // Same as element() without the tag, a single pending id is returned as is
+    NodeId fragment(std::size_t mark);
+
+    std::size_t mark() const
+    {
+        return _pending.size();
+    }
+
+    void push(NodeId id)
+    {
+        _pending.push_back(id);
+    }
+
+    NodeId pending(std::size_t index) const
+    {
+        return _pending[index];
+    }
+
+    // Pieces written to the sink point into the tree or the text given to it
+    void serialize(NodeId root, OutputSink& out) const;
+    void serialize(NodeId root, std::string& out) const;
+    // Also sets spans[id] of every node written, counting from `offset`. The
+    // other nodes get NOT_WRITTEN.
+    void serialize(NodeId root, OutputSink& out, std::size_t offset, std::vector<Span>& spans) const;
+    std::size_t serializedSize(NodeId root) const;
+
+private:
+    struct Frame
+    {
+        NodeId node;
+        std::uint32_t next;
+    };
+
+private:
+    template <typename Enter, typename Leave>
+    void walk(NodeId root, OutputSink& out, Enter&& enter, Leave&& leave) const;
+
+    NodeId add(const Node& node);
+    std::uint32_t takePending(std::size_t mark);
+    char* allocate(std::size_t size);
+
+private:
+    std::vector<Node> _nodes;
+    std::vector<NodeId> _children;
+    std::vector<NodeId> _pending;
+
+    // Text is allocated from chunks so stored views never move
+    std::vector<std::pair<std::unique_ptr<char[]>, std::size_t>> _chunks;
+    std::size_t _chunk = 0;
+    std::size_t _chunkUsed = 0;
+    std::size_t _textBegin = 0;
+
+    mutable std::vector<Frame> _stack;
+};
+} // namespace TXL
@@ -0,0 +1,30 @@
+#pragma once
+
+#include <string>
+
+namespace TXL
+{
+// What goes around the MathML of a formula, see
+// MathMLGenerator::setOptions(). The defaults make a standalone XML document.
+struct OutputOptions final
+{
+    enum class Whitespace
+    {
+        // The prolog and the wrapper tags are on lines of their own and
+        // every document ends with a newline
+        Lines,
+        // No whitespace at all, e.g. to inline formulas into HTML
+        Compact,
+    };
+
+    // <?xml version="1.0" encoding="UTF-8"?>
+    bool prolog = true;
+    // Element around the formula. The attributes are written right after
+    // its name, so they start with a space when not empty.
+    std::string element = "math";
+    std::string attributes = " xmlns=\"http://www.w3.org/1998/Math/MathML\"";
+    // Only the <mrow> of the formula, without prolog and wrapper element
+    bool fragment = false;
+    Whitespace whitespace = Whitespace::Lines;
+};
+} // namespace TXL
@@ -0,0 +1,174 @@
+#include "OutputSink.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <climits>
+#include <system_error>
+
+namespace TXL
+{
+StreamSink::StreamSink(std::ostream& out, std::size_t bufferSize)
+    : _out(out)
+{
+    _buffer.reserve(std::max<std::size_t>(bufferSize, 1));
+}
+
+StreamSink::~StreamSink()
+{
+    drain();
+}
+
+void StreamSink::write(std::string_view text)
+{
+    if (_buffer.size() + text.size() > _buffer.capacity())
+    {
+        drain();
+        if (text.size() >= _buffer.capacity())
+        {
+            _out.write(text.data(), static_cast<std::streamsize>(text.size()));
+            return;
+        }
+    }
+    _buffer.append(text.data(), text.size());
+}
+
+void StreamSink::flush()
+{
+    drain();
+    _out.flush();
+}
+
+void StreamSink::drain()
+{
+    if (!_buffer.empty())
+    {
+        _out.write(_buffer.data(), static_cast<std::streamsize>(_buffer.size()));
+        _buffer.clear();
+    }
+}
+
+#ifdef TXL_HAS_WRITEV
+namespace
+{
+// Retries partial writes, the slices are changed on the way
+void writeSlices(int fd, iovec* slices, std::size_t count)
+{
+#ifdef IOV_MAX
+    const std::size_t maxSlices = IOV_MAX;
+#else
+    const std::size_t maxSlices = 1024;
+#endif
+
+    std::size_t first = 0;
+    while (first < count)
+    {
+        const auto size = std::min(count - first, maxSlices);
+        auto written = ::writev(fd, &slices[first], static_cast<int>(size));
+        if (written < 0)
+        {
+            if (errno == EINTR)
+            {
+                continue;
+            }
+            throw std::system_error(errno, std::generic_category(), "writev");
+        }
+
+        for (auto left = static_cast<std::size_t>(written); left > 0;)
+        {
+            auto& slice = slices[first];
+            if (left >= slice.iov_len)
+            {
+                left -= slice.iov_len;
+                ++first;
+            }
+            else
+            {
+                slice.iov_base = static_cast<char*>(slice.iov_base) + left;
+                slice.iov_len -= left;
+                left = 0;
+            }
+        }
+        // Empty slices left at the end
+        while (first < count && slices[first].iov_len == 0)
+        {
+            ++first;
+        }
+    }
+}
+} // namespace
+
+FdSink::FdSink(int fd, std::size_t bufferSize)
+    : _fd(fd)
+{
+    _buffer.reserve(std::max<std::size_t>(bufferSize, 1));
+}
+
+FdSink::~FdSink()
+{
+    try
+    {
+        flush();
+    }
+    catch (const std::system_error&)
+    {
+    }
+}
+
+void FdSink::write(std::string_view text)
+{
+    if (_buffer.size() + text.size() <= _buffer.capacity())
+    {
+        _buffer.append(text.data(), text.size());
+        return;
+    }
+
+    iovec slices[] = {{_buffer.data(), _buffer.size()}, {const_cast<char*>(text.data()), text.size()}};
+    writeSlices(_fd, slices, 2);
+    _buffer.clear();
+}
+
+void FdSink::flush()
+{
+    if (!_buffer.empty())
+    {
+        iovec slice = {_buffer.data(), _buffer.size()};
+        writeSlices(_fd, &slice, 1);
+        _buffer.clear();
+    }
+}
+
+void IovecSink::write(std::string_view text)
+{
+    if (text.empty())
+    {
+        return;
+    }
+
+    _size += text.size();
+
+    // Pieces that follow each other in memory, like a tag name and its text, share a slice
+    if (!_slices.empty())
+    {
+        auto& last = _slices.back();
+        if (static_cast<const char*>(last.iov_base) + last.iov_len == text.data())
+        {
+            last.iov_len += text.size();
+            return;
+        }
+    }
+    _slices.push_back({const_cast<char*>(text.data()), text.size()});
+}
+
+void IovecSink::writeTo(int fd)
+{
+    writeSlices(fd, _slices.data(), _slices.size());
+    clear();
+}
+
+void IovecSink::clear()
+{
+    _slices.clear();
+    _size = 0;
+}
+#endif
+} // namespace TXL
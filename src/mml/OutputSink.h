@@ -0,0 +1,193 @@
+#pragma once
+
+#include <algorithm>
+#include <cstddef>
+#include <cstring>
+#include <ostream>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#if defined(__unix__) || defined(__APPLE__)
+#include <sys/uio.h>
+#define TXL_HAS_WRITEV 1
+#endif
+
+namespace TXL
+{
+// Receives a document piece by piece while it is serialized, so the whole
+// output never has to exist as one string. Unless a sink says otherwise,
+// a piece is only valid during the write() call.
+class OutputSink
+{
+public:
+    virtual ~OutputSink() = default;
+
+    virtual void write(std::string_view text) = 0;
+
+    // Called after every complete document, or only when asked for, see
+    // MathMLGenerator::setFlushMode()
+    virtual void flush() {}
+
+    // About `size` more bytes are going to be written, a guess that may be
+    // off both ways. Sinks that grow a buffer can make room in one step.
+    virtual void reserve(std::size_t size)
+    {
+        static_cast<void>(size);
+    }
+};
+
+// Writes to a stream through a fixed size buffer. flush() also flushes the stream.
+class StreamSink final : public OutputSink
+{
+public:
+    explicit StreamSink(std::ostream& out, std::size_t bufferSize = 8192);
+    ~StreamSink() override;
+
+    void write(std::string_view text) override;
+    void flush() override;
+
+private:
+    void drain();
+
+private:
+    std::ostream& _out;
+    std::string _buffer;
+};
+
+// Appends to a string of the caller. Clearing it between documents keeps
+// its capacity, so it stops reallocating once it fits the largest one.
+class StringSink final : public OutputSink
+{
+public:
+    explicit StringSink(std::string& out)
+        : _out(out)
+    {
+    }
+
+    void write(std::string_view text) override
+    {
+        _out.append(text.data(), text.size());
+    }
+
+    // Still grows by doubling at least, so documents appended one after
+    // another to the same string do not reallocate every time
+    void reserve(std::size_t size) override
+    {
+        if (_out.size() + size > _out.capacity())
+        {
+            _out.reserve(std::max(_out.size() + size, 2 * _out.capacity()));
+        }
+    }
+
+private:
+    std::string& _out;
+};
+
+// Writes into a fixed buffer of the caller and drops what does not fit,
+// size() still counts all of it, so a second pass knows how much room to give
+class BufferSink final : public OutputSink
+{
+public:
+    BufferSink(char* buffer, std::size_t capacity)
+        : _buffer(buffer)
+        , _capacity(capacity)
+    {
+    }
+
+    void write(std::string_view text) override
+    {
+        if (_size < _capacity)
+        {
+            std::memcpy(_buffer + _size, text.data(), std::min(text.size(), _capacity - _size));
+        }
+        _size += text.size();
+    }
+
+    // Starts over at the beginning of another buffer
+    void reset(char* buffer, std::size_t capacity)
+    {
+        _buffer = buffer;
+        _capacity = capacity;
+        _size = 0;
+    }
+
+    std::size_t size() const
+    {
+        return _size;
+    }
+
+private:
+    char* _buffer;
+    std::size_t _capacity;
+    std::size_t _size = 0;
+};
+
+// Only counts the bytes
+class CountingSink final : public OutputSink
+{
+public:
+    void write(std::string_view text) override
+    {
+        _size += text.size();
+    }
+
+    std::size_t size() const
+    {
+        return _size;
+    }
+
+private:
+    std::size_t _size = 0;
+};
+
+#ifdef TXL_HAS_WRITEV
+// Writes to a file descriptor through a fixed size buffer, bypassing
+// iostreams. A piece that does not fit goes out in one writev() together
+// with the buffer. Throws std::system_error when writing fails.
+class FdSink final : public OutputSink
+{
+public:
+    explicit FdSink(int fd, std::size_t bufferSize = 65536);
+    // Writes out the rest, errors are ignored by then
+    ~FdSink() override;
+
+    void write(std::string_view text) override;
+    void flush() override;
+
+private:
+    const int _fd;
+    std::string _buffer;
+};
+
+// Collects the pieces as a list for writev() without copying them. They
+// point into the memory of the generator, which keeps its own copy of the
+// formula, and stay valid until its next generate() call, so write them
+// out, or copy them, before that.
+class IovecSink final : public OutputSink
+{
+public:
+    void write(std::string_view text) override;
+
+    const std::vector<iovec>& slices() const
+    {
+        return _slices;
+    }
+
+    std::size_t size() const
+    {
+        return _size;
+    }
+
+    // Writes all slices to the file descriptor, retrying partial writes,
+    // and clears the list. Throws std::system_error when writev() fails.
+    void writeTo(int fd);
+
+    void clear();
+
+private:
+    std::vector<iovec> _slices;
+    std::size_t _size = 0;
+};
+#endif
+} // namespace TXL
@@ -0,0 +1,80 @@
+#include "src/mml/BatchConverter.h"
+#include "src/mml/ConversionLimits.h"
+#include "src/mml/MathMLGenerator.h"
+
+#include <gtest/gtest.h>
+
+#include <sstream>
+#include <string>
+#include <vector>
+
+namespace TXL
+{
+using namespace testing;
+
+TEST(BatchConverterTestSuite, keepsInputOrder)
+{
+    std::vector<std::string> formulas;
+    for (int i = 0; i < 500; ++i)
+    {
+        // Mix cheap and expensive formulas so that they finish out of order
+        formulas.push_back(i % 7 == 0
+                           ? "\\begin{pmatrix}" + std::string(200, 'a') + " & \\frac{" + std::to_string(i) + "}{2} \\end{pmatrix}"
+                           : std::to_string(i));
+    }
+
+    std::stringstream expected;
+    MathMLGenerator generator(expected);
+    for (const auto& tex : formulas)
+    {
+        generator.generate(tex);
+    }
+
+    std::stringstream actual;
+    BatchConverter converter(actual, 4, 8);
+    for (const auto& tex : formulas)
+    {
+        converter.add(tex);
+    }
+    converter.finish();
+
+    EXPECT_EQ(expected.str(), actual.str());
+}
+
+TEST(BatchConverterTestSuite, skipsFormulasOverLimits)
+{
+    ConversionLimits limits;
+    limits.maxDepth = 2;
+    const std::string deep = "\\sqrt{\\sqrt{\\sqrt{x}}}";
+
+    std::vector<std::string> formulas;
+    std::stringstream expected;
+    MathMLGenerator generator(expected);
+    for (int i = 0; i < 100; ++i)
+    {
+        formulas.push_back(i % 10 == 3 ? deep : std::to_string(i));
+        if (i % 10 != 3)
+        {
+            generator.generate(formulas.back());
+        }
+    }
+
+    std::stringstream actual;
+    std::vector<std::size_t> failed;
+    BatchConverter converter(actual, 4, 8);
+    converter.setLimits(limits);
+    converter.setLimitHandler([&](std::size_t index, const LimitExceeded& error)
+    {
+        EXPECT_EQ(error.limit(), LimitExceeded::Limit::Depth);
+        failed.push_back(index);
+    });
+    for (const auto& tex : formulas)
+    {
+        converter.add(tex);
+    }
+    converter.finish();
+
+    EXPECT_EQ(expected.str(), actual.str());
+    EXPECT_EQ(failed, (std::vector<std::size_t>{3, 13, 23, 33, 43, 53, 63, 73, 83, 93}));
+}
+} // namespace TXL
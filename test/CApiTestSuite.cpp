@@ -0,0 +1,86 @@
+#include "src/capi/txl.h"
+
+#include <gtest/gtest.h>
+
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace TXL
+{
+using namespace testing;
+
+namespace
+{
+using Generator = std::unique_ptr<txl_generator, decltype(&txl_free)>;
+
+Generator makeGenerator()
+{
+    return Generator(txl_generator_new(), &txl_free);
+}
+
+const std::string FRAC = "<mrow><mfrac><mrow><mn>1</mn></mrow><mrow><mi>x</mi></mrow></mfrac></mrow>";
+} // namespace
+
+TEST(CApiTestSuite, convert)
+{
+    auto gen = makeGenerator();
+    ASSERT_NE(gen, nullptr);
+    txl_set_output(gen.get(), TXL_NO_PROLOG | TXL_COMPACT);
+
+    const std::string tex = "\\frac{1}{x}";
+    const std::string expected = "<math xmlns=\"http://www.w3.org/1998/Math/MathML\">" + FRAC + "</math>";
+    std::vector<char> buffer(256, '#');
+    ASSERT_EQ(txl_convert(gen.get(), tex.data(), tex.size(), buffer.data(), buffer.size()),
+              static_cast<ptrdiff_t>(expected.size()));
+    EXPECT_EQ(std::string(buffer.data(), expected.size()), expected);
+    EXPECT_EQ(buffer[expected.size()], '#');
+    EXPECT_STREQ(txl_last_error(gen.get()), "");
+
+    txl_set_output(gen.get(), TXL_FRAGMENT | TXL_COMPACT);
+    ASSERT_EQ(txl_convert(gen.get(), tex.data(), tex.size(), buffer.data(), buffer.size()),
+              static_cast<ptrdiff_t>(FRAC.size()));
+    EXPECT_EQ(std::string(buffer.data(), FRAC.size()), FRAC);
+}
+
+TEST(CApiTestSuite, smallBuffer)
+{
+    auto gen = makeGenerator();
+    txl_set_output(gen.get(), TXL_FRAGMENT | TXL_COMPACT);
+    const std::string tex = "\\frac{1}{x}";
+
+    // Asking for the size only
+    const auto size = txl_convert(gen.get(), tex.data(), tex.size(), nullptr, 0);
+    ASSERT_EQ(size, static_cast<ptrdiff_t>(FRAC.size()));
+
+    std::vector<char> buffer(10, '#');
+    EXPECT_EQ(txl_convert(gen.get(), tex.data(), tex.size(), buffer.data(), buffer.size()), size);
+    EXPECT_EQ(std::string(buffer.data(), buffer.size()), FRAC.substr(0, buffer.size()));
+
+    buffer.assign(static_cast<std::size_t>(size), '#');
+    EXPECT_EQ(txl_convert(gen.get(), tex.data(), tex.size(), buffer.data(), buffer.size()), size);
+    EXPECT_EQ(std::string(buffer.data(), buffer.size()), FRAC);
+}
+
+TEST(CApiTestSuite, errors)
+{
+    char buffer[16];
+    EXPECT_EQ(txl_convert(nullptr, "x", 1, buffer, sizeof(buffer)), TXL_ERROR_ARGUMENT);
+    EXPECT_STREQ(txl_last_error(nullptr), "");
+
+    auto gen = makeGenerator();
+    EXPECT_EQ(txl_convert(gen.get(), nullptr, 1, buffer, sizeof(buffer)), TXL_ERROR_ARGUMENT);
+    EXPECT_EQ(txl_convert(gen.get(), "x", 1, nullptr, sizeof(buffer)), TXL_ERROR_ARGUMENT);
+    EXPECT_STRNE(txl_last_error(gen.get()), "");
+
+    txl_set_limits(gen.get(), 2, 0, 0, 0);
+    const std::string tex = "\\frac{\\frac{\\frac{1}{2}}{3}}{4}";
+    EXPECT_EQ(txl_convert(gen.get(), tex.data(), tex.size(), nullptr, 0), TXL_ERROR_LIMIT);
+    EXPECT_STRNE(txl_last_error(gen.get()), "");
+
+    // Usable again afterwards
+    txl_set_limits(gen.get(), 0, 0, 0, 0);
+    EXPECT_GT(txl_convert(gen.get(), tex.data(), tex.size(), nullptr, 0), 0);
+    EXPECT_STREQ(txl_last_error(gen.get()), "");
+}
+} // namespace TXL
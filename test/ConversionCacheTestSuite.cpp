@@ -0,0 +1,221 @@
+#include "src/mml/ConversionCache.h"
+#include "src/mml/ConversionLimits.h"
+#include "src/mml/MathMLGenerator.h"
+#include "src/mml/OutputOptions.h"
+#include "src/mml/OutputSink.h"
+
+#include <gtest/gtest.h>
+
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace TXL
+{
+using namespace testing;
+
+namespace
+{
+std::string generate(const std::string& tex, const OutputOptions& options = OutputOptions())
+{
+    std::stringstream out;
+    MathMLGenerator generator(out);
+    generator.setOptions(options);
+    generator.generate(tex);
+    return out.str();
+}
+
+OutputOptions fragment()
+{
+    OutputOptions options;
+    options.fragment = true;
+    options.whitespace = OutputOptions::Whitespace::Compact;
+    return options;
+}
+} // namespace
+
+TEST(ConversionCacheTestSuite, hitsIgnoreWhitespace)
+{
+    auto cache = std::make_shared<ConversionCache>();
+    std::stringstream out;
+    MathMLGenerator generator(out);
+    generator.setCache(cache);
+
+    generator.generate("\\frac{1}{2} + x^2");
+    generator.generate("\\frac{1}{2}+x ^ 2");
+    generator.generate("\\frac{1}{2}+x^3");
+
+    EXPECT_EQ(out.str(), generate("\\frac{1}{2} + x^2") + generate("\\frac{1}{2} + x^2") + generate("\\frac{1}{2}+x^3"));
+
+    const auto stats = cache->stats();
+    EXPECT_EQ(stats.hits, 1u);
+    EXPECT_EQ(stats.misses, 2u);
+    EXPECT_EQ(stats.entries, 2u);
+}
+
+TEST(ConversionCacheTestSuite, keyKeepsTokenBoundaries)
+{
+    auto cache = std::make_shared<ConversionCache>();
+    std::stringstream out;
+    MathMLGenerator generator(out);
+    generator.setCache(cache);
+
+    generator.generate("\\alpha b");
+    generator.generate("\\alphab");
+    EXPECT_EQ(cache->stats().hits, 0u);
+    EXPECT_EQ(out.str(), generate("\\alpha b") + generate("\\alphab"));
+}
+
+TEST(ConversionCacheTestSuite, evictsLeastRecentlyUsed)
+{
+    // Single letters are written without the cache, and only the <mrow> is kept
+    const auto formulaSize = generate("-a", fragment()).size();
+    // Room for two entries
+    auto cache = std::make_shared<ConversionCache>(2 * formulaSize + 64);
+    std::stringstream out;
+    MathMLGenerator generator(out);
+    generator.setCache(cache);
+
+    generator.generate("-a");
+    generator.generate("-b");
+    generator.generate("-a");
+    generator.generate("-c");
+    EXPECT_EQ(cache->stats().evictions, 1u);
+
+    generator.generate("-a");
+    generator.generate("-b");
+    const auto stats = cache->stats();
+    EXPECT_EQ(stats.hits, 2u);
+    EXPECT_EQ(stats.misses, 4u);
+    EXPECT_EQ(stats.entries, 2u);
+}
+
+TEST(ConversionCacheTestSuite, skipsLargeDocuments)
+{
+    auto cache = std::make_shared<ConversionCache>(1 << 20, 64);
+    std::stringstream out;
+    MathMLGenerator generator(out);
+    generator.setCache(cache);
+
+    generator.generate("\\frac{a}{b}");
+    generator.generate("\\frac{a}{b}");
+    EXPECT_EQ(cache->stats().entries, 0u);
+    EXPECT_EQ(out.str(), generate("\\frac{a}{b}") + generate("\\frac{a}{b}"));
+}
+
+TEST(ConversionCacheTestSuite, sharedBetweenOptions)
+{
+    auto cache = std::make_shared<ConversionCache>();
+    std::stringstream documentOut;
+    std::stringstream fragmentOut;
+    MathMLGenerator documentGenerator(documentOut);
+    MathMLGenerator fragmentGenerator(fragmentOut);
+    documentGenerator.setCache(cache);
+    fragmentGenerator.setCache(cache);
+    fragmentGenerator.setOptions(fragment());
+
+    documentGenerator.generate("\\frac{a}{b}");
+    fragmentGenerator.generate("\\frac{a}{b}");
+    EXPECT_EQ(cache->stats().hits, 1u);
+    EXPECT_EQ(documentOut.str(), generate("\\frac{a}{b}"));
+    EXPECT_EQ(fragmentOut.str(), generate("\\frac{a}{b}", fragment()));
+}
+
+TEST(ConversionCacheTestSuite, hitsKeepLimits)
+{
+    auto cache = std::make_shared<ConversionCache>();
+    std::stringstream out;
+    MathMLGenerator generator(out);
+    generator.setCache(cache);
+    const std::string tex = "\\frac{\\sqrt{2}}{x}";
+
+    generator.generate(tex);
+    ConversionLimits limits;
+    limits.maxDepth = 1;
+    generator.setLimits(limits);
+    EXPECT_THROW(generator.generate(tex), LimitExceeded);
+
+    // Converted once under the same limits, later calls are hits
+    limits.maxDepth = 2;
+    generator.setLimits(limits);
+    generator.generate(tex);
+    const auto hits = cache->stats().hits;
+    generator.generate(tex);
+    EXPECT_EQ(cache->stats().hits, hits + 1);
+
+    limits.maxDepth = 1;
+    generator.setLimits(limits);
+    EXPECT_THROW(generator.generate(tex), LimitExceeded);
+}
+
+#ifdef TXL_HAS_WRITEV
+TEST(ConversionCacheTestSuite, hitOutlivesEviction)
+{
+    const std::string tex = "\\frac{a}{b}";
+    const auto expected = generate(tex);
+    auto cache = std::make_shared<ConversionCache>();
+    std::stringstream out;
+    IovecSink sink;
+    MathMLGenerator writer(out);
+    MathMLGenerator reader(sink);
+    writer.setCache(cache);
+    reader.setCache(cache);
+
+    writer.generate(tex);
+    reader.generate(tex);
+    EXPECT_EQ(cache->stats().hits, 1u);
+
+    // The other generator drops the entry the slices point into, and its
+    // memory is likely reused
+    cache->clear();
+    std::vector<std::string> garbage(16, std::string(expected.size(), '#'));
+    writer.generate("\\sqrt{c}");
+
+    std::string joined;
+    for (const auto& slice : sink.slices())
+    {
+        joined.append(static_cast<const char*>(slice.iov_base), slice.iov_len);
+    }
+    EXPECT_EQ(joined, expected);
+}
+#endif
+
+TEST(ConversionCacheTestSuite, sharedBetweenThreads)
+{
+    const std::vector<std::string> formulas = {"x^2", "2\\alpha", "\\frac{1}{2}", "\\sqrt{y}"};
+    std::string expected;
+    for (int i = 0; i < 100; ++i)
+    {
+        expected += generate(formulas[i % formulas.size()]);
+    }
+
+    auto cache = std::make_shared<ConversionCache>();
+    std::vector<std::stringstream> outputs(4);
+    std::vector<std::thread> threads;
+    for (auto& out : outputs)
+    {
+        threads.emplace_back([&]
+        {
+            MathMLGenerator generator(out);
+            generator.setCache(cache);
+            for (int i = 0; i < 100; ++i)
+            {
+                generator.generate(formulas[i % formulas.size()]);
+            }
+        });
+    }
+    for (auto& thread : threads)
+    {
+        thread.join();
+    }
+
+    for (const auto& out : outputs)
+    {
+        EXPECT_EQ(out.str(), expected);
+    }
+    const auto stats = cache->stats();
+    EXPECT_EQ(stats.hits + stats.misses, 400u);
+    EXPECT_EQ(stats.entries, formulas.size());
+}
+} // namespace TXL
@@ -0,0 +1,128 @@
+#include "src/mml/ConversionLimits.h"
+#include "src/mml/MathMLGenerator.h"
+
+#include <gtest/gtest.h>
+
+#include <sstream>
+#include <string>
+
+namespace TXL
+{
+using namespace testing;
+
+namespace
+{
+std::string nested(const std::string& open, std::size_t depth)
+{
+    std::string tex;
+    for (std::size_t i = 0; i < depth; ++i)
+    {
+        tex += open;
+    }
+    tex += "x";
+    tex.append(depth, '}');
+    return tex;
+}
+
+LimitExceeded::Limit limitOf(MathMLGenerator& generator, const std::string& tex)
+{
+    try
+    {
+        generator.generate(tex);
+    }
+    catch (const LimitExceeded& e)
+    {
+        return e.limit();
+    }
+    ADD_FAILURE() << "no limit exceeded";
+    return LimitExceeded::Limit::Depth;
+}
+} // namespace
+
+TEST(ConversionLimitsTestSuite, depth)
+{
+    std::stringstream ss;
+    MathMLGenerator generator(ss);
+
+    ConversionLimits limits;
+    limits.maxDepth = 3;
+    generator.setLimits(limits);
+    EXPECT_NO_THROW(generator.generate(nested("\\frac{1}{", 3)));
+    EXPECT_EQ(limitOf(generator, nested("\\frac{1}{", 4)), LimitExceeded::Limit::Depth);
+    EXPECT_EQ(limitOf(generator, "\\begin{matrix}\\begin{matrix}\\sqrt{\\sqrt{x}}\\end{matrix}\\end{matrix}"),
+              LimitExceeded::Limit::Depth);
+}
+
+TEST(ConversionLimitsTestSuite, tokensAndOutput)
+{
+    std::stringstream ss;
+    MathMLGenerator generator(ss);
+
+    ConversionLimits limits;
+    limits.maxTokens = 3;
+    generator.setLimits(limits);
+    EXPECT_NO_THROW(generator.generate("a+b"));
+    EXPECT_EQ(limitOf(generator, "a+b+c"), LimitExceeded::Limit::Tokens);
+
+    generator.generate("x");
+    const auto size = ss.str().size() - ss.str().rfind("<?xml");
+
+    limits = ConversionLimits();
+    limits.maxOutputBytes = size;
+    generator.setLimits(limits);
+    EXPECT_NO_THROW(generator.generate("y"));
+    EXPECT_EQ(limitOf(generator, "xy"), LimitExceeded::Limit::OutputBytes);
+}
+
+TEST(ConversionLimitsTestSuite, time)
+{
+    std::string tex;
+    for (int i = 0; i < 200000; ++i)
+    {
+        tex += "\\frac{a}{b} + ";
+    }
+
+    std::stringstream ss;
+    MathMLGenerator generator(ss);
+    ConversionLimits limits;
+    limits.maxTime = std::chrono::milliseconds(1);
+    generator.setLimits(limits);
+    EXPECT_EQ(limitOf(generator, tex), LimitExceeded::Limit::Time);
+}
+
+TEST(ConversionLimitsTestSuite, generatorStaysUsable)
+{
+    std::stringstream expected;
+    MathMLGenerator(expected).generate("\\frac{1}{x}");
+
+    std::stringstream ss;
+    MathMLGenerator generator(ss);
+    ConversionLimits limits;
+    limits.maxDepth = 1;
+    generator.setLimits(limits);
+    EXPECT_EQ(limitOf(generator, "\\frac{\\sqrt{2}}{x}"), LimitExceeded::Limit::Depth);
+
+    // Nothing of the failed formula is left before the next one
+    generator.generate("\\frac{1}{x}");
+    EXPECT_EQ(ss.str(), expected.str());
+}
+
+TEST(ConversionLimitsTestSuite, failedFormulaWritesNothing)
+{
+    std::stringstream ss;
+    MathMLGenerator generator(ss);
+    ConversionLimits limits;
+    limits.maxDepth = 3;
+    generator.setLimits(limits);
+
+    // The prolog and <mi>a</mi> come before the formula gets too deep
+    EXPECT_EQ(limitOf(generator, "a+" + nested("\\frac{2}{", 4)), LimitExceeded::Limit::Depth);
+    EXPECT_EQ(ss.str(), "");
+
+    limits = ConversionLimits();
+    limits.maxOutputBytes = 200;
+    generator.setLimits(limits);
+    EXPECT_EQ(limitOf(generator, "a+b+c+d+e+f+g+h+i+j+k+l+m+n"), LimitExceeded::Limit::OutputBytes);
+    EXPECT_EQ(ss.str(), "");
+}
+} // namespace TXL
@@ -0,0 +1,71 @@
+#include "src/mml/ConversionStats.h"
+#include "src/mml/MathMLGenerator.h"
+
+#include <gtest/gtest.h>
+
+#include <sstream>
+#include <string>
+
+namespace TXL
+{
+using namespace testing;
+
+TEST(ConversionStatsTestSuite, countsConversion)
+{
+    if (!ConversionStats::ENABLED)
+    {
+        GTEST_SKIP() << "built without TXL_STATS";
+    }
+
+    std::stringstream ss;
+    ConversionStats stats;
+    MathMLGenerator generator(ss);
+    generator.setStats(&stats);
+    generator.generate("\\frac{\\sqrt{x}}{2} + \\begin{matrix} a & \\frac{1}{b} \\end{matrix}");
+
+    EXPECT_EQ(stats.formulas, 1u);
+    EXPECT_EQ(stats.tokens[COMMAND], 3u);
+    EXPECT_EQ(stats.tokens[BEGIN_ENV], 1u);
+    EXPECT_EQ(stats.tokens[END_ENV], 1u);
+    EXPECT_EQ(stats.tokens[END], 1u);
+    EXPECT_EQ(stats.commands.at("frac"), 2u);
+    EXPECT_EQ(stats.commands.at("sqrt"), 1u);
+    EXPECT_EQ(stats.environments.at("matrix"), 1u);
+    // \frac holding \sqrt, and \frac inside the matrix
+    EXPECT_EQ(stats.maxDepth, 2u);
+    EXPECT_EQ(stats.outputBytes, ss.str().size());
+
+    // Without stats nothing is counted
+    generator.setStats(nullptr);
+    generator.generate("\\frac{1}{2}");
+    EXPECT_EQ(stats.formulas, 1u);
+    EXPECT_EQ(stats.commands.at("frac"), 2u);
+}
+
+TEST(ConversionStatsTestSuite, sumAndJson)
+{
+    ConversionStats stats;
+    stats.formulas = 1;
+    stats.tokens[DIGIT] = 2;
+    stats.maxDepth = 3;
+    ConversionStats::count(stats.commands, "frac");
+
+    ConversionStats other;
+    other.formulas = 2;
+    other.maxDepth = 1;
+    ConversionStats::count(other.commands, "frac");
+    ConversionStats::count(other.environments, "a\"b");
+
+    stats += other;
+    EXPECT_EQ(stats.formulas, 3u);
+    EXPECT_EQ(stats.maxDepth, 3u);
+    EXPECT_EQ(stats.commands.at("frac"), 2u);
+
+    std::ostringstream json;
+    stats.writeJson(json);
+    EXPECT_NE(json.str().find("\"formulas\": 3"), std::string::npos);
+    EXPECT_NE(json.str().find("\"DIGIT\": 2"), std::string::npos);
+    EXPECT_NE(json.str().find("\"commands\": {\"frac\": 2}"), std::string::npos);
+    EXPECT_NE(json.str().find("\"environments\": {\"a\\\"b\": 1}"), std::string::npos);
+}
+} // namespace TXL
@@ -0,0 +1,132 @@
+#include "src/mml/EditSession.h"
+#include "src/mml/MathMLGenerator.h"
+#include "src/mml/OutputOptions.h"
+
+#include <gtest/gtest.h>
+
+#include <random>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+namespace TXL
+{
+using namespace testing;
+
+namespace
+{
+std::string generate(const std::string& tex, const OutputOptions& options = OutputOptions())
+{
+    std::stringstream out;
+    MathMLGenerator generator(out);
+    generator.setOptions(options);
+    generator.generate(tex);
+    return out.str();
+}
+
+std::string applyPatch(std::string document, const EditSession::Patch& patch)
+{
+    return document.replace(patch.offset, patch.removed, patch.inserted.data(), patch.inserted.size());
+}
+} // namespace
+
+TEST(EditSessionTestSuite, patchesEnclosingGroup)
+{
+    const std::string head = "a + \\frac{1}{x";
+    const std::string tail = "} + \\sqrt{b} + c";
+    EditSession session(head + tail);
+    EXPECT_EQ(session.document(), generate(head + tail));
+
+    const auto before = session.document();
+    const auto patch = session.apply({head.size(), 0, "+y"});
+    EXPECT_EQ(session.text(), head + "+y" + tail);
+    EXPECT_EQ(session.document(), generate(session.text()));
+    EXPECT_EQ(applyPatch(before, patch), session.document());
+
+    // Only the denominator is written again
+    EXPECT_EQ(patch.inserted, "<mrow><mi>x</mi><mo>+</mo><mi>y</mi></mrow>");
+}
+
+TEST(EditSessionTestSuite, patchesTopLevel)
+{
+    EditSession session("a + b + c");
+    const auto before = session.document();
+    const auto patch = session.apply({4, 1, "x^2"});
+    EXPECT_EQ(session.text(), "a + x^2 + c");
+    EXPECT_EQ(session.document(), generate(session.text()));
+    EXPECT_EQ(applyPatch(before, patch), session.document());
+
+    // From the child before the edit to the first one after it that stays
+    EXPECT_EQ(patch.inserted, "<mo>+</mo><msup><mrow><mi>x</mi></mrow><mrow><mn>2</mn></mrow></msup>");
+}
+
+TEST(EditSessionTestSuite, environments)
+{
+    EditSession session("\\begin{pmatrix} a & b \\\\ c & d \\end{pmatrix} + x");
+    const auto before = session.document();
+    const auto patch = session.apply({20, 1, "\\alpha"});
+    EXPECT_EQ(session.text(), "\\begin{pmatrix} a & \\alpha \\\\ c & d \\end{pmatrix} + x");
+    EXPECT_EQ(session.document(), generate(session.text()));
+    EXPECT_EQ(applyPatch(before, patch), session.document());
+    EXPECT_EQ(patch.inserted.substr(0, 8), "<mfenced");
+}
+
+TEST(EditSessionTestSuite, options)
+{
+    OutputOptions options;
+    options.fragment = true;
+    options.whitespace = OutputOptions::Whitespace::Compact;
+    EditSession session("a + \\frac{1}{x}", options);
+    EXPECT_EQ(session.document(), generate(session.text(), options));
+
+    const auto before = session.document();
+    const auto patch = session.apply({13, 0, "+y"});
+    EXPECT_EQ(session.document(), generate(session.text(), options));
+    EXPECT_EQ(applyPatch(before, patch), session.document());
+
+    options.prolog = false;
+    options.fragment = false;
+    options.whitespace = OutputOptions::Whitespace::Lines;
+    EditSession wrapped("x^2", options);
+    EXPECT_EQ(wrapped.document(), generate("x^2", options));
+
+    options.element.clear();
+    EXPECT_THROW(EditSession("x", options), std::invalid_argument);
+}
+
+TEST(EditSessionTestSuite, outsideOfText)
+{
+    EditSession session("abc");
+    EXPECT_THROW(session.apply({4, 0, "x"}), std::out_of_range);
+    EXPECT_THROW(session.apply({2, 2, ""}), std::out_of_range);
+    EXPECT_EQ(session.document(), generate("abc"));
+}
+
+TEST(EditSessionTestSuite, randomEdits)
+{
+    const std::vector<std::string> pieces = {
+        "a", "1", " ", "{", "}", "[", "]", "^", "_", "+", "\\", "\\frac", "\\sqrt", "\\mathbb", "\\left(", "\\right)",
+        "\\begin{pmatrix}", "\\end{pmatrix}", "&", "\\\\", "\\mbox{", "xy", "EOF", "\\sum", "\\limits", "\\alpha"};
+
+    std::mt19937 rng(7);
+    EditSession session("\\frac{a+b}{\\sqrt{c}} + \\left( x^{2} \\right) \\begin{pmatrix} 1 & 2 \\end{pmatrix}");
+    for (int i = 0; i < 3000; ++i)
+    {
+        const auto& text = session.text();
+        const auto offset = text.empty() ? 0 : rng() % (text.size() + 1);
+        const auto removed = (rng() % 3 == 0 && offset < text.size()) ? rng() % std::min<std::size_t>(4, text.size() - offset) + 1 : 0;
+        const auto& inserted = rng() % 4 == 0 ? std::string() : pieces[rng() % pieces.size()];
+
+        const auto before = session.document();
+        const auto patch = session.apply({offset, removed, inserted});
+        ASSERT_EQ(session.document(), generate(session.text())) << session.text();
+        ASSERT_EQ(applyPatch(before, patch), session.document());
+
+        if (session.text().size() > 400)
+        {
+            session.apply({0, 200, ""});
+        }
+    }
+}
+} // namespace TXL
@@ -0,0 +1,66 @@
+#include "src/FormulaReader.h"
+
+#include <gtest/gtest.h>
+
+#include <sstream>
+#include <stdexcept>
+#include <vector>
+
+namespace TXL
+{
+using namespace testing;
+
+namespace
+{
+std::vector<std::string> readAll(const std::string& input, FormulaReader::Format format,
+                                 const std::string& delimiter = std::string())
+{
+    std::istringstream in(input);
+    FormulaReader reader(in, format, delimiter);
+
+    std::vector<std::string> result;
+    for (std::string tex; reader.next(tex);)
+    {
+        result.push_back(tex);
+    }
+    return result;
+}
+} // namespace
+
+TEST(FormulaReaderTestSuite, lines)
+{
+    EXPECT_EQ((std::vector<std::string>{"x^2", "", "\\alpha"}),
+              readAll("x^2\n\n\\alpha\n", FormulaReader::Format::Lines));
+}
+
+TEST(FormulaReaderTestSuite, delimited)
+{
+    EXPECT_EQ((std::vector<std::string>{"\\begin{matrix}\na & b\n\\end{matrix}", "x"}),
+              readAll("\\begin{matrix}\na & b\n\\end{matrix}\n%%\nx\n", FormulaReader::Format::Delimited, "%%"));
+    EXPECT_EQ((std::vector<std::string>{"x", "y"}),
+              readAll("x\r\n%%\r\ny\r\n%%\r\n", FormulaReader::Format::Delimited, "%%"));
+}
+
+TEST(FormulaReaderTestSuite, jsonLines)
+{
+    EXPECT_EQ((std::vector<std::string>{"\\frac{1}{2}", "a\"b", "\xCE\xB1\xF0\x9D\x94\xB8", "y"}),
+              readAll("{\"id\": 1, \"tex\": \"\\\\frac{1}{2}\"}\n"
+                      "\n"
+                      "{\"meta\": {\"tags\": [1, \"}\", null]}, \"tex\": \"a\\\"b\"}\n"
+                      "{\"tex\": \"\\u03b1\\ud835\\udd38\"}\n"
+                      "\"y\"\n",
+                      FormulaReader::Format::JsonLines));
+}
+
+TEST(FormulaReaderTestSuite, malformedJson)
+{
+    EXPECT_THROW(readAll("{\"tex\": 1}\n", FormulaReader::Format::JsonLines), std::runtime_error);
+    EXPECT_THROW(readAll("{\"tex\": \"x\"\n", FormulaReader::Format::JsonLines), std::runtime_error);
+
+    // Unpaired surrogates
+    EXPECT_THROW(readAll("{\"tex\": \"\\ud835\"}\n", FormulaReader::Format::JsonLines), std::runtime_error);
+    EXPECT_THROW(readAll("{\"tex\": \"\\ud835x\"}\n", FormulaReader::Format::JsonLines), std::runtime_error);
+    EXPECT_THROW(readAll("{\"tex\": \"\\ud835\\u0041\"}\n", FormulaReader::Format::JsonLines), std::runtime_error);
+    EXPECT_THROW(readAll("{\"tex\": \"\\udd38\"}\n", FormulaReader::Format::JsonLines), std::runtime_error);
+}
+} // namespace TXL
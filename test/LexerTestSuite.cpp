@@ -2,6 +2,11 @@
 
 #include <gtest/gtest.h>
 
+#include <cstdint>
+#include <limits>
+#include <stdexcept>
+#include <vector>
+
 namespace TXL
 {
 using namespace testing;
@@ -11,6 +16,11 @@ std::ostream& operator<<(std::ostream& stream, const Token& t)
     return stream << "(type: " << t.type << ", content: " << t.content << ")" << std::endl;
 }
 
+std::ostream& operator<<(std::ostream& stream, const TokenView& t)
+{
+    return stream << "(type: " << t.type << ", content: " << t.content << ")" << std::endl;
+}
+
 TEST(LexerTestSuite, parseSQRT)
 {
     const std::string str = "$$\\sqrt[3]{(x-y)^4}=x+y$$";
@@ -62,4 +72,112 @@ TEST(LexerTestSuite, parsePrime)
     EXPECT_EQ((Token{TEXT, "text"}), lexer.next());
     EXPECT_EQ((Token{SIGN, "'"}), lexer.next());
 }
+
+TEST(LexerTestSuite, parseView)
+{
+    const std::string str = "\\frac{a}{42}";
+    Lexer lexer(str);
+
+    std::vector<TokenView> tokens;
+    for (auto t = lexer.nextView(); t.type != END; t = lexer.nextView())
+    {
+        tokens.push_back(t);
+    }
+
+    ASSERT_EQ(7u, tokens.size());
+    EXPECT_EQ((TokenView{COMMAND, "frac"}), tokens[0]);
+    EXPECT_EQ((TokenView{START_GROUP, "{"}), tokens[1]);
+    EXPECT_EQ((TokenView{TEXT, "a"}), tokens[2]);
+    EXPECT_EQ((TokenView{END_GROUP, "}"}), tokens[3]);
+    EXPECT_EQ((TokenView{START_GROUP, "{"}), tokens[4]);
+    EXPECT_EQ((TokenView{DIGIT, "42"}), tokens[5]);
+    EXPECT_EQ((TokenView{END_GROUP, "}"}), tokens[6]);
+}
+
+TEST(LexerTestSuite, tokenize)
+{
+    const std::string str = "$x^{12}$";
+    Lexer lexer;
+    TokenArray tokens;
+    lexer.tokenize(str, tokens);
+
+    ASSERT_EQ(6u, tokens.size());
+    EXPECT_EQ((std::vector<std::uint8_t>{TEXT, SIGN, START_GROUP, DIGIT, END_GROUP, END}), tokens.types);
+    EXPECT_EQ((std::vector<std::uint32_t>{1, 2, 3, 4, 6, 8}), tokens.offsets);
+    EXPECT_EQ((std::vector<std::uint32_t>{1, 1, 1, 2, 1, 0}), tokens.lengths);
+    EXPECT_EQ((TokenView{DIGIT, "12"}), tokens[3]);
+
+    const std::string other = "\\alpha";
+    lexer.tokenize(other, tokens);
+
+    ASSERT_EQ(2u, tokens.size());
+    EXPECT_EQ((TokenView{COMMAND, "alpha"}), tokens[0]);
+    EXPECT_EQ((TokenView{END, ""}), tokens[1]);
+}
+
+TEST(LexerTestSuite, tokenizeStopsAtEOF)
+{
+    Lexer lexer;
+    TokenArray tokens;
+    lexer.tokenize("a+EOF b", tokens);
+
+    EXPECT_EQ((std::vector<std::uint8_t>{TEXT, SIGN, END}), tokens.types);
+    EXPECT_EQ(2u, tokens.offsets[2]);
+    EXPECT_EQ(0u, tokens.lengths[2]);
+}
+
+TEST(LexerTestSuite, nameIds)
+{
+    const std::string str = "\\frac\\foo\\begin{pmatrix}x\\end{pmatrix}";
+    Lexer lexer;
+    TokenArray tokens;
+    lexer.tokenize(str, tokens);
+
+    ASSERT_EQ(6u, tokens.size());
+    EXPECT_EQ(commandId("frac"), tokens[0].id);
+    EXPECT_NE(NO_NAME, tokens[0].id);
+    EXPECT_EQ(NO_NAME, tokens[1].id);
+    EXPECT_EQ(environmentId("pmatrix"), tokens[2].id);
+    EXPECT_NE(NO_NAME, tokens[2].id);
+    EXPECT_EQ(NO_NAME, tokens[3].id);
+    EXPECT_EQ(tokens[2].id, tokens[4].id);
+
+    // The same without the array
+    lexer.reset(str);
+    EXPECT_EQ(tokens[0].id, lexer.nextView().id);
+    EXPECT_EQ(NO_NAME, lexer.nextView().id);
+}
+
+TEST(LexerTestSuite, reset)
+{
+    Lexer lexer;
+
+    lexer.reset("\\begin{matrix");
+    EXPECT_EQ((Token{BEGIN_ENV, "matrix"}), lexer.next());
+    EXPECT_EQ(END, lexer.next().type);
+
+    // Scanning starts over in the initial state
+    lexer.reset("{x}");
+    EXPECT_EQ((Token{START_GROUP, "{"}), lexer.next());
+    EXPECT_EQ((Token{TEXT, "x"}), lexer.next());
+    EXPECT_EQ((Token{END_GROUP, "}"}), lexer.next());
+    EXPECT_EQ(END, lexer.next().type);
+
+    char buffer[] = "a+1\0";
+    lexer.reset(buffer, sizeof(buffer));
+    const auto first = lexer.nextView();
+    EXPECT_EQ((TokenView{TEXT, "a"}), first);
+    EXPECT_EQ(buffer, first.content.data());
+    EXPECT_EQ((Token{SIGN, "+"}), lexer.next());
+    EXPECT_EQ((Token{DIGIT, "1"}), lexer.next());
+    EXPECT_EQ(END, lexer.next().type);
+
+    char unterminated[] = {'x', '\0', 'y'};
+    EXPECT_THROW(lexer.reset(unterminated, sizeof(unterminated)), std::invalid_argument);
+
+    // Offsets would not fit into 32 bit, checked before the text is read
+    const std::size_t tooLarge = std::size_t(std::numeric_limits<std::uint32_t>::max()) - 1;
+    EXPECT_THROW(lexer.reset(std::string_view(buffer, tooLarge)), std::length_error);
+    EXPECT_THROW(lexer.reset(buffer, tooLarge + 2), std::length_error);
+}
 } // namespace TXL
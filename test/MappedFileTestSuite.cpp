@@ -0,0 +1,68 @@
+#include "src/MappedFile.h"
+
+#include <gtest/gtest.h>
+
+#include <cstdio>
+#include <fstream>
+#include <string>
+#include <system_error>
+
+namespace TXL
+{
+using namespace testing;
+
+namespace
+{
+const std::string PATH = "MappedFileTestSuite.tex";
+
+void writeFile(const std::string& text)
+{
+    std::ofstream(PATH, std::ios::binary) << text;
+}
+} // namespace
+
+TEST(MappedFileTestSuite, endsWithTwoNuls)
+{
+    // Sizes around a page, where the NUL bytes come from the next one
+    for (const std::size_t size : {0, 1, 4094, 4095, 4096, 4097, 8192})
+    {
+        const std::string text(size, 'x');
+        writeFile(text);
+
+        MappedFile file(PATH);
+        EXPECT_EQ(file.text(), text);
+        ASSERT_EQ(file.bufferSize(), size + 2);
+        EXPECT_EQ(file.buffer()[size], '\0');
+        EXPECT_EQ(file.buffer()[size + 1], '\0');
+    }
+
+    // Writes stay private
+    writeFile("abc");
+    MappedFile file(PATH);
+    file.buffer()[0] = 'y';
+    EXPECT_EQ(MappedFile(PATH).text(), "abc");
+
+    std::remove(PATH.c_str());
+}
+
+TEST(MappedFileTestSuite, readOnly)
+{
+    for (const std::size_t size : {0, 4095, 4096})
+    {
+        const std::string text(size, 'x');
+        writeFile(text);
+
+        MappedFile file(PATH, MappedFile::Access::ReadOnly);
+        EXPECT_EQ(file.text(), text);
+        ASSERT_EQ(file.bufferSize(), size + 2);
+        EXPECT_EQ(file.buffer()[size], '\0');
+        EXPECT_EQ(file.buffer()[size + 1], '\0');
+    }
+    std::remove(PATH.c_str());
+}
+
+TEST(MappedFileTestSuite, missingFile)
+{
+    EXPECT_THROW(MappedFile("MappedFileTestSuite.missing"), std::system_error);
+}
+} // namespace TXL
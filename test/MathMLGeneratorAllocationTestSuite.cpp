@@ -0,0 +1,103 @@
+#include "src/mml/MathMLGenerator.h"
+
+#include <gtest/gtest.h>
+
+#include <atomic>
+#include <cstdlib>
+#include <new>
+#include <ostream>
+#include <streambuf>
+#include <string>
+
+namespace
+{
+std::atomic<bool> countAllocations{false};
+std::atomic<std::size_t> allocations{0};
+
+// Every replaced form goes through malloc() and free(), so they pair up
+// whichever of them the compiler picks
+void* allocate(std::size_t size)
+{
+    if (countAllocations)
+    {
+        ++allocations;
+    }
+    if (void* memory = std::malloc(size ? size : 1))
+    {
+        return memory;
+    }
+    throw std::bad_alloc();
+}
+} // namespace
+
+void* operator new(std::size_t size)
+{
+    return allocate(size);
+}
+
+void* operator new[](std::size_t size)
+{
+    return allocate(size);
+}
+
+void operator delete(void* memory) noexcept
+{
+    std::free(memory);
+}
+
+void operator delete(void* memory, std::size_t) noexcept
+{
+    std::free(memory);
+}
+
+void operator delete[](void* memory) noexcept
+{
+    std::free(memory);
+}
+
+void operator delete[](void* memory, std::size_t) noexcept
+{
+    std::free(memory);
+}
+
+namespace TXL
+{
+using namespace testing;
+
+namespace
+{
+class NullBuffer final : public std::streambuf
+{
+protected:
+    int overflow(int c) override
+    {
+        return c;
+    }
+
+    std::streamsize xsputn(const char*, std::streamsize count) override
+    {
+        return count;
+    }
+};
+} // namespace
+
+TEST(MathMLGeneratorAllocationTestSuite, noAllocationsOnceWarm)
+{
+    const std::string tex =
+        "\\frac{\\sqrt[3]{x}}{\\sum_{i=0}^{n} a_i} + \\left( \\mathbb{NQZ} \\right)^2"
+        "\\begin{pmatrix} a & \\mbox{some words} \\\\ \\textcolor{#ff00ff}{c} & \\binom{n}{k} \\end{pmatrix}"
+        "\\int\\limits_0^1 \\vec{v} \\quad \\overset{!}{=} \\genfrac{(}{)}{0pt}{}{a}{b}";
+
+    NullBuffer buffer;
+    std::ostream out(&buffer);
+    MathMLGenerator generator(out);
+    generator.generate(tex);
+
+    allocations = 0;
+    countAllocations = true;
+    generator.generate(tex);
+    countAllocations = false;
+
+    EXPECT_EQ(allocations, 0u);
+}
+} // namespace TXL
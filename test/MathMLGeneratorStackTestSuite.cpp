@@ -0,0 +1,91 @@
+#include "src/mml/MathMLGenerator.h"
+
+#include <gtest/gtest.h>
+
+#include <cstddef>
+#include <sstream>
+#include <string>
+
+#if defined(__unix__) || defined(__APPLE__)
+#include <pthread.h>
+#endif
+
+namespace TXL
+{
+using namespace testing;
+
+namespace
+{
+constexpr std::size_t DEPTH = 100000;
+
+// Fractions in square roots in matrices, each level nested in the one before
+std::string deepFormula()
+{
+    std::string tex;
+    for (std::size_t i = 0; i < DEPTH; ++i)
+    {
+        tex += i % 3 == 0 ? "\\frac{1}{" : i % 3 == 1 ? "\\sqrt{" : "\\begin{pmatrix}a & ";
+    }
+    tex += "x";
+    for (std::size_t i = DEPTH; i-- > 0;)
+    {
+        tex += i % 3 == 2 ? "\\end{pmatrix}" : "}";
+    }
+    return tex;
+}
+
+std::size_t count(const std::string& text, const std::string& part)
+{
+    std::size_t result = 0;
+    for (auto pos = text.find(part); pos != std::string::npos; pos = text.find(part, pos + part.size()))
+    {
+        ++result;
+    }
+    return result;
+}
+
+std::string convert(const std::string& tex)
+{
+    std::stringstream ss;
+    MathMLGenerator generator(ss);
+    generator.generate(tex);
+    return ss.str();
+}
+} // namespace
+
+TEST(MathMLGeneratorStackTestSuite, deepNesting)
+{
+    const auto output = convert(deepFormula());
+    EXPECT_EQ(count(output, "<mfrac>"), (DEPTH + 2) / 3);
+    EXPECT_EQ(count(output, "<msqrt>") + count(output, "<mroot>"), (DEPTH + 1) / 3);
+    EXPECT_EQ(count(output, "<mtable>"), DEPTH / 3);
+}
+
+#if defined(__unix__) || defined(__APPLE__)
+TEST(MathMLGeneratorStackTestSuite, smallThreadStack)
+{
+    struct Job
+    {
+        std::string tex;
+        std::string output;
+    } job{deepFormula(), {}};
+
+    pthread_attr_t attributes;
+    ASSERT_EQ(pthread_attr_init(&attributes), 0);
+    ASSERT_EQ(pthread_attr_setstacksize(&attributes, 64 * 1024), 0);
+
+    pthread_t thread;
+    const auto run = [](void* argument) -> void*
+    {
+        auto& job = *static_cast<Job*>(argument);
+        job.output = convert(job.tex);
+        return nullptr;
+    };
+    ASSERT_EQ(pthread_create(&thread, &attributes, run, &job), 0);
+    pthread_join(thread, nullptr);
+    pthread_attr_destroy(&attributes);
+
+    EXPECT_EQ(job.output, convert(job.tex));
+}
+#endif
+} // namespace TXL
@@ -0,0 +1,100 @@
+#include "src/mml/MathMLTree.h"
+
+#include <gtest/gtest.h>
+
+#include <string>
+#include <vector>
+
+namespace TXL
+{
+using namespace testing;
+
+TEST(MathMLTreeTestSuite, serialize)
+{
+    MathMLTree tree;
+
+    const auto mark = tree.mark();
+    tree.push(tree.textElement("mi", "", "x"));
+    tree.push(tree.textElement("mo", " stretchy=\"false\"", "+"));
+    tree.push(tree.markup("<mspace width=\"2em\"/>"));
+    const auto row = tree.element("mrow", "", mark);
+    const auto root = tree.element("msup", "", {row, tree.textElement("mn", "", "2")});
+
+    std::string out;
+    tree.serialize(root, out);
+    EXPECT_EQ(out, "<msup><mrow><mi>x</mi><mo stretchy=\"false\">+</mo><mspace width=\"2em\"/></mrow><mn>2</mn></msup>");
+    EXPECT_EQ(tree.mark(), mark);
+}
+
+TEST(MathMLTreeTestSuite, fragment)
+{
+    MathMLTree tree;
+
+    const auto single = tree.textElement("mi", "", "x");
+    tree.push(single);
+    EXPECT_EQ(tree.fragment(0), single);
+
+    tree.push(tree.textElement("mi", "", "a"));
+    tree.push(tree.textElement("mi", "", "b"));
+    const auto both = tree.fragment(0);
+    EXPECT_EQ(tree.node(both).kind, MathMLTree::Kind::Fragment);
+
+    std::string out;
+    tree.serialize(tree.element("mrow", "", {both}), out);
+    EXPECT_EQ(out, "<mrow><mi>a</mi><mi>b</mi></mrow>");
+
+    out.clear();
+    tree.serialize(tree.fragment(0), out);
+    EXPECT_EQ(out, "");
+}
+
+TEST(MathMLTreeTestSuite, nestedMarks)
+{
+    MathMLTree tree;
+
+    const auto outer = tree.mark();
+    tree.push(tree.textElement("mi", "", "a"));
+
+    const auto inner = tree.mark();
+    tree.push(tree.textElement("mi", "", "b"));
+    tree.push(tree.element("mtd", "", inner));
+
+    tree.push(tree.textElement("mi", "", "c"));
+    const auto root = tree.element("mtr", "", outer);
+
+    std::string out;
+    tree.serialize(root, out);
+    EXPECT_EQ(out, "<mtr><mi>a</mi><mtd><mi>b</mi></mtd><mi>c</mi></mtr>");
+}
+
+TEST(MathMLTreeTestSuite, storeKeepsText)
+{
+    MathMLTree tree;
+
+    const std::string big(10000, 'x');
+    std::vector<std::string_view> stored;
+    for (int i = 0; i < 100; ++i)
+    {
+        stored.push_back(tree.store({" color='", std::to_string(i), "'"}));
+    }
+    const auto large = tree.store({big});
+
+    for (int i = 0; i < 100; ++i)
+    {
+        EXPECT_EQ(stored[i], " color='" + std::to_string(i) + "'");
+    }
+    EXPECT_EQ(large, big);
+
+    tree.clear();
+    EXPECT_EQ(tree.size(), 0u);
+    EXPECT_EQ(tree.store({"a", "b"}), "ab");
+}
+
+TEST(MathMLTreeTestSuite, storeSkipsEmptyParts)
+{
+    MathMLTree tree;
+    // Like the open fence of \left. in an mfenced element
+    EXPECT_EQ(tree.store({" open='", std::string_view(), "' close='", ")", "'"}), " open='' close=')'");
+    EXPECT_EQ(tree.store({std::string_view(), std::string_view()}), "");
+}
+} // namespace TXL
@@ -0,0 +1,68 @@
+#include "src/mml/MathMLGenerator.h"
+#include "src/mml/OutputOptions.h"
+
+#include <gtest/gtest.h>
+
+#include <sstream>
+#include <stdexcept>
+#include <string>
+
+namespace TXL
+{
+using namespace testing;
+
+namespace
+{
+const std::string FRAC = "<mrow><mfrac><mrow><mn>1</mn></mrow><mrow><mi>x</mi></mrow></mfrac></mrow>";
+
+// \frac{1}{x} and x, which takes the path for single tokens
+std::string generate(const OutputOptions& options)
+{
+    std::stringstream ss;
+    MathMLGenerator generator(ss);
+    generator.setOptions(options);
+    generator.generate("\\frac{1}{x}");
+    generator.generate("x");
+    return ss.str();
+}
+} // namespace
+
+TEST(OutputOptionsTestSuite, defaults)
+{
+    const std::string begin = "<?xml version=\"1.0\" encoding=\"UTF-8\"?>\n"
+                              "<math xmlns=\"http://www.w3.org/1998/Math/MathML\">\n";
+    EXPECT_EQ(generate(OutputOptions()),
+              begin + FRAC + "\n</math>\n" + begin + "<mrow><mi>x</mi></mrow>\n</math>\n");
+}
+
+TEST(OutputOptionsTestSuite, wrapper)
+{
+    OutputOptions options;
+    options.prolog = false;
+    options.attributes += " display=\"block\"";
+    options.whitespace = OutputOptions::Whitespace::Compact;
+
+    const std::string begin = "<math xmlns=\"http://www.w3.org/1998/Math/MathML\" display=\"block\">";
+    EXPECT_EQ(generate(options), begin + FRAC + "</math>" + begin + "<mrow><mi>x</mi></mrow></math>");
+
+    options.element = "span";
+    options.attributes.clear();
+    EXPECT_EQ(generate(options), "<span>" + FRAC + "</span><span><mrow><mi>x</mi></mrow></span>");
+}
+
+TEST(OutputOptionsTestSuite, fragment)
+{
+    OutputOptions options;
+    options.fragment = true;
+    EXPECT_EQ(generate(options), FRAC + "\n<mrow><mi>x</mi></mrow>\n");
+
+    options.whitespace = OutputOptions::Whitespace::Compact;
+    EXPECT_EQ(generate(options), FRAC + "<mrow><mi>x</mi></mrow>");
+
+    // A fragment needs no element
+    options.element.clear();
+    EXPECT_NO_THROW(generate(options));
+    options.fragment = false;
+    EXPECT_THROW(generate(options), std::invalid_argument);
+}
+} // namespace TXL
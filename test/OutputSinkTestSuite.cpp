@@ -0,0 +1,182 @@
+#include "src/mml/MathMLGenerator.h"
+#include "src/mml/OutputSink.h"
+
+#include <gtest/gtest.h>
+
+#include <sstream>
+#include <string>
+
+#ifdef TXL_HAS_WRITEV
+#include <unistd.h>
+#endif
+
+namespace TXL
+{
+using namespace testing;
+
+namespace
+{
+const std::string TEX =
+    "\\left( \\frac{a}{b} \\right)^2 + x_i^{n} \\begin{pmatrix} 1 & \\mbox{text} \\\\ c & d \\end{pmatrix}"
+    "\\left[ \\sqrt{2} \\left. y \\right| \\right] - \\mathbb{R}";
+
+std::string generateToStream(const std::string& tex)
+{
+    std::stringstream out;
+    MathMLGenerator generator(out);
+    generator.generate(tex);
+    return out.str();
+}
+} // namespace
+
+TEST(OutputSinkTestSuite, stringSink)
+{
+    std::string out;
+    StringSink sink(out);
+    MathMLGenerator generator(sink);
+    generator.generate(TEX);
+    EXPECT_EQ(out, generateToStream(TEX));
+
+    out.clear();
+    generator.generate("x");
+    EXPECT_EQ(out, generateToStream("x"));
+}
+
+TEST(OutputSinkTestSuite, streamSinkSmallBuffer)
+{
+    std::stringstream out;
+    StreamSink sink(out, 4);
+    MathMLGenerator generator(sink);
+    generator.generate(TEX);
+    generator.generate(TEX);
+
+    const auto single = generateToStream(TEX);
+    EXPECT_EQ(out.str(), single + single);
+}
+
+TEST(OutputSinkTestSuite, streamsLongFormula)
+{
+    std::string tex;
+    for (int i = 0; i < 2000; ++i)
+    {
+        tex += "a_" + std::to_string(i) + " + \\left( b \\right) ";
+    }
+
+    std::string out;
+    StringSink sink(out);
+    MathMLGenerator generator(sink);
+    generator.generate(tex);
+    EXPECT_EQ(out, generateToStream(tex));
+}
+
+TEST(OutputSinkTestSuite, flushOnDemand)
+{
+    struct FlushCounter final : public OutputSink
+    {
+        void write(std::string_view text) override
+        {
+            out.append(text.data(), text.size());
+        }
+
+        void flush() override
+        {
+            ++flushes;
+        }
+
+        std::string out;
+        int flushes = 0;
+    } sink;
+
+    MathMLGenerator generator(sink);
+    generator.generate(TEX);
+    generator.generate("x");
+    EXPECT_EQ(sink.flushes, 2);
+
+    generator.setFlushMode(MathMLGenerator::FlushMode::OnDemand);
+    generator.generate(TEX);
+    generator.generate("x");
+    EXPECT_EQ(sink.flushes, 2);
+    generator.flush();
+    EXPECT_EQ(sink.flushes, 3);
+
+    const auto documents = generateToStream(TEX) + generateToStream("x");
+    EXPECT_EQ(sink.out, documents + documents);
+}
+
+#ifdef TXL_HAS_WRITEV
+TEST(OutputSinkTestSuite, fdSink)
+{
+    int fds[2];
+    ASSERT_EQ(::pipe(fds), 0);
+    {
+        // Small enough that most documents go out with a full buffer
+        FdSink sink(fds[1], 64);
+        MathMLGenerator generator(sink);
+        generator.setFlushMode(MathMLGenerator::FlushMode::OnDemand);
+        generator.generate(TEX);
+        generator.generate("x");
+    }
+    ::close(fds[1]);
+
+    std::string written;
+    char buffer[4096];
+    for (ssize_t count; (count = ::read(fds[0], buffer, sizeof(buffer))) > 0;)
+    {
+        written.append(buffer, static_cast<std::size_t>(count));
+    }
+    ::close(fds[0]);
+    EXPECT_EQ(written, generateToStream(TEX) + generateToStream("x"));
+}
+
+TEST(OutputSinkTestSuite, iovecSink)
+{
+    IovecSink sink;
+    MathMLGenerator generator(sink);
+    generator.generate(TEX);
+
+    const auto expected = generateToStream(TEX);
+    std::string joined;
+    for (const auto& slice : sink.slices())
+    {
+        joined.append(static_cast<const char*>(slice.iov_base), slice.iov_len);
+    }
+    EXPECT_EQ(joined, expected);
+    EXPECT_EQ(sink.size(), expected.size());
+
+    int fds[2];
+    ASSERT_EQ(::pipe(fds), 0);
+    sink.writeTo(fds[1]);
+    ::close(fds[1]);
+    EXPECT_TRUE(sink.slices().empty());
+
+    std::string written;
+    char buffer[4096];
+    for (ssize_t count; (count = ::read(fds[0], buffer, sizeof(buffer))) > 0;)
+    {
+        written.append(buffer, static_cast<std::size_t>(count));
+    }
+    ::close(fds[0]);
+    EXPECT_EQ(written, expected);
+}
+
+TEST(OutputSinkTestSuite, iovecSinkOutlivesText)
+{
+    // The texts are gone when the slices are read, the second one is a
+    // single token written without lexing
+    const std::string atom = "abcdefghijklmnopqrstuvwxyz";
+    IovecSink sink;
+    MathMLGenerator generator(sink);
+    MathMLGenerator atomGenerator(sink);
+    generator.generate(std::string(TEX));
+    atomGenerator.generate(std::string(atom));
+    const std::string scribble(TEX.size(), '#');
+
+    std::string joined;
+    for (const auto& slice : sink.slices())
+    {
+        joined.append(static_cast<const char*>(slice.iov_base), slice.iov_len);
+    }
+    EXPECT_EQ(joined, generateToStream(TEX) + generateToStream(atom));
+}
+#endif
+} // namespace TXL
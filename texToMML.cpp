@@ -1,12 +1,242 @@
+#include "src/FormulaReader.h"
+#include "src/mml/BatchConverter.h"
+#include "src/mml/ConversionLimits.h"
+#include "src/mml/ConversionStats.h"
 #include "src/mml/MathMLGenerator.h"
+#include "src/mml/OutputOptions.h"
+#include "src/mml/OutputSink.h"
 
+#include <cctype>
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
 #include <iostream>
+#include <memory>
+#include <optional>
+#include <stdexcept>
+
+#ifdef TXL_HAS_WRITEV
+#include <unistd.h>
+#endif
 
 using namespace TXL;
 
-int main()
+namespace
+{
+void printUsage()
+{
+    std::cerr << "usage: texToMML [--lines | --delimiter <line> | --jsonl] [-j <threads>] [--stats] [limits] [output] [in.tex] > out.xml" << std::endl
+              << "  --lines              every input line is a formula" << std::endl
+              << "  --delimiter <line>   formulas are separated by lines equal to <line>" << std::endl
+              << "  --jsonl              every input line is {\"tex\": \"...\"}" << std::endl
+              << "  -j <threads>         convert formulas in parallel, output keeps the input order" << std::endl
+              << "  --stats              print conversion counters and timings as JSON to stderr" << std::endl
+              << "  --max-depth <n>      fail formulas nested deeper than n levels" << std::endl
+              << "  --max-tokens <n>     fail formulas with more than n tokens" << std::endl
+              << "  --max-output <n>     fail documents larger than n bytes" << std::endl
+              << "  --timeout <ms>       fail formulas taking longer than ms milliseconds" << std::endl
+              << "  --no-prolog          leave out <?xml ...?>" << std::endl
+              << "  --block              write <math display=\"block\">" << std::endl
+              << "  --fragment           write only the <mrow> of each formula" << std::endl
+              << "  --compact            no newlines around the formulas" << std::endl
+              << "Without options the whole input is one formula. Of many formulas, those over a" << std::endl
+              << "limit are left out of the output and reported on stderr, the rest are converted." << std::endl
+              << "The input is in.tex when given, otherwise stdin." << std::endl;
+}
+
+// `number` counts the formulas of the input from 1
+void reportLimit(std::size_t number, const LimitExceeded& error)
+{
+    std::cerr << "texToMML: formula " << number << ": " << error.what() << std::endl;
+}
+
+// A whole non-negative number, nothing else
+bool parseCount(const char* text, std::size_t& count)
 {
-    MathMLGenerator gen(std::cout);
-    gen.generateFromIN();
+    char* end = nullptr;
+    const auto value = std::strtoull(text, &end, 10);
+    if (!std::isdigit(static_cast<unsigned char>(text[0])) || *end)
+    {
+        return false;
+    }
+    count = static_cast<std::size_t>(value);
+    return true;
+}
+} // namespace
+
+int main(int argc, char** argv)
+{
+    std::optional<FormulaReader::Format> format;
+    std::string delimiter;
+    std::size_t threads = 1;
+    const char* path = nullptr;
+    bool printStats = false;
+    ConversionLimits limits;
+    OutputOptions options;
+    std::size_t timeout = 0;
+    for (int i = 1; i < argc; ++i)
+    {
+        if (std::strcmp(argv[i], "--lines") == 0)
+        {
+            format = FormulaReader::Format::Lines;
+        }
+        else if (std::strcmp(argv[i], "--delimiter") == 0 && i + 1 < argc)
+        {
+            format = FormulaReader::Format::Delimited;
+            delimiter = argv[++i];
+        }
+        else if (std::strcmp(argv[i], "--jsonl") == 0)
+        {
+            format = FormulaReader::Format::JsonLines;
+        }
+        else if (std::strcmp(argv[i], "-j") == 0 && i + 1 < argc && std::atoi(argv[i + 1]) > 0)
+        {
+            threads = static_cast<std::size_t>(std::atoi(argv[++i]));
+        }
+        else if (std::strcmp(argv[i], "--stats") == 0)
+        {
+            printStats = true;
+        }
+        else if (std::strcmp(argv[i], "--max-depth") == 0 && i + 1 < argc && parseCount(argv[i + 1], limits.maxDepth))
+        {
+            ++i;
+        }
+        else if (std::strcmp(argv[i], "--max-tokens") == 0 && i + 1 < argc && parseCount(argv[i + 1], limits.maxTokens))
+        {
+            ++i;
+        }
+        else if (std::strcmp(argv[i], "--max-output") == 0 && i + 1 < argc && parseCount(argv[i + 1], limits.maxOutputBytes))
+        {
+            ++i;
+        }
+        else if (std::strcmp(argv[i], "--timeout") == 0 && i + 1 < argc && parseCount(argv[i + 1], timeout))
+        {
+            limits.maxTime = std::chrono::milliseconds(timeout);
+            ++i;
+        }
+        else if (std::strcmp(argv[i], "--no-prolog") == 0)
+        {
+            options.prolog = false;
+        }
+        else if (std::strcmp(argv[i], "--block") == 0)
+        {
+            options.attributes += " display=\"block\"";
+        }
+        else if (std::strcmp(argv[i], "--fragment") == 0)
+        {
+            options.fragment = true;
+        }
+        else if (std::strcmp(argv[i], "--compact") == 0)
+        {
+            options.whitespace = OutputOptions::Whitespace::Compact;
+        }
+        else if (argv[i][0] != '-' && !path)
+        {
+            path = argv[i];
+        }
+        else
+        {
+            printUsage();
+            return 1;
+        }
+    }
+
+    if (printStats && !ConversionStats::ENABLED)
+    {
+        std::cerr << "texToMML: --stats needs a build with TXL_STATS" << std::endl;
+        return 1;
+    }
+
+    // Lets std::cin report how much input is ready, see the loop below
+    std::ios::sync_with_stdio(false);
+
+#ifdef TXL_HAS_WRITEV
+    // Written to the descriptor directly, only BatchConverter uses std::cout
+    FdSink sink(STDOUT_FILENO);
+#else
+    StreamSink sink(std::cout);
+#endif
+    ConversionStats stats;
+    MathMLGenerator gen(sink);
+    gen.setStats(printStats ? &stats : nullptr);
+    gen.setLimits(limits);
+    gen.setOptions(options);
+    try
+    {
+        if (!format && !path)
+        {
+            gen.generateFromIN();
+        }
+        else if (!format)
+        {
+            // Mapped and lexed in place, however large the file is
+            gen.generateFromFile(path);
+        }
+        else
+        {
+            std::ifstream file;
+            if (path)
+            {
+                file.open(path);
+                if (!file)
+                {
+                    throw std::runtime_error(std::string("cannot open ") + path);
+                }
+            }
+            const auto reader = std::make_unique<FormulaReader>(path ? file : std::cin, *format, delimiter);
+
+            if (threads > 1)
+            {
+                BatchConverter converter(std::cout, threads);
+                converter.setStats(printStats ? &stats : nullptr);
+                converter.setLimits(limits);
+                converter.setLimitHandler([](std::size_t index, const LimitExceeded& error)
+                {
+                    reportLimit(index + 1, error);
+                });
+                converter.setOptions(options);
+                for (std::string tex; reader->next(tex);)
+                {
+                    converter.add(std::move(tex));
+                }
+                converter.finish();
+            }
+            else
+            {
+                // Flushed when the next formula is not there yet, rather than after each one
+                auto& input = path ? static_cast<std::istream&>(file) : std::cin;
+                gen.setFlushMode(MathMLGenerator::FlushMode::OnDemand);
+                std::size_t number = 0;
+                for (std::string tex; reader->next(tex);)
+                {
+                    ++number;
+                    try
+                    {
+                        gen.generate(tex);
+                    }
+                    catch (const LimitExceeded& error)
+                    {
+                        reportLimit(number, error);
+                    }
+                    if (input.rdbuf()->in_avail() <= 0)
+                    {
+                        gen.flush();
+                    }
+                }
+                gen.flush();
+            }
+        }
+    }
+    catch (const std::exception& e)
+    {
+        std::cerr << "texToMML: " << e.what() << std::endl;
+        return 1;
+    }
+
+    if (printStats)
+    {
+        stats.writeJson(std::cerr);
+    }
     return 0;
 }